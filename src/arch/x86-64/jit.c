@@ -0,0 +1,691 @@
+#include "class.h"
+#include "exec.h"
+#include "gc.h"
+#include "jit.h"
+#include "opcode.h"
+#include "quicken.h"
+#include "runtime.h"
+#include "thread.h"
+#include "typeflow.h"
+#include "util.h"
+#include "x86.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+int jit_enabled = 1;
+
+/*
+ * Frame of a compiled method:
+ *
+ *   rbx                   -> locals, in the Java stack exactly as for the interpreter
+ *   rsp + 8*max_stack     -> the Frame_t of the method
+ *   rsp + 8*k             -> operand stack slot k, in the native frame
+ *
+ * The depth of the operand stack before each instruction comes from
+ * infer_types(), so every template addresses its operands directly and the
+ * stack pointer never moves. rsp stays 16-byte aligned for calls into the
+ * runtime, which are made for division, float to int conversion and
+ * comparison, quickening, allocation and invocation. Frame_t::stack is rsp,
+ * and ip and sp are stored there before allocation and invocation just as
+ * the interpreter does.
+ */
+typedef struct {
+    Method_t* m;
+    CodeBuf_t cb;
+    size_t* native_at; // code offset of each instruction, and of the epilogue at nr_insns
+    struct {
+        size_t at; // of a rel32 displacement
+        size_t target; // instruction index
+    }* fixups;
+    size_t nr_fixups;
+} Jit_t;
+
+static int32_t slot(size_t k)
+{
+    return 8 * k;
+}
+static int32_t local(uint16_t index)
+{
+    return 8 * index;
+}
+
+/*
+ * Slots are always written whole even though an int or float only defines
+ * the low half, as a narrower store followed by a full width load of the same
+ * slot (which is what every load and store of a local does) defeats store
+ * forwarding.
+ */
+static void store_slot(CodeBuf_t* cb, int base, int32_t disp, int reg)
+{
+    mov_store(cb, 1, base, disp, reg);
+}
+static void store_slot_xmm0(CodeBuf_t* cb, int32_t disp)
+{
+    op_mem(cb, 0x66, 0, SSE_MOVQ_STORE, 0, RSP, disp);
+}
+
+static void branch_to(Jit_t* j, size_t at, size_t target)
+{
+    j->fixups = realloc(j->fixups, sizeof(j->fixups[0]) * (j->nr_fixups + 1));
+    j->fixups[j->nr_fixups].at = at;
+    j->fixups[j->nr_fixups].target = target;
+    j->nr_fixups++;
+}
+
+// tell the collector which slots hold references while insn runs, those of the top nr_args not being ours
+static void emit_publish(Jit_t* j, Insn_t* insn, size_t nr_args)
+{
+    CodeBuf_t* cb = &j->cb;
+    size_t d = j->m->stack_depth[insn - j->m->insns];
+    mov_load(cb, 1, RAX, RSP, slot(j->m->max_stack));
+    mov_imm64(cb, RCX, (uintptr_t)insn);
+    mov_store(cb, 1, RAX, offsetof(Frame_t, ip), RCX);
+    mov_store_imm(cb, 1, RAX, offsetof(Frame_t, sp), (int32_t)(d - nr_args) - 1);
+}
+
+// call quicken() the first time the instruction runs, unless it already was
+static void emit_quicken(Jit_t* j, Insn_t* insn, enum opcode op)
+{
+    CodeBuf_t* cb = &j->cb;
+    if (insn->op != op)
+        return;
+    mov_imm64(cb, RDI, (uintptr_t)insn);
+    op_mem(cb, 0x66, 0, 0x81, 7, RDI, offsetof(Insn_t, op));
+    emit16(cb, op);
+    size_t done = jcc8(cb, CC_NE);
+    mov_imm64(cb, RSI, (uintptr_t)j->m);
+    call_abs(cb, (uintptr_t)quicken);
+    patch8(cb, done);
+}
+
+// type of the field referenced by a GETFIELD/PUTFIELD, quickened or not
+static enum ValueType field_type(Method_t const* m, Insn_t const* insn)
+{
+    return get_value_type(resolve_ref_desc(m->c->constant_pool.list, insn->index)[0]);
+}
+static void invoke_shape(Method_t const* m, Insn_t const* insn, enum opcode op, size_t* nr_args, int* returns)
+{
+    if (insn->op != op) {
+        *nr_args = insn->nr_args;
+        *returns = insn->returns;
+        return;
+    }
+    char const* desc = resolve_ref_desc(m->c->constant_pool.list, insn->index);
+    *nr_args = nr_desc_args(desc) + (op != INVOKESTATIC);
+    *returns = (strchr(desc, ')')[1] != 'V');
+}
+
+static enum Cond branch_cond(enum opcode op)
+{
+    switch (op) {
+    case IFEQ:
+    case IF_ICMPEQ:
+    case IF_ACMPEQ:
+        return CC_E;
+    case IFNE:
+    case IF_ICMPNE:
+    case IF_ACMPNE:
+        return CC_NE;
+    case IFLT:
+    case IF_ICMPLT:
+        return CC_L;
+    case IFGE:
+    case IF_ICMPGE:
+        return CC_GE;
+    case IFGT:
+    case IF_ICMPGT:
+        return CC_G;
+    case IFLE:
+    case IF_ICMPLE:
+        return CC_LE;
+    default:
+        panicf("not a conditional branch 0x%x", op);
+    }
+}
+
+// rax = [a] op [b], stored back to a
+static void emit_alu(CodeBuf_t* cb, int w, uint16_t alu, size_t d)
+{
+    mov_load(cb, w, RAX, RSP, slot(d - 2));
+    op_mem(cb, 0, w, alu, RAX, RSP, slot(d - 1));
+    store_slot(cb, RSP, slot(d - 2), RAX);
+}
+// rax = fn([a], [b]) for integral operands
+static void emit_call2(CodeBuf_t* cb, int w, uintptr_t fn, size_t d)
+{
+    mov_load(cb, w, RDI, RSP, slot(d - 2));
+    mov_load(cb, w, RSI, RSP, slot(d - 1));
+    call_abs(cb, fn);
+    store_slot(cb, RSP, slot(d - 2), RAX);
+}
+// shift [a] by [b] & (width - 1), which is what x86 does with cl
+static void emit_shift(CodeBuf_t* cb, int w, int ext, size_t d)
+{
+    mov_load(cb, w, RAX, RSP, slot(d - 2));
+    mov_load(cb, 0, RCX, RSP, slot(d - 1));
+    op_reg(cb, 0, w, 0xd3, ext, RAX);
+    store_slot(cb, RSP, slot(d - 2), RAX);
+}
+// xmm0 = [a] op [b], prefix selecting single or double precision
+static void emit_sse(CodeBuf_t* cb, uint8_t prefix, uint16_t sse, size_t d)
+{
+    op_mem(cb, prefix, 0, SSE_MOV, 0, RSP, slot(d - 2));
+    op_mem(cb, prefix, 0, sse, 0, RSP, slot(d - 1));
+    store_slot_xmm0(cb, slot(d - 2));
+}
+// xmm0 = [a], xmm1 = [b], then fn
+static void emit_sse_call2(CodeBuf_t* cb, uint8_t prefix, uintptr_t fn, size_t d)
+{
+    op_mem(cb, prefix, 0, SSE_MOV, 0, RSP, slot(d - 2));
+    op_mem(cb, prefix, 0, SSE_MOV, 1, RSP, slot(d - 1));
+    call_abs(cb, fn);
+}
+// rax = fn(xmm0 = [top]), stored back to top
+static void emit_convert_call(CodeBuf_t* cb, uint8_t prefix, uintptr_t fn, size_t d)
+{
+    op_mem(cb, prefix, 0, SSE_MOV, 0, RSP, slot(d - 1));
+    call_abs(cb, fn);
+    store_slot(cb, RSP, slot(d - 1), RAX);
+}
+// v is sign extended from 32 bits unless wide
+static void emit_push_imm(CodeBuf_t* cb, int wide, uint64_t v, size_t d)
+{
+    if (wide && (int64_t)v != (int32_t)v) {
+        mov_imm64(cb, RAX, v);
+        store_slot(cb, RSP, slot(d), RAX);
+    } else
+        mov_store_imm(cb, 1, RSP, slot(d), (int32_t)v);
+}
+
+// emit the template of instruction i, returning 0 if there is none
+static int emit_insn(Jit_t* j, size_t i)
+{
+    CodeBuf_t* cb = &j->cb;
+    Method_t* m = j->m;
+    Insn_t* insn = &m->insns[i];
+    // fused and quickened instructions are compiled from their original opcode
+    enum opcode op = m->code[insn->pc];
+    size_t d = m->stack_depth[i];
+
+    switch (op) {
+    case NOP:
+        break;
+    case ACONST_NULL:
+        emit_push_imm(cb, 1, 0, d);
+        break;
+    case ICONST_M1:
+    case ICONST_0:
+    case ICONST_1:
+    case ICONST_2:
+    case ICONST_3:
+    case ICONST_4:
+    case ICONST_5:
+    case BIPUSH:
+    case SIPUSH:
+    case FCONST_0:
+    case FCONST_1:
+    case FCONST_2:
+        emit_push_imm(cb, 0, (uint32_t)insn->i, d);
+        break;
+    case LCONST_0:
+    case LCONST_1:
+    case DCONST_0:
+    case DCONST_1:
+        emit_push_imm(cb, 1, insn->l, d);
+        break;
+    case LDC:
+    case LDC_W:
+    case LDC2_W:
+        emit_push_imm(cb, insn->type == L || insn->type == D, insn->type == L || insn->type == D ? (uint64_t)insn->l : (uint32_t)insn->i, d);
+        break;
+
+    case ILOAD:
+    case LLOAD:
+    case FLOAD:
+    case DLOAD:
+    case ALOAD:
+    case ILOAD_0:
+    case ILOAD_1:
+    case ILOAD_2:
+    case ILOAD_3:
+    case LLOAD_0:
+    case LLOAD_1:
+    case LLOAD_2:
+    case LLOAD_3:
+    case FLOAD_0:
+    case FLOAD_1:
+    case FLOAD_2:
+    case FLOAD_3:
+    case DLOAD_0:
+    case DLOAD_1:
+    case DLOAD_2:
+    case DLOAD_3:
+    case ALOAD_0:
+    case ALOAD_1:
+    case ALOAD_2:
+    case ALOAD_3:
+        mov_load(cb, 1, RAX, RBX, local(insn->index));
+        store_slot(cb, RSP, slot(d), RAX);
+        break;
+    case ISTORE:
+    case LSTORE:
+    case FSTORE:
+    case DSTORE:
+    case ASTORE:
+    case ISTORE_0:
+    case ISTORE_1:
+    case ISTORE_2:
+    case ISTORE_3:
+    case LSTORE_0:
+    case LSTORE_1:
+    case LSTORE_2:
+    case LSTORE_3:
+    case FSTORE_0:
+    case FSTORE_1:
+    case FSTORE_2:
+    case FSTORE_3:
+    case DSTORE_0:
+    case DSTORE_1:
+    case DSTORE_2:
+    case DSTORE_3:
+    case ASTORE_0:
+    case ASTORE_1:
+    case ASTORE_2:
+    case ASTORE_3:
+        mov_load(cb, 1, RAX, RSP, slot(d - 1));
+        store_slot(cb, RBX, local(insn->index), RAX);
+        break;
+    case IINC:
+        mov_load(cb, 0, RAX, RBX, local(insn->index));
+        op_reg(cb, 0, 0, 0x81, 0, RAX);
+        emit32(cb, insn->i);
+        store_slot(cb, RBX, local(insn->index), RAX);
+        break;
+
+    case POP:
+        break;
+    case DUP:
+        mov_load(cb, 1, RAX, RSP, slot(d - 1));
+        store_slot(cb, RSP, slot(d), RAX);
+        break;
+    case SWAP:
+        mov_load(cb, 1, RAX, RSP, slot(d - 1));
+        mov_load(cb, 1, RCX, RSP, slot(d - 2));
+        store_slot(cb, RSP, slot(d - 1), RCX);
+        store_slot(cb, RSP, slot(d - 2), RAX);
+        break;
+
+    case IADD:
+        emit_alu(cb, 0, ALU_ADD, d);
+        break;
+    case ISUB:
+        emit_alu(cb, 0, ALU_SUB, d);
+        break;
+    case IMUL:
+        emit_alu(cb, 0, ALU_IMUL, d);
+        break;
+    case IAND:
+        emit_alu(cb, 0, ALU_AND, d);
+        break;
+    case IOR:
+        emit_alu(cb, 0, ALU_OR, d);
+        break;
+    case IXOR:
+        emit_alu(cb, 0, ALU_XOR, d);
+        break;
+    case LADD:
+        emit_alu(cb, 1, ALU_ADD, d);
+        break;
+    case LSUB:
+        emit_alu(cb, 1, ALU_SUB, d);
+        break;
+    case LMUL:
+        emit_alu(cb, 1, ALU_IMUL, d);
+        break;
+    case LAND:
+        emit_alu(cb, 1, ALU_AND, d);
+        break;
+    case LOR:
+        emit_alu(cb, 1, ALU_OR, d);
+        break;
+    case LXOR:
+        emit_alu(cb, 1, ALU_XOR, d);
+        break;
+    case IDIV:
+        emit_call2(cb, 0, (uintptr_t)jit_idiv, d);
+        break;
+    case IREM:
+        emit_call2(cb, 0, (uintptr_t)jit_irem, d);
+        break;
+    case LDIV:
+        emit_call2(cb, 1, (uintptr_t)jit_ldiv, d);
+        break;
+    case LREM:
+        emit_call2(cb, 1, (uintptr_t)jit_lrem, d);
+        break;
+    case ISHL:
+        emit_shift(cb, 0, 4, d);
+        break;
+    case ISHR:
+        emit_shift(cb, 0, 7, d);
+        break;
+    case IUSHR:
+        emit_shift(cb, 0, 5, d);
+        break;
+    case LSHL:
+        emit_shift(cb, 1, 4, d);
+        break;
+    case LSHR:
+        emit_shift(cb, 1, 7, d);
+        break;
+    case LUSHR:
+        emit_shift(cb, 1, 5, d);
+        break;
+
+    case FADD:
+        emit_sse(cb, 0xf3, SSE_ADD, d);
+        break;
+    case FSUB:
+        emit_sse(cb, 0xf3, SSE_SUB, d);
+        break;
+    case FMUL:
+        emit_sse(cb, 0xf3, SSE_MUL, d);
+        break;
+    case FDIV:
+        emit_sse(cb, 0xf3, SSE_DIV, d);
+        break;
+    case DADD:
+        emit_sse(cb, 0xf2, SSE_ADD, d);
+        break;
+    case DSUB:
+        emit_sse(cb, 0xf2, SSE_SUB, d);
+        break;
+    case DMUL:
+        emit_sse(cb, 0xf2, SSE_MUL, d);
+        break;
+    case DDIV:
+        emit_sse(cb, 0xf2, SSE_DIV, d);
+        break;
+    case FREM:
+        emit_sse_call2(cb, 0xf3, (uintptr_t)fmodf, d);
+        store_slot_xmm0(cb, slot(d - 2));
+        break;
+    case DREM:
+        emit_sse_call2(cb, 0xf2, (uintptr_t)fmod, d);
+        store_slot_xmm0(cb, slot(d - 2));
+        break;
+
+    case INEG:
+        mov_load(cb, 0, RAX, RSP, slot(d - 1));
+        op_reg(cb, 0, 0, 0xf7, 3, RAX);
+        store_slot(cb, RSP, slot(d - 1), RAX);
+        break;
+    case LNEG:
+        op_mem(cb, 0, 1, 0xf7, 3, RSP, slot(d - 1));
+        break;
+    case FNEG:
+        // the high half flips too, which is harmless
+        op_mem(cb, 0, 1, 0x81, 6, RSP, slot(d - 1));
+        emit32(cb, 0x80000000);
+        break;
+    case DNEG:
+        mov_imm64(cb, RAX, 1ull << 63);
+        op_mem(cb, 0, 1, 0x31, RAX, RSP, slot(d - 1));
+        break;
+
+    case I2L:
+        op_mem(cb, 0, 1, 0x63, RAX, RSP, slot(d - 1));
+        store_slot(cb, RSP, slot(d - 1), RAX);
+        break;
+    case L2I:
+        // an int is the low half of the slot
+        break;
+    case I2F:
+    case L2F:
+        op_mem(cb, 0xf3, op == L2F, SSE_CVTSI2, 0, RSP, slot(d - 1));
+        store_slot_xmm0(cb, slot(d - 1));
+        break;
+    case I2D:
+    case L2D:
+        op_mem(cb, 0xf2, op == L2D, SSE_CVTSI2, 0, RSP, slot(d - 1));
+        store_slot_xmm0(cb, slot(d - 1));
+        break;
+    case F2D:
+        op_mem(cb, 0xf3, 0, SSE_CVT, 0, RSP, slot(d - 1));
+        store_slot_xmm0(cb, slot(d - 1));
+        break;
+    case D2F:
+        op_mem(cb, 0xf2, 0, SSE_CVT, 0, RSP, slot(d - 1));
+        store_slot_xmm0(cb, slot(d - 1));
+        break;
+    case F2I:
+        emit_convert_call(cb, 0xf3, (uintptr_t)jit_f2i, d);
+        break;
+    case F2L:
+        emit_convert_call(cb, 0xf3, (uintptr_t)jit_f2l, d);
+        break;
+    case D2I:
+        emit_convert_call(cb, 0xf2, (uintptr_t)jit_d2i, d);
+        break;
+    case D2L:
+        emit_convert_call(cb, 0xf2, (uintptr_t)jit_d2l, d);
+        break;
+    case I2B:
+    case I2C:
+    case I2S:
+        op_mem(cb, 0, 0, op == I2B ? 0x0fbe : op == I2C ? 0x0fb7 : 0x0fbf, RAX, RSP, slot(d - 1));
+        store_slot(cb, RSP, slot(d - 1), RAX);
+        break;
+
+    case LCMP:
+        op_reg(cb, 0, 0, ALU_XOR, RCX, RCX);
+        op_reg(cb, 0, 0, ALU_XOR, RDX, RDX);
+        mov_load(cb, 1, RAX, RSP, slot(d - 2));
+        op_mem(cb, 0, 1, ALU_CMP, RAX, RSP, slot(d - 1));
+        setcc(cb, CC_G, RCX);
+        setcc(cb, CC_L, RDX);
+        op_reg(cb, 0, 0, ALU_SUB, RCX, RDX);
+        store_slot(cb, RSP, slot(d - 2), RCX);
+        break;
+    case FCMPL:
+    case FCMPG:
+    case DCMPL:
+    case DCMPG:
+        mov_imm32(cb, RDI, op == FCMPL || op == DCMPL ? -1 : 1);
+        if (op == FCMPL || op == FCMPG)
+            emit_sse_call2(cb, 0xf3, (uintptr_t)jit_fcmp, d);
+        else
+            emit_sse_call2(cb, 0xf2, (uintptr_t)jit_dcmp, d);
+        store_slot(cb, RSP, slot(d - 2), RAX);
+        break;
+
+    case IFEQ:
+    case IFNE:
+    case IFLT:
+    case IFGE:
+    case IFGT:
+    case IFLE:
+        op_mem(cb, 0, 0, 0x83, 7, RSP, slot(d - 1));
+        emit8(cb, 0);
+        branch_to(j, jcc32(cb, branch_cond(op)), insn->target - m->insns);
+        break;
+    case IF_ICMPEQ:
+    case IF_ICMPNE:
+    case IF_ICMPLT:
+    case IF_ICMPGE:
+    case IF_ICMPGT:
+    case IF_ICMPLE:
+    case IF_ACMPEQ:
+    case IF_ACMPNE: {
+        int w = (op == IF_ACMPEQ || op == IF_ACMPNE);
+        mov_load(cb, w, RAX, RSP, slot(d - 2));
+        op_mem(cb, 0, w, ALU_CMP, RAX, RSP, slot(d - 1));
+        branch_to(j, jcc32(cb, branch_cond(op)), insn->target - m->insns);
+    } break;
+    case GOTO:
+        branch_to(j, jmp32(cb), insn->target - m->insns);
+        break;
+
+    case IRETURN:
+    case LRETURN:
+    case FRETURN:
+    case DRETURN:
+    case ARETURN:
+        mov_load(cb, 1, RAX, RSP, slot(d - 1));
+        branch_to(j, jmp32(cb), m->nr_insns);
+        break;
+    case RETURN:
+        op_reg(cb, 0, 0, ALU_XOR, RAX, RAX);
+        branch_to(j, jmp32(cb), m->nr_insns);
+        break;
+
+    case GETSTATIC:
+        emit_quicken(j, insn, op);
+        mov_imm64(cb, RAX, (uintptr_t)insn);
+        mov_load(cb, 1, RAX, RAX, offsetof(Insn_t, field));
+        mov_load(cb, 1, RAX, RAX, offsetof(Field_t, static_val));
+        store_slot(cb, RSP, slot(d), RAX);
+        break;
+    case PUTSTATIC:
+        emit_quicken(j, insn, op);
+        mov_imm64(cb, RAX, (uintptr_t)insn);
+        mov_load(cb, 1, RAX, RAX, offsetof(Insn_t, field));
+        mov_load(cb, 1, RCX, RSP, slot(d - 1));
+        mov_store(cb, 1, RAX, offsetof(Field_t, static_val), RCX);
+        break;
+    case GETFIELD:
+    case PUTFIELD: {
+        enum ValueType type = field_type(m, insn);
+        if (type == ARR)
+            return 0;
+        int w = (type == A || type == L || type == D);
+        size_t obj = (op == GETFIELD ? d - 1 : d - 2);
+        emit_quicken(j, insn, op);
+        mov_imm64(cb, RAX, (uintptr_t)insn);
+        mov_load(cb, 1, RCX, RAX, offsetof(Insn_t, offset));
+        mov_load(cb, 1, RAX, RSP, slot(obj));
+        op_reg(cb, 0, 1, ALU_ADD, RAX, RCX);
+        if (op == GETFIELD) {
+            mov_load(cb, w, RAX, RAX, 0);
+            store_slot(cb, RSP, slot(d - 1), RAX);
+        } else {
+            mov_load(cb, 1, RDX, RSP, slot(d - 1));
+            mov_store(cb, w, RAX, 0, RDX);
+            if (type == A) {
+                mov_load(cb, 1, RAX, RSP, slot(obj));
+                emit_write_barrier(cb, RAX, RCX);
+            }
+        }
+    } break;
+    case NEW:
+        emit_quicken(j, insn, op);
+        emit_publish(j, insn, 0);
+        mov_imm64(cb, RAX, (uintptr_t)insn);
+        mov_load(cb, 1, RDI, RAX, offsetof(Insn_t, class));
+        call_abs(cb, (uintptr_t)alloc_object);
+        store_slot(cb, RSP, slot(d), RAX);
+        break;
+
+    case INVOKEVIRTUAL:
+    case INVOKESPECIAL:
+    case INVOKESTATIC: {
+        size_t nr_args;
+        int returns;
+        invoke_shape(m, insn, op, &nr_args, &returns);
+        emit_quicken(j, insn, op);
+        emit_publish(j, insn, nr_args);
+        if (op == INVOKEVIRTUAL) {
+            mov_imm64(cb, RDI, (uintptr_t)insn);
+            lea(cb, RSI, RSP, slot(d - nr_args));
+            call_abs(cb, (uintptr_t)jit_invokevirtual);
+        } else {
+            mov_imm64(cb, RAX, (uintptr_t)insn);
+            mov_load(cb, 1, RDI, RAX, offsetof(Insn_t, method));
+            lea(cb, RSI, RSP, slot(d - nr_args));
+            mov_imm32(cb, RDX, nr_args);
+            call_abs(cb, (uintptr_t)call_method);
+        }
+        if (returns)
+            store_slot(cb, RSP, slot(d - nr_args), RAX);
+    } break;
+
+    default:
+        return 0;
+    }
+    return 1;
+}
+
+static void jit_abort(Jit_t* j, char const* why)
+{
+    debugf("jit: leaving %s.%s to the interpreter: %s\n", j->m->c->name, j->m->name, why);
+    j->m->jit.failed = 1;
+    free(j->cb.buf);
+    free(j->native_at);
+    free(j->fixups);
+}
+
+int jit_compile(Method_t* m)
+{
+    Jit_t j = { .m = m };
+    if (m->insns == NULL || !jit_enabled) {
+        m->jit.failed = 1;
+        return 0;
+    }
+    j.native_at = malloc(sizeof(j.native_at[0]) * (m->nr_insns + 1));
+
+    // the operand stack area, rounded so that rsp stays aligned after pushing rbp and rbx, which
+    // always leaves the slot after it for the Frame_t
+    int32_t frame = (8 * m->max_stack + 15) / 16 * 16 + 8;
+    CodeBuf_t* cb = &j.cb;
+    push(cb, RBP);
+    mov_reg(cb, 1, RBP, RSP);
+    push(cb, RBX);
+    sub_imm(cb, RSP, frame);
+    mov_reg(cb, 1, RBX, RDI);
+    mov_store(cb, 1, RSP, slot(m->max_stack), RSI);
+    mov_store(cb, 1, RSI, offsetof(Frame_t, stack), RSP);
+
+    for (size_t i = 0; i < m->nr_insns; ++i) {
+        j.native_at[i] = cb->len;
+        if (m->stack_depth[i] == DEPTH_UNREACHED)
+            continue;
+        if (!emit_insn(&j, i)) {
+            jit_abort(&j, get_string(m->code[m->insns[i].pc]));
+            return 0;
+        }
+    }
+
+    j.native_at[m->nr_insns] = cb->len;
+    lea(cb, RSP, RBP, -8);
+    pop(cb, RBX);
+    pop(cb, RBP);
+    ret(cb);
+
+    for (size_t i = 0; i < j.nr_fixups; ++i)
+        patch32(cb, j.fixups[i].at, j.native_at[j.fixups[i].target] - (j.fixups[i].at + 4));
+
+    size_t size;
+    void* code = install_code(cb, m, &size);
+    debugf("jit: compiled %s.%s%s into %lu bytes at %p\n", m->c->name, m->name, m->desc, cb->len, code);
+    m->jit.code = (JitCode_t) { .code = code, .size = size };
+    m->jit.tier = TIER_BASELINE;
+
+    free(cb->buf);
+    free(j.native_at);
+    free(j.fixups);
+    return 1;
+}
+
+void jit_free(Method_t const* m)
+{
+    if (m->jit.code.code != NULL)
+        munmap(m->jit.code.code, m->jit.code.size);
+    for (size_t i = 0; i < m->jit.nr_retired; ++i)
+        munmap(m->jit.retired[i].code, m->jit.retired[i].size);
+    for (size_t i = 0; i < m->nr_loops; ++i)
+        if (m->jit.osr[i].code != NULL)
+            munmap(m->jit.osr[i].code, m->jit.osr[i].size);
+}
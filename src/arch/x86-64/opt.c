@@ -0,0 +1,957 @@
+#include "cha.h"
+#include "class.h"
+#include "exec.h"
+#include "gc.h"
+#include "inline_cache.h"
+#include "ir.h"
+#include "jit.h"
+#include "opcode.h"
+#include "quicken.h"
+#include "regalloc.h"
+#include "runtime.h"
+#include "thread.h"
+#include "util.h"
+#include "x86.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+int opt_enabled = 1;
+
+/*
+ * Frame of a method compiled by the optimizing tier:
+ *
+ *   rbp                     -> saved rbp, below it the preserved registers the method uses
+ *   rsp + 8*(nr_out + s)    -> spill slot s
+ *   rsp + 8*k               -> outgoing argument k, passed to call_method() as its args array
+ *
+ * rax, rcx, rdx, r11, xmm0 and xmm1 are scratch and never hold a value
+ * across instructions. r11 holds the incoming locals while the parameters
+ * are loaded at the start of the entry block.
+ *
+ * References live across an allocation or a call are always spilled (see
+ * ir_allocate_registers()), and their spill slots come first. The Frame_t
+ * points the collector at those slots on entry, which are zeroed so that any
+ * not yet holding a reference holds NULL.
+ */
+#define XMM0 0
+#define XMM1 1
+#define PRESERVED (1u << RBX | 1u << R12 | 1u << R13 | 1u << R14 | 1u << R15)
+
+static uint8_t const gprs[] = { RSI, RDI, R8, R9, R10, RBX, R12, R13, R14, R15 };
+static uint8_t const xmms[] = { 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+static int is_const_divisor(IrFunc_t const* f, uint32_t v)
+{
+    return ir_is_const(f, v) && f->insns[v].imm != 0 && f->insns[v].imm != -1;
+}
+static int is_call(IrFunc_t const* f, IrInsn_t const* insn)
+{
+    switch (insn->op) {
+    case IR_CALL:
+    case IR_NEW:
+        return 1;
+    case IR_GETSTATIC:
+    case IR_PUTSTATIC:
+    case IR_GETFIELD:
+    case IR_PUTFIELD:
+        return (insn->flags & IR_UNRESOLVED) != 0;
+    case IR_DIV:
+        return !ir_class(insn->type) && !is_const_divisor(f, ir_arg(f, insn, 1));
+    case IR_REM:
+        return ir_class(insn->type) || !is_const_divisor(f, ir_arg(f, insn, 1));
+    case IR_CONV:
+        return insn->imm == F2I || insn->imm == F2L || insn->imm == D2I || insn->imm == D2L;
+    default:
+        return 0;
+    }
+}
+
+static int is_safepoint(IrFunc_t const* f, IrInsn_t const* insn)
+{
+    return insn->op == IR_CALL || insn->op == IR_NEW;
+}
+
+static RegInfo_t const reg_info = {
+    .nr_regs = { sizeof(gprs), sizeof(xmms) },
+    .regs = { gprs, xmms },
+    .preserved = { PRESERVED, 0 },
+    .is_call = is_call,
+    .is_safepoint = is_safepoint,
+};
+
+typedef struct {
+    IrFunc_t* f;
+    CodeBuf_t cb;
+    size_t* block_at; // code offset of each block
+    struct {
+        size_t at; // of a rel32 displacement
+        uint32_t block;
+    }* fixups;
+    size_t nr_fixups;
+    uint32_t next; // block laid out after the current one, or IR_NONE
+    int32_t spill_base;
+    uint8_t saved[sizeof(gprs)];
+    size_t nr_saved;
+} Opt_t;
+
+static int reg_of(Opt_t const* o, uint32_t v)
+{
+    return (ir_is_const(o->f, v) ? -1 : o->f->locs[v].reg);
+}
+static int32_t spill_of(Opt_t const* o, uint32_t v)
+{
+    return o->spill_base + 8 * o->f->locs[v].spill;
+}
+static int64_t imm_of(Opt_t const* o, uint32_t v)
+{
+    return o->f->insns[v].imm;
+}
+static int fits32(int64_t imm)
+{
+    return imm == (int32_t)imm;
+}
+static int is_xmm(Opt_t const* o, uint32_t v)
+{
+    return ir_class(o->f->insns[v].type);
+}
+
+// the bits of v into general purpose register reg, whatever its class
+static void load_gpr(Opt_t* o, int reg, uint32_t v)
+{
+    CodeBuf_t* cb = &o->cb;
+    if (ir_is_const(o->f, v)) {
+        int64_t imm = imm_of(o, v);
+        if (imm == (uint32_t)imm)
+            mov_imm32(cb, reg, imm);
+        else if (fits32(imm)) {
+            op_reg(cb, 0, 1, 0xc7, 0, reg);
+            emit32(cb, imm);
+        } else
+            mov_imm64(cb, reg, imm);
+    } else if (reg_of(o, v) >= 0) {
+        if (is_xmm(o, v))
+            movq_from_xmm(cb, reg, reg_of(o, v));
+        else if (reg_of(o, v) != reg)
+            mov_reg(cb, 1, reg, reg_of(o, v));
+    } else
+        mov_load(cb, 1, reg, RSP, spill_of(o, v));
+}
+static void load_xmm(Opt_t* o, int xmm, uint32_t v)
+{
+    CodeBuf_t* cb = &o->cb;
+    if (ir_is_const(o->f, v)) {
+        load_gpr(o, R11, v);
+        movq_to_xmm(cb, xmm, R11);
+    } else if (reg_of(o, v) >= 0) {
+        if (reg_of(o, v) != xmm)
+            op_reg(cb, 0, 0, SSE_MOVAPS, xmm, reg_of(o, v));
+    } else
+        op_mem(cb, 0xf2, 0, SSE_MOV, xmm, RSP, spill_of(o, v));
+}
+// the register holding v, loading it into scratch if it has none
+static int gpr_of(Opt_t* o, uint32_t v, int scratch)
+{
+    if (reg_of(o, v) >= 0)
+        return reg_of(o, v);
+    load_gpr(o, scratch, v);
+    return scratch;
+}
+static int xmm_of(Opt_t* o, uint32_t v, int scratch)
+{
+    if (reg_of(o, v) >= 0)
+        return reg_of(o, v);
+    load_xmm(o, scratch, v);
+    return scratch;
+}
+// the register to compute v in, scratch if v lives in memory
+static int dst_of(Opt_t const* o, uint32_t v, int scratch)
+{
+    return (reg_of(o, v) >= 0 ? reg_of(o, v) : scratch);
+}
+// v = reg, for v of either class
+static void store_gpr(Opt_t* o, uint32_t v, int reg)
+{
+    CodeBuf_t* cb = &o->cb;
+    if (reg_of(o, v) < 0)
+        mov_store(cb, 1, RSP, spill_of(o, v), reg);
+    else if (is_xmm(o, v))
+        movq_to_xmm(cb, reg_of(o, v), reg);
+    else if (reg_of(o, v) != reg)
+        mov_reg(cb, 1, reg_of(o, v), reg);
+}
+static void store_xmm(Opt_t* o, uint32_t v, int xmm)
+{
+    CodeBuf_t* cb = &o->cb;
+    if (reg_of(o, v) < 0)
+        op_mem(cb, 0x66, 0, SSE_MOVQ_STORE, xmm, RSP, spill_of(o, v));
+    else if (reg_of(o, v) != xmm)
+        op_reg(cb, 0, 0, SSE_MOVAPS, reg_of(o, v), xmm);
+}
+// op reg, v for an `op reg, r/m` opcode, a constant v going through scratch
+static void op_value(Opt_t* o, uint8_t prefix, int w, uint16_t op, int reg, uint32_t v, int scratch)
+{
+    CodeBuf_t* cb = &o->cb;
+    if (ir_is_const(o->f, v)) {
+        if (is_xmm(o, v))
+            load_xmm(o, scratch, v);
+        else
+            load_gpr(o, scratch, v);
+        op_reg(cb, prefix, w, op, reg, scratch);
+    } else if (reg_of(o, v) >= 0)
+        op_reg(cb, prefix, w, op, reg, reg_of(o, v));
+    else
+        op_mem(cb, prefix, w, op, reg, RSP, spill_of(o, v));
+}
+
+static void jump_to(Opt_t* o, size_t at, uint32_t block)
+{
+    o->fixups = realloc(o->fixups, sizeof(o->fixups[0]) * (o->nr_fixups + 1));
+    o->fixups[o->nr_fixups].at = at;
+    o->fixups[o->nr_fixups].block = block;
+    o->nr_fixups++;
+}
+static void emit_jump(Opt_t* o, uint32_t block)
+{
+    if (block != o->next)
+        jump_to(o, jmp32(&o->cb), block);
+}
+// to succs[0] if cc holds, to succs[1] otherwise
+static void emit_branch(Opt_t* o, IrBlock_t const* block, enum Cond cc)
+{
+    if (block->succs[1] == o->next)
+        jump_to(o, jcc32(&o->cb, cc), block->succs[0]);
+    else if (block->succs[0] == o->next)
+        jump_to(o, jcc32(&o->cb, cond_not(cc)), block->succs[1]);
+    else {
+        jump_to(o, jcc32(&o->cb, cc), block->succs[0]);
+        jump_to(o, jmp32(&o->cb), block->succs[1]);
+    }
+}
+
+/*
+ * Phi moves on the edge into a block, as a parallel copy. Locations are
+ * general purpose registers, xmm registers (16 + n) and spill slots (32 + s),
+ * with rax standing in for the location a cycle is broken at.
+ */
+typedef struct {
+    int dst, src; // src is -1 for the constant v
+    uint32_t v;
+} Move_t;
+
+static int location(Opt_t const* o, uint32_t v)
+{
+    if (ir_is_const(o->f, v))
+        return -1;
+    if (reg_of(o, v) >= 0)
+        return reg_of(o, v) + (is_xmm(o, v) ? 16 : 0);
+    return 32 + o->f->locs[v].spill;
+}
+static void emit_move(Opt_t* o, Move_t const* mv)
+{
+    CodeBuf_t* cb = &o->cb;
+    int dst = mv->dst, src = mv->src;
+    int32_t dst_disp = o->spill_base + 8 * (dst - 32), src_disp = o->spill_base + 8 * (src - 32);
+    if (src < 0) {
+        if (dst < 16)
+            load_gpr(o, dst, mv->v);
+        else if (dst < 32)
+            load_xmm(o, dst - 16, mv->v);
+        else if (fits32(imm_of(o, mv->v)))
+            mov_store_imm(cb, 1, RSP, dst_disp, imm_of(o, mv->v));
+        else {
+            load_gpr(o, R11, mv->v);
+            mov_store(cb, 1, RSP, dst_disp, R11);
+        }
+    } else if (dst < 16) {
+        if (src < 16)
+            mov_reg(cb, 1, dst, src);
+        else if (src < 32)
+            movq_from_xmm(cb, dst, src - 16);
+        else
+            mov_load(cb, 1, dst, RSP, src_disp);
+    } else if (dst < 32) {
+        if (src < 16)
+            movq_to_xmm(cb, dst - 16, src);
+        else if (src < 32)
+            op_reg(cb, 0, 0, SSE_MOVAPS, dst - 16, src - 16);
+        else
+            op_mem(cb, 0xf2, 0, SSE_MOV, dst - 16, RSP, src_disp);
+    } else {
+        if (src < 16)
+            mov_store(cb, 1, RSP, dst_disp, src);
+        else if (src < 32)
+            op_mem(cb, 0x66, 0, SSE_MOVQ_STORE, src - 16, RSP, dst_disp);
+        else {
+            mov_load(cb, 1, RCX, RSP, src_disp);
+            mov_store(cb, 1, RSP, dst_disp, RCX);
+        }
+    }
+}
+static void emit_phi_moves(Opt_t* o, uint32_t from, uint32_t to)
+{
+    IrFunc_t* f = o->f;
+    IrBlock_t const* succ = &f->blocks[to];
+    size_t p = 0;
+    while (succ->preds[p] != from)
+        p++;
+
+    Move_t* moves = malloc(sizeof(moves[0]) * (succ->nr_insns + 1));
+    size_t n = 0;
+    for (size_t k = 0; k < succ->nr_insns && f->insns[succ->insns[k]].op == IR_PHI; ++k) {
+        uint32_t phi = succ->insns[k], arg = ir_arg(f, &f->insns[phi], p);
+        Move_t mv = { .dst = location(o, phi), .src = location(o, arg), .v = arg };
+        if (mv.dst != mv.src)
+            moves[n++] = mv;
+    }
+
+    while (n > 0) {
+        int progress = 0;
+        for (size_t k = 0; k < n; ++k) {
+            int blocked = 0;
+            for (size_t j = 0; j < n && !blocked; ++j)
+                blocked = (j != k && moves[j].src == moves[k].dst);
+            if (blocked)
+                continue;
+            emit_move(o, &moves[k]);
+            moves[k--] = moves[--n];
+            progress = 1;
+        }
+        if (!progress) {
+            // every remaining move is on a cycle: park one destination in rax
+            Move_t save = { .dst = RAX, .src = moves[0].dst };
+            emit_move(o, &save);
+            for (size_t j = 0; j < n; ++j)
+                if (moves[j].src == save.src)
+                    moves[j].src = RAX;
+        }
+    }
+    free(moves);
+}
+
+// call quicken() the first time the instruction runs, for those unresolved at compile time
+static void emit_quicken(Opt_t* o, IrInsn_t const* insn)
+{
+    CodeBuf_t* cb = &o->cb;
+    if (!(insn->flags & IR_UNRESOLVED))
+        return;
+    mov_imm64(cb, RDI, (uintptr_t)insn->insn);
+    op_mem(cb, 0x66, 0, 0x81, 7, RDI, offsetof(Insn_t, op));
+    emit16(cb, insn->method->code[insn->insn->pc]);
+    size_t done = jcc8(cb, CC_NE);
+    mov_imm64(cb, RSI, (uintptr_t)insn->method);
+    call_abs(cb, (uintptr_t)quicken);
+    patch8(cb, done);
+}
+
+// v = [base + disp], of the width of v
+static void emit_load(Opt_t* o, uint32_t v, int base, int32_t disp)
+{
+    CodeBuf_t* cb = &o->cb;
+    uint8_t type = o->f->insns[v].type;
+    if (ir_class(type)) {
+        int xd = dst_of(o, v, XMM0);
+        op_mem(cb, type == F ? 0xf3 : 0xf2, 0, SSE_MOV, xd, base, disp);
+        store_xmm(o, v, xd);
+    } else {
+        int rd = dst_of(o, v, RAX);
+        mov_load(cb, type != I, rd, base, disp);
+        store_gpr(o, v, rd);
+    }
+}
+// [base + disp] = v, of the width of type
+static void emit_store(Opt_t* o, uint32_t v, uint8_t type, int base, int32_t disp)
+{
+    CodeBuf_t* cb = &o->cb;
+    if (ir_class(type))
+        op_mem(cb, type == F ? 0xf3 : 0xf2, 0, SSE_STORE, xmm_of(o, v, XMM0), base, disp);
+    else if (ir_is_const(o->f, v) && fits32(imm_of(o, v)))
+        mov_store_imm(cb, type != I, base, disp, imm_of(o, v));
+    else
+        mov_store(cb, type != I, base, disp, gpr_of(o, v, RDX));
+}
+
+static uint16_t const alu_rm[] = {
+    [IR_ADD] = ALU_ADD,
+    [IR_SUB] = ALU_SUB,
+    [IR_MUL] = ALU_IMUL,
+    [IR_AND] = ALU_AND,
+    [IR_OR] = ALU_OR,
+    [IR_XOR] = ALU_XOR,
+};
+static int const alu_ext[] = {
+    [IR_ADD] = ALU_EXT_ADD,
+    [IR_SUB] = ALU_EXT_SUB,
+    [IR_AND] = ALU_EXT_AND,
+    [IR_OR] = ALU_EXT_OR,
+    [IR_XOR] = ALU_EXT_XOR,
+};
+static uint16_t const sse_op[] = {
+    [IR_ADD] = SSE_ADD,
+    [IR_SUB] = SSE_SUB,
+    [IR_MUL] = SSE_MUL,
+    [IR_DIV] = SSE_DIV,
+};
+static enum Cond const conds[] = {
+    [IR_EQ] = CC_E,
+    [IR_NE] = CC_NE,
+    [IR_LT] = CC_L,
+    [IR_GE] = CC_GE,
+    [IR_GT] = CC_G,
+    [IR_LE] = CC_LE,
+};
+// the condition with its operands swapped
+static enum IrCond const swapped[] = {
+    [IR_EQ] = IR_EQ,
+    [IR_NE] = IR_NE,
+    [IR_LT] = IR_GT,
+    [IR_GE] = IR_LE,
+    [IR_GT] = IR_LT,
+    [IR_LE] = IR_GE,
+};
+
+static void emit_alu(Opt_t* o, uint32_t v)
+{
+    CodeBuf_t* cb = &o->cb;
+    IrInsn_t const* insn = &o->f->insns[v];
+    uint32_t a = ir_arg(o->f, insn, 0), b = ir_arg(o->f, insn, 1);
+    int w = (insn->type != I);
+    int rd = dst_of(o, v, RAX);
+    if (insn->op != IR_SUB && (ir_is_const(o->f, a) || (reg_of(o, b) == rd && reg_of(o, a) != rd))) {
+        uint32_t t = a;
+        a = b;
+        b = t;
+    }
+    // b would be overwritten by a before being read
+    if (reg_of(o, b) == rd && reg_of(o, a) != rd)
+        rd = RAX;
+    load_gpr(o, rd, a);
+    if (ir_is_const(o->f, b) && fits32(imm_of(o, b))) {
+        if (insn->op == IR_MUL) {
+            op_reg(cb, 0, w, 0x69, rd, rd);
+            emit32(cb, imm_of(o, b));
+        } else
+            op_imm(cb, w, alu_ext[insn->op], rd, imm_of(o, b));
+    } else
+        op_value(o, 0, w, alu_rm[insn->op], rd, b, RCX);
+    store_gpr(o, v, rd);
+}
+
+static void emit_shift(Opt_t* o, uint32_t v)
+{
+    CodeBuf_t* cb = &o->cb;
+    IrInsn_t const* insn = &o->f->insns[v];
+    uint32_t a = ir_arg(o->f, insn, 0), b = ir_arg(o->f, insn, 1);
+    int w = (insn->type == L);
+    int ext = (insn->op == IR_SHL ? SHIFT_SHL : insn->op == IR_SHR ? SHIFT_SAR : SHIFT_SHR);
+    int rd = dst_of(o, v, RAX);
+    if (ir_is_const(o->f, b)) {
+        load_gpr(o, rd, a);
+        op_reg(cb, 0, w, 0xc1, ext, rd);
+        emit8(cb, imm_of(o, b) & (w ? 63 : 31));
+    } else {
+        // x86 masks the count in cl just like Java does
+        load_gpr(o, RCX, b);
+        load_gpr(o, rd, a);
+        op_reg(cb, 0, w, 0xd3, ext, rd);
+    }
+    store_gpr(o, v, rd);
+}
+
+static void emit_div(Opt_t* o, uint32_t v)
+{
+    CodeBuf_t* cb = &o->cb;
+    IrInsn_t const* insn = &o->f->insns[v];
+    uint32_t a = ir_arg(o->f, insn, 0), b = ir_arg(o->f, insn, 1);
+    int w = (insn->type == L);
+    if (is_const_divisor(o->f, b)) {
+        // neither division by zero nor the overflow of MIN_VALUE / -1 can happen
+        load_gpr(o, RAX, a);
+        if (w)
+            emit8(cb, 0x48);
+        emit8(cb, 0x99); // cdq/cqo
+        load_gpr(o, RCX, b);
+        op_reg(cb, 0, w, 0xf7, 7, RCX);
+        store_gpr(o, v, insn->op == IR_DIV ? RAX : RDX);
+        return;
+    }
+    load_gpr(o, RDI, a);
+    load_gpr(o, RSI, b);
+    if (insn->op == IR_DIV)
+        call_abs(cb, w ? (uintptr_t)jit_ldiv : (uintptr_t)jit_idiv);
+    else
+        call_abs(cb, w ? (uintptr_t)jit_lrem : (uintptr_t)jit_irem);
+    store_gpr(o, v, RAX);
+}
+
+static void emit_sse(Opt_t* o, uint32_t v)
+{
+    CodeBuf_t* cb = &o->cb;
+    IrInsn_t const* insn = &o->f->insns[v];
+    uint32_t a = ir_arg(o->f, insn, 0), b = ir_arg(o->f, insn, 1);
+    uint8_t prefix = (insn->type == F ? 0xf3 : 0xf2);
+    if (insn->op == IR_REM) {
+        load_xmm(o, XMM0, a);
+        load_xmm(o, XMM1, b);
+        call_abs(cb, insn->type == F ? (uintptr_t)fmodf : (uintptr_t)fmod);
+        store_xmm(o, v, XMM0);
+        return;
+    }
+    int xd = dst_of(o, v, XMM0);
+    int commutes = (insn->op == IR_ADD || insn->op == IR_MUL);
+    if (commutes && reg_of(o, b) == xd && reg_of(o, a) != xd) {
+        uint32_t t = a;
+        a = b;
+        b = t;
+    }
+    if (reg_of(o, b) == xd && reg_of(o, a) != xd)
+        xd = XMM0;
+    load_xmm(o, xd, a);
+    op_value(o, prefix, 0, sse_op[insn->op], xd, b, XMM1);
+    store_xmm(o, v, xd);
+}
+
+static void emit_neg(Opt_t* o, uint32_t v)
+{
+    CodeBuf_t* cb = &o->cb;
+    IrInsn_t const* insn = &o->f->insns[v];
+    uint32_t a = ir_arg(o->f, insn, 0);
+    if (insn->type == F || insn->type == D) {
+        // flip the sign bit
+        load_gpr(o, RAX, a);
+        if (insn->type == F)
+            op_imm(cb, 0, ALU_EXT_XOR, RAX, INT32_MIN);
+        else {
+            mov_imm64(cb, RCX, 1ull << 63);
+            op_reg(cb, 0, 1, ALU_XOR, RAX, RCX);
+        }
+        store_gpr(o, v, RAX);
+        return;
+    }
+    int rd = dst_of(o, v, RAX);
+    load_gpr(o, rd, a);
+    op_reg(cb, 0, insn->type == L, 0xf7, 3, rd);
+    store_gpr(o, v, rd);
+}
+
+static void emit_conv(Opt_t* o, uint32_t v)
+{
+    CodeBuf_t* cb = &o->cb;
+    IrInsn_t const* insn = &o->f->insns[v];
+    uint32_t a = ir_arg(o->f, insn, 0);
+    switch (insn->imm) {
+    case I2L:
+    case L2I: {
+        int rd = dst_of(o, v, RAX);
+        // movsxd or a 32-bit mov
+        op_value(o, 0, insn->imm == I2L, insn->imm == I2L ? 0x63 : 0x8b, rd, a, RAX);
+        store_gpr(o, v, rd);
+    } break;
+    case I2B:
+    case I2C:
+    case I2S: {
+        int rd = dst_of(o, v, RAX);
+        load_gpr(o, RAX, a);
+        op_reg(cb, 0, 0, insn->imm == I2B ? 0x0fbe : insn->imm == I2C ? 0x0fb7 : 0x0fbf, rd, RAX);
+        store_gpr(o, v, rd);
+    } break;
+    case I2F:
+    case L2F:
+    case I2D:
+    case L2D: {
+        int xd = dst_of(o, v, XMM0);
+        op_value(o, insn->type == F ? 0xf3 : 0xf2, insn->imm == L2F || insn->imm == L2D, SSE_CVTSI2, xd, a, RAX);
+        store_xmm(o, v, xd);
+    } break;
+    case F2D:
+    case D2F: {
+        int xd = dst_of(o, v, XMM0);
+        op_value(o, insn->imm == F2D ? 0xf3 : 0xf2, 0, SSE_CVT, xd, a, XMM1);
+        store_xmm(o, v, xd);
+    } break;
+    default: {
+        static uintptr_t const helpers[] = {
+            [F2I - F2I] = (uintptr_t)jit_f2i,
+            [F2L - F2I] = (uintptr_t)jit_f2l,
+            [D2I - F2I] = (uintptr_t)jit_d2i,
+            [D2L - F2I] = (uintptr_t)jit_d2l,
+        };
+        load_xmm(o, XMM0, a);
+        call_abs(cb, helpers[insn->imm - F2I]);
+        store_gpr(o, v, RAX);
+    }
+    }
+}
+
+// LCMP, FCMPx and DCMPx, into -1, 0 or 1
+static void emit_cmp(Opt_t* o, uint32_t v)
+{
+    CodeBuf_t* cb = &o->cb;
+    IrInsn_t const* insn = &o->f->insns[v];
+    uint32_t a = ir_arg(o->f, insn, 0), b = ir_arg(o->f, insn, 1);
+    uint8_t type = o->f->insns[a].type;
+    op_reg(cb, 0, 0, ALU_XOR, RCX, RCX);
+    op_reg(cb, 0, 0, ALU_XOR, RDX, RDX);
+    if (type == L) {
+        int ra = gpr_of(o, a, RAX);
+        if (ir_is_const(o->f, b) && fits32(imm_of(o, b)))
+            op_imm(cb, 1, ALU_EXT_CMP, ra, imm_of(o, b));
+        else
+            op_value(o, 0, 1, ALU_CMP, ra, b, R11);
+        setcc(cb, CC_G, RCX);
+        setcc(cb, CC_L, RDX);
+    } else {
+        // unordered sets CF, so compare b with a when NaN must compare greater
+        int greater = (insn->imm == 1);
+        int xa = xmm_of(o, greater ? b : a, XMM0);
+        op_value(o, type == F ? 0 : 0x66, 0, SSE_UCOMI, xa, greater ? a : b, XMM1);
+        setcc(cb, greater ? CC_B : CC_A, RCX);
+        setcc(cb, greater ? CC_A : CC_B, RDX);
+    }
+    op_reg(cb, 0, 0, ALU_SUB, RCX, RDX);
+    store_gpr(o, v, RCX);
+}
+
+static void emit_call(Opt_t* o, uint32_t v)
+{
+    CodeBuf_t* cb = &o->cb;
+    IrFunc_t* f = o->f;
+    IrInsn_t const* insn = &f->insns[v];
+    for (size_t k = 0; k < insn->nr_args; ++k) {
+        uint32_t arg = ir_arg(f, insn, k);
+        if (ir_is_const(f, arg) && fits32(imm_of(o, arg)))
+            mov_store_imm(cb, 1, RSP, 8 * k, imm_of(o, arg));
+        else if (reg_of(o, arg) >= 0 && is_xmm(o, arg))
+            op_mem(cb, 0x66, 0, SSE_MOVQ_STORE, reg_of(o, arg), RSP, 8 * k);
+        else
+            mov_store(cb, 1, RSP, 8 * k, gpr_of(o, arg, RAX));
+    }
+
+    emit_quicken(o, insn);
+    size_t done = 0;
+    if (insn->flags & IR_DIRECT) {
+        // unless a class loaded since overrides the target, skipping the receiver's vtable
+        Method_t const* target = insn->insn->ic->method;
+        mov_imm64(cb, RAX, (uintptr_t)&target->overridden);
+        cmp8_imm(cb, RAX, 0, 0);
+        size_t slow = jcc8(cb, CC_NE);
+        mov_imm64(cb, RDI, (uintptr_t)target);
+        mov_reg(cb, 1, RSI, RSP);
+        mov_imm32(cb, RDX, insn->nr_args);
+        call_abs(cb, (uintptr_t)call_method);
+        done = jmp8(cb);
+        patch8(cb, slow);
+    }
+    if (insn->method->code[insn->insn->pc] == INVOKEVIRTUAL) {
+        mov_imm64(cb, RDI, (uintptr_t)insn->insn);
+        mov_reg(cb, 1, RSI, RSP);
+        call_abs(cb, (uintptr_t)jit_invokevirtual);
+    } else {
+        if (insn->flags & IR_UNRESOLVED) {
+            mov_imm64(cb, RAX, (uintptr_t)insn->insn);
+            mov_load(cb, 1, RDI, RAX, offsetof(Insn_t, method));
+        } else
+            mov_imm64(cb, RDI, (uintptr_t)insn->insn->method);
+        mov_reg(cb, 1, RSI, RSP);
+        mov_imm32(cb, RDX, insn->nr_args);
+        call_abs(cb, (uintptr_t)call_method);
+    }
+    if (insn->flags & IR_DIRECT)
+        patch8(cb, done);
+    if (insn->type != IR_VOID)
+        store_gpr(o, v, RAX);
+}
+
+// the bump of alloc_object() inline for classes known at compile time, calling it once the TLAB runs out
+static void emit_new(Opt_t* o, uint32_t v)
+{
+    CodeBuf_t* cb = &o->cb;
+    IrInsn_t const* insn = &o->f->insns[v];
+    emit_quicken(o, insn);
+    if (insn->flags & IR_UNRESOLVED) {
+        mov_imm64(cb, RAX, (uintptr_t)insn->insn);
+        mov_load(cb, 1, RDI, RAX, offsetof(Insn_t, class));
+        call_abs(cb, (uintptr_t)alloc_object);
+        store_gpr(o, v, RAX);
+        return;
+    }
+
+    Class_t const* c = insn->insn->class;
+    mov_imm64(cb, RAX, (uintptr_t)&main_thread.tlab);
+    mov_load(cb, 1, RCX, RAX, offsetof(Thread_t, tlab.top) - offsetof(Thread_t, tlab));
+    lea(cb, RDX, RCX, object_size(c));
+    op_mem(cb, 0, 1, ALU_CMP, RDX, RAX, offsetof(Thread_t, tlab.end) - offsetof(Thread_t, tlab));
+    size_t slow = jcc8(cb, CC_A);
+    mov_store(cb, 1, RAX, offsetof(Thread_t, tlab.top) - offsetof(Thread_t, tlab), RDX);
+#ifdef COMPACT_HEADERS
+    mov_store_imm(cb, 0, RCX, 0, c->header);
+#else
+    mov_imm64(cb, RDX, (uintptr_t)c->header);
+    mov_store(cb, 1, RCX, 0, RDX);
+#endif
+    store_gpr(o, v, RCX);
+    size_t done = jmp8(cb);
+    patch8(cb, slow);
+    mov_imm64(cb, RDI, (uintptr_t)c);
+    call_abs(cb, (uintptr_t)alloc_object);
+    store_gpr(o, v, RAX);
+    patch8(cb, done);
+}
+
+static void emit_epilogue(Opt_t* o)
+{
+    CodeBuf_t* cb = &o->cb;
+    lea(cb, RSP, RBP, -8 * (int32_t)o->nr_saved);
+    for (size_t k = o->nr_saved; k-- > 0;)
+        pop(cb, o->saved[k]);
+    pop(cb, RBP);
+    ret(cb);
+}
+
+static void emit_insn(Opt_t* o, uint32_t b, uint32_t v)
+{
+    CodeBuf_t* cb = &o->cb;
+    IrFunc_t* f = o->f;
+    IrInsn_t const* insn = &f->insns[v];
+    IrBlock_t const* block = &f->blocks[b];
+    switch (insn->op) {
+    case IR_CONST:
+    case IR_PHI:
+        break;
+    case IR_PARAM:
+        if (is_xmm(o, v)) {
+            int xd = dst_of(o, v, XMM0);
+            op_mem(cb, 0xf2, 0, SSE_MOV, xd, R11, 8 * insn->imm);
+            store_xmm(o, v, xd);
+        } else {
+            int rd = dst_of(o, v, RAX);
+            mov_load(cb, 1, rd, R11, 8 * insn->imm);
+            store_gpr(o, v, rd);
+        }
+        break;
+
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+    case IR_REM:
+    case IR_AND:
+    case IR_OR:
+    case IR_XOR:
+        if (ir_class(insn->type))
+            emit_sse(o, v);
+        else if (insn->op == IR_DIV || insn->op == IR_REM)
+            emit_div(o, v);
+        else
+            emit_alu(o, v);
+        break;
+    case IR_SHL:
+    case IR_SHR:
+    case IR_USHR:
+        emit_shift(o, v);
+        break;
+    case IR_NEG:
+        emit_neg(o, v);
+        break;
+    case IR_CONV:
+        emit_conv(o, v);
+        break;
+    case IR_CMP:
+        emit_cmp(o, v);
+        break;
+
+    case IR_GETSTATIC:
+    case IR_PUTSTATIC: {
+        emit_quicken(o, insn);
+        if (insn->flags & IR_UNRESOLVED) {
+            mov_imm64(cb, RAX, (uintptr_t)insn->insn);
+            mov_load(cb, 1, RAX, RAX, offsetof(Insn_t, field));
+        } else
+            mov_imm64(cb, RAX, (uintptr_t)insn->insn->field);
+        // the whole slot, as the interpreter reads static_val
+        if (insn->op == IR_GETSTATIC)
+            emit_load(o, v, RAX, offsetof(Field_t, static_val));
+        else {
+            uint32_t value = ir_arg(f, insn, 0);
+            emit_store(o, value, is_xmm(o, value) ? D : L, RAX, offsetof(Field_t, static_val));
+        }
+    } break;
+    case IR_GETFIELD:
+    case IR_PUTFIELD: {
+        uint32_t obj = ir_arg(f, insn, 0);
+        int base;
+        int32_t disp = 0;
+        emit_quicken(o, insn);
+        if (insn->flags & IR_UNRESOLVED) {
+            mov_imm64(cb, RCX, (uintptr_t)insn->insn);
+            mov_load(cb, 1, RCX, RCX, offsetof(Insn_t, offset));
+            op_value(o, 0, 1, ALU_ADD, RCX, obj, RAX);
+            base = RCX;
+        } else {
+            base = gpr_of(o, obj, RCX);
+            disp = insn->insn->offset;
+        }
+        if (insn->op == IR_GETFIELD)
+            emit_load(o, v, base, disp);
+        else {
+            uint32_t value = ir_arg(f, insn, 1);
+            emit_store(o, value, f->insns[value].type, base, disp);
+            // storing null needs no card
+            if (f->insns[value].type == A && !ir_is_const(f, value)) {
+                int r = gpr_of(o, obj, RCX);
+                if (r != RCX)
+                    mov_reg(cb, 1, RCX, r);
+                emit_write_barrier(cb, RCX, RDX);
+            }
+        }
+    } break;
+    case IR_NEW:
+        emit_new(o, v);
+        break;
+    case IR_CALL:
+        emit_call(o, v);
+        break;
+    case IR_OVERRIDDEN:
+        mov_imm64(cb, RAX, (uintptr_t)&insn->insn->ic->method->overridden);
+        movzx8_load(cb, RAX, RAX, 0);
+        store_gpr(o, v, RAX);
+        break;
+
+    case IR_JUMP:
+        emit_phi_moves(o, b, block->succs[0]);
+        emit_jump(o, block->succs[0]);
+        break;
+    case IR_BRANCH: {
+        uint32_t a = ir_arg(f, insn, 0), c = ir_arg(f, insn, 1);
+        enum IrCond cond = insn->cond;
+        if (ir_is_const(f, a)) {
+            uint32_t t = a;
+            a = c;
+            c = t;
+            cond = swapped[cond];
+        }
+        int w = (f->insns[a].type != I);
+        int ra = gpr_of(o, a, RAX);
+        if (ir_is_const(f, c) && imm_of(o, c) == 0)
+            op_reg(cb, 0, w, 0x85, ra, ra);
+        else if (ir_is_const(f, c) && fits32(imm_of(o, c)))
+            op_imm(cb, w, ALU_EXT_CMP, ra, imm_of(o, c));
+        else
+            op_value(o, 0, w, ALU_CMP, ra, c, RCX);
+        emit_branch(o, block, conds[cond]);
+    } break;
+    case IR_RETURN:
+        if (insn->nr_args > 0)
+            load_gpr(o, RAX, ir_arg(f, insn, 0));
+        emit_epilogue(o);
+        break;
+    default:
+        panicf("unexpected IR op %u", insn->op);
+    }
+}
+
+// compile m from entry on (see ir_build()) into *out
+static int compile(Method_t* m, Insn_t const* entry, JitCode_t* out)
+{
+    if (m->insns == NULL || !jit_enabled || !opt_enabled)
+        return 0;
+    IrFunc_t* f = ir_build(m, entry);
+    if (f == NULL)
+        return 0;
+    ir_optimize(f);
+    ir_split_critical_edges(f);
+    ir_allocate_registers(f, &reg_info);
+    if (debug)
+        ir_print(f);
+
+    Opt_t o = { .f = f };
+    size_t nr_out = 0;
+    for (size_t k = 0; k < f->nr_order; ++k) {
+        IrBlock_t const* block = &f->blocks[f->order[k]];
+        for (size_t n = 0; n < block->nr_insns; ++n) {
+            IrInsn_t const* insn = &f->insns[block->insns[n]];
+            if (insn->op == IR_CALL && insn->nr_args > nr_out)
+                nr_out = insn->nr_args;
+        }
+    }
+    // spill slots of references first
+    size_t nr_refs = 0, nr_others = 0;
+    for (uint32_t v = 0; v < f->nr_insns; ++v)
+        if (f->locs[v].spill >= 0 && f->insns[v].type == A)
+            nr_refs++;
+    for (size_t v = 0, ref = 0; v < f->nr_insns; ++v)
+        if (f->locs[v].spill >= 0)
+            f->locs[v].spill = (f->insns[v].type == A ? ref++ : nr_refs + nr_others++);
+    uint32_t used = 0;
+    for (uint32_t v = 0; v < f->nr_insns; ++v)
+        if (f->locs[v].reg >= 0 && !ir_class(f->insns[v].type))
+            used |= 1u << f->locs[v].reg;
+    for (size_t k = 0; k < sizeof(gprs); ++k)
+        if ((PRESERVED & used) >> gprs[k] & 1)
+            o.saved[o.nr_saved++] = gprs[k];
+
+    // rsp is 16-byte aligned after pushing rbp, the saved registers and the frame
+    int32_t frame = 8 * (nr_out + f->nr_spills);
+    if ((8 * o.nr_saved + frame) % 16 != 0)
+        frame += 8;
+    o.spill_base = 8 * nr_out;
+
+    CodeBuf_t* cb = &o.cb;
+    push(cb, RBP);
+    mov_reg(cb, 1, RBP, RSP);
+    for (size_t k = 0; k < o.nr_saved; ++k)
+        push(cb, o.saved[k]);
+    if (frame > 0)
+        sub_imm(cb, RSP, frame);
+    mov_reg(cb, 1, R11, RDI);
+    lea(cb, RAX, RSP, o.spill_base);
+    mov_store(cb, 1, RSI, offsetof(Frame_t, stack), RAX);
+    mov_store_imm(cb, 1, RSI, offsetof(Frame_t, sp), (int32_t)nr_refs - 1);
+    mov_store_imm(cb, 1, RSI, offsetof(Frame_t, ip), 0);
+    for (size_t k = 0; k < nr_refs; ++k)
+        mov_store_imm(cb, 1, RSP, o.spill_base + 8 * k, 0);
+
+    o.block_at = malloc(sizeof(o.block_at[0]) * f->nr_blocks);
+    for (size_t k = 0; k < f->nr_order; ++k) {
+        uint32_t b = f->order[k];
+        IrBlock_t const* block = &f->blocks[b];
+        o.next = (k + 1 < f->nr_order ? f->order[k + 1] : IR_NONE);
+        o.block_at[b] = cb->len;
+        for (size_t n = 0; n < block->nr_insns; ++n)
+            emit_insn(&o, b, block->insns[n]);
+    }
+    for (size_t k = 0; k < o.nr_fixups; ++k)
+        patch32(cb, o.fixups[k].at, o.block_at[o.fixups[k].block] - (o.fixups[k].at + 4));
+
+    out->code = install_code(cb, m, &out->size);
+    debugf("opt: compiled %s.%s%s", m->c->name, m->name, m->desc);
+    if (entry != NULL)
+        debugf(" from pc %u", entry->pc);
+    debugf(" into %lu bytes at %p, %lu spill slots\n", cb->len, out->code, f->nr_spills);
+    for (size_t k = 0; k < f->nr_assumed; ++k)
+        cha_depend(f->assumed[k], m, entry == NULL ? -1 : (int)(out - m->jit.osr));
+
+    free(cb->buf);
+    free(o.block_at);
+    free(o.fixups);
+    ir_free(f);
+    return 1;
+}
+
+int opt_compile(Method_t* m)
+{
+    JitCode_t code;
+    if (!compile(m, NULL, &code))
+        return 0;
+    // a frame may still be running the code replaced
+    jit_retire(m, &m->jit.code);
+    m->jit.code = code;
+    m->jit.tier = TIER_OPT;
+    return 1;
+}
+
+int opt_compile_osr(Method_t* m, Insn_t const* header, JitCode_t* out)
+{
+    return compile(m, header, out);
+}
@@ -0,0 +1,82 @@
+#include "runtime.h"
+#include "class.h"
+#include "exec.h"
+#include "gc.h"
+#include "inline_cache.h"
+#include "jmath.h"
+#include "util.h"
+#include "x86.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+int32_t jit_idiv(int32_t a, int32_t b)
+{
+    return java_idiv(a, b);
+}
+int32_t jit_irem(int32_t a, int32_t b)
+{
+    return java_irem(a, b);
+}
+int64_t jit_ldiv(int64_t a, int64_t b)
+{
+    return java_ldiv(a, b);
+}
+int64_t jit_lrem(int64_t a, int64_t b)
+{
+    return java_lrem(a, b);
+}
+int32_t jit_f2i(float f)
+{
+    return java_d2i(f);
+}
+int64_t jit_f2l(float f)
+{
+    return java_d2l(f);
+}
+int32_t jit_d2i(double d)
+{
+    return java_d2i(d);
+}
+int64_t jit_d2l(double d)
+{
+    return java_d2l(d);
+}
+int32_t jit_fcmp(float a, float b, int32_t nan_result)
+{
+    return (a > b ? 1 : a < b ? -1 : a == b ? 0 : nan_result);
+}
+int32_t jit_dcmp(double a, double b, int32_t nan_result)
+{
+    return (a > b ? 1 : a < b ? -1 : a == b ? 0 : nan_result);
+}
+Slot_t jit_invokevirtual(Insn_t* insn, Slot_t* args)
+{
+    Method_t* m = ic_lookup(insn->ic, insn, args[0].a);
+    return call_method(m, args, insn->nr_args);
+}
+
+void* install_code(CodeBuf_t const* cb, Method_t const* m, size_t* size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    *size = (cb->len + page - 1) / page * page;
+    void* code = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+        errorf("unable to map %lu bytes of code for %s.%s", *size, m->c->name, m->name);
+    memcpy(code, cb->buf, cb->len);
+    if (mprotect(code, *size, PROT_READ | PROT_EXEC) != 0)
+        errorf("unable to make the code of %s.%s executable", m->c->name, m->name);
+    return code;
+}
+
+void emit_write_barrier(CodeBuf_t* cb, int obj, int tmp)
+{
+    op_reg(cb, 0, 1, 0xc1, SHIFT_SHR, obj);
+    emit8(cb, CARD_SHIFT);
+    mov_imm64(cb, tmp, gc_card_bias);
+    op_reg(cb, 0, 1, ALU_ADD, obj, tmp);
+    op_mem(cb, 0, 0, 0xc6, 0, obj, 0); // mov byte [obj], 1
+    emit8(cb, 1);
+}
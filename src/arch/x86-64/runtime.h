@@ -0,0 +1,29 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include "class.h"
+#include "x86.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// called from compiled code for what is not worth inlining, with Java semantics
+int32_t jit_idiv(int32_t a, int32_t b);
+int32_t jit_irem(int32_t a, int32_t b);
+int64_t jit_ldiv(int64_t a, int64_t b);
+int64_t jit_lrem(int64_t a, int64_t b);
+int32_t jit_f2i(float f);
+int64_t jit_f2l(float f);
+int32_t jit_d2i(double d);
+int64_t jit_d2l(double d);
+int32_t jit_fcmp(float a, float b, int32_t nan_result);
+int32_t jit_dcmp(double a, double b, int32_t nan_result);
+Slot_t jit_invokevirtual(Insn_t* insn, Slot_t* args);
+
+// mark the card of the object in obj (see gc_write_barrier), clobbering obj and tmp
+void emit_write_barrier(CodeBuf_t* cb, int obj, int tmp);
+
+// copy the code of m into fresh executable pages, *size bytes of them
+void* install_code(CodeBuf_t const* cb, Method_t const* m, size_t* size);
+
+#endif // RUNTIME_H
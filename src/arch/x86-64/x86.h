@@ -0,0 +1,301 @@
+#ifndef X86_H
+#define X86_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Just enough of an x86-64 encoder for the JIT. Memory operands are always
+ * [base + disp], general purpose and xmm registers share numbers.
+ */
+enum Reg {
+    RAX,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
+};
+enum Cond {
+    CC_B = 0x2,
+    CC_AE = 0x3,
+    CC_E = 0x4,
+    CC_NE = 0x5,
+    CC_BE = 0x6,
+    CC_A = 0x7,
+    CC_P = 0xa,
+    CC_NP = 0xb,
+    CC_L = 0xc,
+    CC_GE = 0xd,
+    CC_LE = 0xe,
+    CC_G = 0xf,
+};
+
+typedef struct {
+    uint8_t* buf;
+    size_t len, cap;
+} CodeBuf_t;
+
+static inline void emit8(CodeBuf_t* cb, uint8_t b)
+{
+    if (cb->len == cb->cap) {
+        cb->cap = (cb->cap == 0 ? 256 : 2 * cb->cap);
+        cb->buf = realloc(cb->buf, cb->cap);
+    }
+    cb->buf[cb->len++] = b;
+}
+static inline void emit16(CodeBuf_t* cb, uint16_t v)
+{
+    emit8(cb, v);
+    emit8(cb, v >> 8);
+}
+static inline void emit32(CodeBuf_t* cb, uint32_t v)
+{
+    emit16(cb, v);
+    emit16(cb, v >> 16);
+}
+static inline void emit64(CodeBuf_t* cb, uint64_t v)
+{
+    emit32(cb, v);
+    emit32(cb, v >> 32);
+}
+static inline void patch32(CodeBuf_t* cb, size_t at, uint32_t v)
+{
+    memcpy(&cb->buf[at], &v, sizeof(v));
+}
+
+static inline void rex(CodeBuf_t* cb, int w, int reg, int base)
+{
+    uint8_t r = 0x40 | w << 3 | (reg >> 3) << 2 | (base >> 3);
+    if (r != 0x40)
+        emit8(cb, r);
+}
+static inline void modrm_mem(CodeBuf_t* cb, int reg, int base, int32_t disp)
+{
+    int mod = (disp == 0 && (base & 7) != RBP ? 0 : disp >= -128 && disp <= 127 ? 1 : 2);
+    emit8(cb, mod << 6 | (reg & 7) << 3 | (base & 7));
+    if ((base & 7) == RSP)
+        emit8(cb, 0x24); // SIB without index
+    if (mod == 1)
+        emit8(cb, disp);
+    else if (mod == 2)
+        emit32(cb, disp);
+}
+
+/*
+ * op is a one byte opcode or 0x0fxx, prefix a mandatory prefix (0x66, 0xf2,
+ * 0xf3) or 0 and w selects 64-bit operand size.
+ */
+static inline void op_mem(CodeBuf_t* cb, uint8_t prefix, int w, uint16_t op, int reg, int base, int32_t disp)
+{
+    if (prefix)
+        emit8(cb, prefix);
+    rex(cb, w, reg, base);
+    if (op > 0xff)
+        emit8(cb, op >> 8);
+    emit8(cb, op);
+    modrm_mem(cb, reg, base, disp);
+}
+static inline void op_reg(CodeBuf_t* cb, uint8_t prefix, int w, uint16_t op, int reg, int rm)
+{
+    if (prefix)
+        emit8(cb, prefix);
+    rex(cb, w, reg, rm);
+    if (op > 0xff)
+        emit8(cb, op >> 8);
+    emit8(cb, op);
+    emit8(cb, 0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+// mov reg, [base + disp]
+static inline void mov_load(CodeBuf_t* cb, int w, int reg, int base, int32_t disp)
+{
+    op_mem(cb, 0, w, 0x8b, reg, base, disp);
+}
+// movzx reg32, byte [base + disp]
+static inline void movzx8_load(CodeBuf_t* cb, int reg, int base, int32_t disp)
+{
+    op_mem(cb, 0, 0, 0x0fb6, reg, base, disp);
+}
+// mov [base + disp], reg
+static inline void mov_store(CodeBuf_t* cb, int w, int base, int32_t disp, int reg)
+{
+    op_mem(cb, 0, w, 0x89, reg, base, disp);
+}
+// mov [base + disp], imm (sign extended for w)
+static inline void mov_store_imm(CodeBuf_t* cb, int w, int base, int32_t disp, int32_t imm)
+{
+    op_mem(cb, 0, w, 0xc7, 0, base, disp);
+    emit32(cb, imm);
+}
+// mov reg, imm64
+static inline void mov_imm64(CodeBuf_t* cb, int reg, uint64_t imm)
+{
+    rex(cb, 1, 0, reg);
+    emit8(cb, 0xb8 + (reg & 7));
+    emit64(cb, imm);
+}
+// mov reg, imm32 (zero extended)
+static inline void mov_imm32(CodeBuf_t* cb, int reg, uint32_t imm)
+{
+    rex(cb, 0, 0, reg);
+    emit8(cb, 0xb8 + (reg & 7));
+    emit32(cb, imm);
+}
+// mov dst, src
+static inline void mov_reg(CodeBuf_t* cb, int w, int dst, int src)
+{
+    op_reg(cb, 0, w, 0x89, src, dst);
+}
+// op r/m, imm for the group 1 opcodes (ALU_EXT_*), with the short form for imm8
+static inline void op_imm(CodeBuf_t* cb, int w, int ext, int reg, int32_t imm)
+{
+    if (imm >= -128 && imm <= 127) {
+        op_reg(cb, 0, w, 0x83, ext, reg);
+        emit8(cb, imm);
+    } else {
+        op_reg(cb, 0, w, 0x81, ext, reg);
+        emit32(cb, imm);
+    }
+}
+// movq xmm, r64 and movq r64, xmm
+static inline void movq_to_xmm(CodeBuf_t* cb, int xmm, int reg)
+{
+    op_reg(cb, 0x66, 1, 0x0f6e, xmm, reg);
+}
+static inline void movq_from_xmm(CodeBuf_t* cb, int reg, int xmm)
+{
+    op_reg(cb, 0x66, 1, 0x0f7e, xmm, reg);
+}
+// lea reg, [base + disp]
+static inline void lea(CodeBuf_t* cb, int reg, int base, int32_t disp)
+{
+    op_mem(cb, 0, 1, 0x8d, reg, base, disp);
+}
+// sub/add reg, imm32
+static inline void sub_imm(CodeBuf_t* cb, int reg, int32_t imm)
+{
+    op_reg(cb, 0, 1, 0x81, 5, reg);
+    emit32(cb, imm);
+}
+
+// alu opcodes of the `op reg, r/m` form
+enum {
+    ALU_ADD = 0x03,
+    ALU_OR = 0x0b,
+    ALU_AND = 0x23,
+    ALU_SUB = 0x2b,
+    ALU_XOR = 0x33,
+    ALU_CMP = 0x3b,
+    ALU_IMUL = 0x0faf,
+};
+// the /ext of the group 1 `op r/m, imm` opcodes
+enum {
+    ALU_EXT_ADD = 0,
+    ALU_EXT_OR = 1,
+    ALU_EXT_AND = 4,
+    ALU_EXT_SUB = 5,
+    ALU_EXT_XOR = 6,
+    ALU_EXT_CMP = 7,
+};
+// cmp byte [base + disp], imm
+static inline void cmp8_imm(CodeBuf_t* cb, int base, int32_t disp, int8_t imm)
+{
+    op_mem(cb, 0, 0, 0x80, ALU_EXT_CMP, base, disp);
+    emit8(cb, imm);
+}
+// the /ext of the shift opcodes 0xc1 (by imm8) and 0xd3 (by cl)
+enum {
+    SHIFT_SHL = 4,
+    SHIFT_SHR = 5,
+    SHIFT_SAR = 7,
+};
+// sse opcodes of the `op xmm, xmm/m` form, with 0xf3 for single and 0xf2 for double precision
+enum {
+    SSE_MOV = 0x0f10,
+    SSE_STORE = 0x0f11, // movss/movsd m, xmm
+    SSE_CVTSI2 = 0x0f2a,
+    SSE_UCOMI = 0x0f2e, // with prefix 0 for ucomiss and 0x66 for ucomisd
+    SSE_ADD = 0x0f58,
+    SSE_MUL = 0x0f59,
+    SSE_CVT = 0x0f5a, // cvtss2sd / cvtsd2ss
+    SSE_SUB = 0x0f5c,
+    SSE_DIV = 0x0f5e,
+    SSE_MOVQ_STORE = 0x0fd6, // movq m64, xmm with prefix 0x66
+    SSE_MOVAPS = 0x0f28, // with prefix 0, to copy a whole register
+};
+
+static inline void push(CodeBuf_t* cb, int reg)
+{
+    rex(cb, 0, 0, reg);
+    emit8(cb, 0x50 + (reg & 7));
+}
+static inline void pop(CodeBuf_t* cb, int reg)
+{
+    rex(cb, 0, 0, reg);
+    emit8(cb, 0x58 + (reg & 7));
+}
+static inline void ret(CodeBuf_t* cb)
+{
+    emit8(cb, 0xc3);
+}
+// call an absolute address through rax
+static inline void call_abs(CodeBuf_t* cb, uintptr_t fn)
+{
+    mov_imm64(cb, RAX, fn);
+    op_reg(cb, 0, 0, 0xff, 2, RAX);
+}
+// setcc reg8, for reg < 4 only
+static inline void setcc(CodeBuf_t* cb, enum Cond cc, int reg)
+{
+    op_reg(cb, 0, 0, 0x0f90 + cc, 0, reg);
+}
+// invert a condition
+static inline enum Cond cond_not(enum Cond cc)
+{
+    return cc ^ 1;
+}
+// jcc/jmp rel32, returning the offset of the displacement to patch
+static inline size_t jcc32(CodeBuf_t* cb, enum Cond cc)
+{
+    emit8(cb, 0x0f);
+    emit8(cb, 0x80 + cc);
+    emit32(cb, 0);
+    return cb->len - 4;
+}
+static inline size_t jmp32(CodeBuf_t* cb)
+{
+    emit8(cb, 0xe9);
+    emit32(cb, 0);
+    return cb->len - 4;
+}
+// jcc rel8, returning the offset of the displacement to patch with patch8()
+static inline size_t jcc8(CodeBuf_t* cb, enum Cond cc)
+{
+    emit8(cb, 0x70 + cc);
+    emit8(cb, 0);
+    return cb->len - 1;
+}
+static inline size_t jmp8(CodeBuf_t* cb)
+{
+    emit8(cb, 0xeb);
+    emit8(cb, 0);
+    return cb->len - 1;
+}
+static inline void patch8(CodeBuf_t* cb, size_t at)
+{
+    cb->buf[at] = cb->len - (at + 1);
+}
+
+#endif // X86_H
@@ -0,0 +1,51 @@
+#include "arena.h"
+#include "util.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define ARENA_ALIGN 16
+#define CHUNK_PAGES 16
+
+struct ArenaChunk {
+    ArenaChunk_t* prev;
+    size_t size; // including this header
+};
+
+void* arena_alloc(Arena_t* a, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if ((size_t)(a->end - a->top) < size) {
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        size_t header = (sizeof(ArenaChunk_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+        size_t chunk_size = CHUNK_PAGES * page_size;
+        if (chunk_size < header + size)
+            chunk_size = (header + size + page_size - 1) & ~(page_size - 1);
+        ArenaChunk_t* chunk = mmap(NULL, chunk_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (chunk == MAP_FAILED)
+            errorf("unable to map %lu bytes of metadata", chunk_size);
+        chunk->prev = a->chunks;
+        chunk->size = chunk_size;
+        a->chunks = chunk;
+        a->reserved += chunk_size;
+        // what was left of the previous chunk is wasted
+        a->top = (uint8_t*)chunk + header;
+        a->end = (uint8_t*)chunk + chunk_size;
+    }
+    void* p = a->top;
+    a->top += size;
+    a->used += size;
+    return p;
+}
+
+void arena_release(Arena_t* a)
+{
+    for (ArenaChunk_t* chunk = a->chunks; chunk != NULL;) {
+        ArenaChunk_t* prev = chunk->prev;
+        munmap(chunk, chunk->size);
+        chunk = prev;
+    }
+    *a = (Arena_t) { 0 };
+}
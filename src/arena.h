@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bump allocator for memory that is released all at once. Chunks are mapped
+ * a few pages at a time, or as many as an allocation needs, and handed out
+ * zeroed and aligned for any type; nothing is freed before arena_release().
+ */
+typedef struct ArenaChunk ArenaChunk_t;
+typedef struct {
+    ArenaChunk_t* chunks; // newest first
+    uint8_t* top;
+    uint8_t* end;
+    size_t used; // bytes handed out
+    size_t reserved; // bytes of the chunks
+} Arena_t;
+
+void* arena_alloc(Arena_t* a, size_t size);
+static inline void* arena_calloc(Arena_t* a, size_t nr, size_t size)
+{
+    return arena_alloc(a, nr * size);
+}
+void arena_release(Arena_t* a);
+
+#endif // ARENA_H
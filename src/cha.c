@@ -0,0 +1,58 @@
+#include "cha.h"
+#include "class.h"
+#include "inline_cache.h"
+#include "jit.h"
+#include "util.h"
+
+#include <stdlib.h>
+
+#ifdef JIT
+typedef struct {
+    Method_t* target;
+    Method_t* m;
+    int loop;
+} Dependency_t;
+
+static struct {
+    size_t nr, cap;
+    Dependency_t* list;
+} dependencies = { 0, 0, NULL };
+
+void cha_depend(Method_t* target, Method_t* m, int loop)
+{
+    if (dependencies.nr == dependencies.cap) {
+        dependencies.cap = (dependencies.cap == 0 ? 16 : 2 * dependencies.cap);
+        dependencies.list = realloc(dependencies.list, sizeof(dependencies.list[0]) * dependencies.cap);
+    }
+    dependencies.list[dependencies.nr++] = (Dependency_t) { .target = target, .m = m, .loop = loop };
+}
+#endif
+
+void cha_override(Method_t* m, Class_t const* c)
+{
+    if (m->overridden)
+        return;
+    m->overridden = 1;
+    debugf("cha: %s overrides %s.%s%s\n", c->name, m->c->name, m->name, m->desc);
+    ic_override(m);
+#ifdef JIT
+    size_t kept = 0;
+    for (size_t k = 0; k < dependencies.nr; ++k) {
+        Dependency_t d = dependencies.list[k];
+        if (d.target == m)
+            tier_invalidate(d.m, d.loop);
+        else
+            dependencies.list[kept++] = d;
+    }
+    dependencies.nr = kept;
+#endif
+}
+
+void cha_end(void)
+{
+#ifdef JIT
+    free(dependencies.list);
+    dependencies.nr = dependencies.cap = 0;
+    dependencies.list = NULL;
+#endif
+}
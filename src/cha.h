@@ -0,0 +1,25 @@
+#ifndef CHA_H
+#define CHA_H
+
+#include "class.h"
+
+/*
+ * Class hierarchy analysis. Loading a class marks every method it overrides in
+ * the vtable of its superclass, so a method not marked yet is the only
+ * implementation of its vtable slot among the loaded classes, and INVOKEVIRTUAL
+ * sites resolving to it may call it without looking at the receiver.
+ * Interpreted sites do so through their inline cache (see inline_cache.h),
+ * which goes back to looking targets up once the method is overridden.
+ * Optimized code checks Method_t::overridden before each such call and
+ * registers as a dependent of the method, to be recompiled once it is.
+ */
+
+// c, being loaded, overrides m
+void cha_override(Method_t* m, Class_t const* c);
+#ifdef JIT
+// the code compiled for m, or for its loop if not -1, assumes no loaded class overrides target
+void cha_depend(Method_t* target, Method_t* m, int loop);
+#endif
+void cha_end(void);
+
+#endif // CHA_H
@@ -1,7 +1,9 @@
 #include "class.h"
 #include "loader.h"
+#include "symbol.h"
 #include "util.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 typedef struct {
@@ -9,6 +11,35 @@ typedef struct {
     char const* type;
 } resolved_t;
 
+Arena_t class_metadata;
+
+#ifdef COMPACT_HEADERS
+Method_t*** class_vtables;
+static size_t nr_class_vtables, cap_class_vtables;
+#endif
+
+void register_class(Class_t* c)
+{
+#ifdef COMPACT_HEADERS
+    if (nr_class_vtables == cap_class_vtables) {
+        cap_class_vtables = (cap_class_vtables == 0 ? 16 : 2 * cap_class_vtables);
+        class_vtables = realloc(class_vtables, sizeof(class_vtables[0]) * cap_class_vtables);
+    }
+    c->header = sizeof(class_vtables[0]) * nr_class_vtables;
+    class_vtables[nr_class_vtables++] = c->vtable;
+#else
+    c->header = c->vtable;
+#endif
+}
+void unregister_classes(void)
+{
+#ifdef COMPACT_HEADERS
+    free(class_vtables);
+    class_vtables = NULL;
+    nr_class_vtables = cap_class_vtables = 0;
+#endif
+}
+
 char const* resolve_utf8(Const_t* constant_pool_list, size_t i)
 {
     Const_t* c = &constant_pool_list[i - 1];
@@ -43,44 +74,173 @@ static resolved_t resolve_constant(Const_t* constant_pool_list, size_t i, enum C
     return ret;
 }
 
+static MemberIndex_t new_index(size_t nr)
+{
+    MemberIndex_t index = { 0, NULL };
+    if (nr == 0)
+        return index;
+    for (index.cap = 4; index.cap < 2 * nr; index.cap *= 2)
+        ;
+    index.slots = arena_calloc(&class_metadata, index.cap, sizeof(index.slots[0]));
+    return index;
+}
+static size_t method_hash(char const* name, char const* desc)
+{
+    return symbol_hash(name) * 31 + symbol_hash(desc);
+}
+void index_members(Class_t* c)
+{
+    c->field_index = new_index(c->fields.size);
+    for (size_t i = 0; i < c->fields.size; ++i) {
+        size_t j = symbol_hash(c->fields.list[i].name) & (c->field_index.cap - 1);
+        while (c->field_index.slots[j] != 0)
+            j = (j + 1) & (c->field_index.cap - 1);
+        c->field_index.slots[j] = i + 1;
+    }
+    c->method_index = new_index(c->methods.size);
+    for (size_t i = 0; i < c->methods.size; ++i) {
+        size_t j = method_hash(c->methods.list[i].name, c->methods.list[i].desc) & (c->method_index.cap - 1);
+        while (c->method_index.slots[j] != 0)
+            j = (j + 1) & (c->method_index.cap - 1);
+        c->method_index.slots[j] = i + 1;
+    }
+}
+
+Field_t* find_field(Class_t const* c, char const* name)
+{
+    if (c->field_index.cap == 0)
+        return NULL;
+    for (size_t j = symbol_hash(name) & (c->field_index.cap - 1); c->field_index.slots[j] != 0; j = (j + 1) & (c->field_index.cap - 1)) {
+        Field_t* f = &c->fields.list[c->field_index.slots[j] - 1];
+        if (f->name == name)
+            return f;
+    }
+    return NULL;
+}
+Method_t* find_method(Class_t const* c, char const* name, char const* desc)
+{
+    if (c->method_index.cap == 0)
+        return NULL;
+    for (size_t j = method_hash(name, desc) & (c->method_index.cap - 1); c->method_index.slots[j] != 0; j = (j + 1) & (c->method_index.cap - 1)) {
+        Method_t* m = &c->methods.list[c->method_index.slots[j] - 1];
+        if (m->name == name && m->desc == desc)
+            return m;
+    }
+    return NULL;
+}
+
 static Field_t* get_field(Class_t* c, char const* fieldname)
 {
-    for (size_t i = 0; i < c->fields.size; ++i)
-        if (strcmp(c->fields.list[i].name, fieldname) == 0)
-            return &c->fields.list[i];
+    for (Class_t const* k = c; k != NULL; k = k->super) {
+        Field_t* f = find_field(k, fieldname);
+        if (f != NULL)
+            return f;
+    }
     errorf("unable to find field %s in class %s", fieldname, c->name);
 }
-Field_t* resolve_fieldref(Const_t* constant_pool_list, size_t i)
+Field_t* resolve_fieldref_slow(Const_t* constant_pool_list, size_t i)
 {
     Const_t* con = &constant_pool_list[i - 1];
     if (con->tag != CONST_FIELD)
         errorf("unable to resolve fieldref %lu", i);
-    char const* classname = resolve_constant(constant_pool_list, con->class_index, CONST_CLASS).name;
-    Class_t* c = load_class(classname);
+    Class_t* c = resolve_class(constant_pool_list, con->class_index);
     char const* fieldname = resolve_constant(constant_pool_list, con->name_and_type_index, CONST_NAME_AND_TYPE).name;
-    return get_field(c, fieldname);
+    con->resolved.field = get_field(c, fieldname);
+    return con->resolved.field;
+}
+
+char const* resolve_ref_desc(Const_t* constant_pool_list, size_t i)
+{
+    Const_t* con = &constant_pool_list[i - 1];
+    if (con->tag != CONST_FIELD && con->tag != CONST_METHOD)
+        errorf("unable to resolve member ref %lu", i);
+    return resolve_constant(constant_pool_list, con->name_and_type_index, CONST_NAME_AND_TYPE).type;
 }
 
 Method_t* get_method(Class_t* c, char const* methodname, char const* desc)
 {
-    for (size_t i = 0; i < c->methods.size; ++i)
-        if (strcmp(c->methods.list[i].name, methodname) == 0
-            && strcmp(c->methods.list[i].desc, desc) == 0)
-            return &c->methods.list[i];
+    for (Class_t const* k = c; k != NULL; k = k->super) {
+        Method_t* m = find_method(k, methodname, desc);
+        if (m != NULL)
+            return m;
+    }
     errorf("unable to find method %s in class %s", methodname, c->name);
 }
-Method_t* resolve_methodref(Const_t* constant_pool_list, size_t i)
+Method_t* resolve_methodref_slow(Const_t* constant_pool_list, size_t i)
 {
     Const_t* con = &constant_pool_list[i - 1];
     if (con->tag != CONST_METHOD)
         errorf("unable to resolve methodref %lu", i);
-    char const* classname = resolve_constant(constant_pool_list, con->class_index, CONST_CLASS).name;
-    Class_t* c = load_class(classname);
+    Class_t* c = resolve_class(constant_pool_list, con->class_index);
     resolved_t name_and_type = resolve_constant(constant_pool_list, con->name_and_type_index, CONST_NAME_AND_TYPE);
-    return get_method(c, name_and_type.name, name_and_type.type);
+    con->resolved.method = get_method(c, name_and_type.name, name_and_type.type);
+    return con->resolved.method;
 }
 
-char const* resolve_class(Const_t* constant_pool_list, size_t i)
+// returns the character following the field descriptor at p, part of the method descriptor desc
+static char const* skip_field_desc(char const* p, char const* desc)
+{
+    while (*p == '[')
+        ++p;
+    if (*p == 'L') {
+        while (*p != ';' && *p != '\0')
+            ++p;
+    } else if (*p != '\0' && strchr("BCDFIJSZ", *p) == NULL)
+        errorf("bad method descriptor %s", desc);
+    if (*p == '\0')
+        errorf("bad method descriptor %s", desc);
+    return p + 1;
+}
+size_t nr_desc_args(char const* desc)
+{
+    if (desc[0] != '(')
+        errorf("bad method descriptor %s", desc);
+    size_t nr_args = 0;
+    char const* p = &desc[1];
+    for (; *p != ')'; p = skip_field_desc(p, desc))
+        nr_args++;
+    // a single return type, or V
+    ++p;
+    if (*p == 'V' ? p[1] != '\0' : *skip_field_desc(p, desc) != '\0')
+        errorf("bad method descriptor %s", desc);
+    return nr_args;
+}
+void parse_desc(Signature_t* sig, char const* desc, int has_receiver)
+{
+    size_t nr_args = has_receiver + nr_desc_args(desc);
+
+    sig->nr_args = nr_args;
+    sig->nr_slots = 0;
+    if (has_receiver) {
+        sig->arg_types[0] = A;
+        sig->nr_slots++;
+    }
+    char const* p = &desc[1];
+    for (size_t i = has_receiver; i < nr_args; p = skip_field_desc(p, desc), ++i) {
+        sig->arg_types[i] = get_value_type(*p);
+        sig->nr_slots += (*p == 'J' || *p == 'D' ? 2 : 1);
+    }
+
+    ++p;
+    sig->returns = (*p != 'V');
+    sig->ret_type = (sig->returns ? get_value_type(*p) : 0);
+}
+void parse_signature(Method_t* m)
+{
+    int has_receiver = !(m->flags & ACC_STATIC);
+    if (m->desc[0] != '(')
+        errorf("bad method descriptor %s for %s.%s", m->desc, m->c->name, m->name);
+    m->sig.arg_types = arena_alloc(&class_metadata, has_receiver + nr_desc_args(m->desc));
+    parse_desc(&m->sig, m->desc, has_receiver);
+}
+
+char const* resolve_class_name(Const_t* constant_pool_list, size_t i)
 {
     return resolve_constant(constant_pool_list, i, CONST_CLASS).name;
 }
+Class_t* resolve_class_slow(Const_t* constant_pool_list, size_t i)
+{
+    Const_t* con = &constant_pool_list[i - 1];
+    con->resolved.class = load_class(resolve_class_name(constant_pool_list, i));
+    return con->resolved.class;
+}
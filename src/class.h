@@ -1,6 +1,9 @@
 #ifndef CLASS_H
 #define CLASS_H
 
+#include "arena.h"
+#include "util.h"
+
 #include <stddef.h>
 #include <stdint.h>
 
@@ -27,6 +30,71 @@ typedef struct Value {
     };
 } Value_t;
 
+/*
+ * Operand stack and local variable slot. By default slots are raw 8-byte
+ * words whose types are only known statically (see typeflow.h); build with
+ * `make SLOTS=tagged` to carry a Value_t tag in every slot instead.
+ */
+#ifdef TAGGED_SLOTS
+typedef Value_t Slot_t;
+    #define SLOT(T, field, v) ((Slot_t) { .type = T, .field = v })
+#else
+typedef union {
+    int32_t i;
+    float f;
+    void* a;
+
+    int64_t l;
+    double d;
+} Slot_t;
+    #define SLOT(T, field, v) ((Slot_t) { .field = v })
+#endif
+
+static inline Slot_t makeI(int32_t i)
+{
+    return SLOT(I, i, i);
+}
+static inline Slot_t makeL(int64_t l)
+{
+    return SLOT(L, l, l);
+}
+static inline Slot_t makeF(float f)
+{
+    return SLOT(F, f, f);
+}
+static inline Slot_t makeD(double d)
+{
+    return SLOT(D, d, d);
+}
+static inline Slot_t makeA(void* a)
+{
+    return SLOT(A, a, a);
+}
+
+static inline enum ValueType get_value_type(char desc)
+{
+    switch (desc) {
+    case 'I':
+        return I;
+    case 'F':
+        return F;
+    case 'J':
+        return L;
+    case 'D':
+        return D;
+    case 'L':
+        return A;
+    case '[':
+        return ARR;
+    default:
+        panicf("unknown type desc %c", desc);
+    }
+}
+
+typedef struct _Class Class_t;
+typedef struct Field Field_t;
+typedef struct Method Method_t;
+
 typedef struct {
     enum ConstType {
         CONST_UTF8 = 0x01,
@@ -41,7 +109,7 @@ typedef struct {
         CONST_NAME_AND_TYPE = 0x0c,
     } tag;
     union {
-        char* utf8;
+        char const* utf8; // interned, see symbol.h
         int32_t i;
         int64_t l;
         float f;
@@ -56,43 +124,159 @@ typedef struct {
         };
         uint16_t string_index;
     };
+    // filled in on first resolution of CONST_CLASS/CONST_FIELD/CONST_METHOD
+    union {
+        Class_t* class;
+        Field_t* field;
+        Method_t* method;
+    } resolved;
 } Const_t;
 
-typedef struct _Class Class_t;
+typedef struct Insn Insn_t;
+typedef struct InlineCache InlineCache_t;
 
 enum Flags {
+    ACC_PRIVATE = 0x0002,
     ACC_STATIC = 0x0008,
+    ACC_FINAL = 0x0010,
     ACC_NATIVE = 0x0100,
 };
-typedef struct Field {
+struct Field {
     uint16_t flags;
     char const* name;
     char const* desc;
 
     union {
         size_t offset;
-        Value_t static_val;
+        Slot_t static_val;
     };
 
     char const* source_file;
-} Field_t;
+};
+
+// args holds the receiver (if any) followed by the arguments, one slot each
+typedef Slot_t (*NativeFn)(Slot_t const* args);
+
+struct Frame; // see thread.h
+
+// native code installed by the JIT, entered with the local variables of a frame and the frame itself
+typedef struct {
+    union {
+        Slot_t (*entry)(Slot_t* locals, struct Frame* frame);
+        void* code;
+    };
+    size_t size;
+} JitCode_t;
 
-typedef struct Method {
+// a method descriptor parsed once at load time
+typedef struct {
+    uint16_t nr_args; // including the receiver of instance methods
+    uint16_t nr_slots; // local variable slots taken by the arguments, longs and doubles count twice
+    uint8_t returns;
+    uint8_t ret_type; // enum ValueType, if returns
+    uint8_t* arg_types; // enum ValueType of each argument
+} Signature_t;
+
+struct Method {
     uint16_t flags;
     char const* name;
     char const* desc;
+    Signature_t sig;
 
     struct {
         size_t max_stack, max_locals;
         size_t code_length;
-        uint8_t* code;
+        uint8_t const* code; // in the mapped class file
     };
+    // code pre-decoded by translate_method()
+    Insn_t* insns;
+    size_t nr_insns;
+    // slot types on entry to each instruction, computed by infer_types()
+    uint8_t* slot_types;
+    uint16_t* stack_depth;
+    // which slots hold references where a collection may happen, see refmap.h
+    struct {
+        size_t size;
+        uint16_t* pcs; // ascending
+        uint32_t* bits;
+    } ref_maps;
+    // loop headers backward branches jump to, numbered by translate_method()
+    uint16_t nr_loops;
+    // native code from the JIT (see jit.h)
+    struct {
+        JitCode_t code; // run instead of insns once present
+        uint8_t failed; // to compile with the baseline compiler
+        uint8_t tier; // enum Tier of the code at entry, or TIER_BASELINE for optimized code due to be recompiled
+        uint32_t invocations;
+        // code replaced while frames may still be running it
+        JitCode_t* retired;
+        size_t nr_retired;
+        // per loop: taken back edges, and code continuing the method from its header
+        uint32_t* backedges;
+        JitCode_t* osr;
+    } jit;
 
     Class_t* c;
     size_t vtable_offset;
+    uint8_t overridden; // by a loaded class, see cha.h
+
+    NativeFn native; // bound when the class is loaded, for ACC_NATIVE methods
 
     char const* source_file;
-} Method_t;
+};
+
+struct Insn {
+    uint16_t op; // enum opcode, rewritten in place when quickened
+    uint16_t pc; // offset of the original instruction in Method_t::code
+    union {
+        struct {
+            uint16_t index; // local variable or constant pool index
+            uint8_t type; // enum ValueType of constants and quickened field accesses
+        };
+        struct {
+            uint16_t nr_args; // of a quickened invoke, including the receiver
+            uint8_t returns;
+        };
+        uint16_t loop; // of a backward branch, see Method_t::nr_loops
+    };
+    union {
+        int32_t i;
+        int64_t l;
+        float f;
+        double d;
+        Insn_t* target; // branch destination
+        size_t offset; // quickened instance field
+        Field_t* field; // quickened static field
+        Method_t* method; // quickened invoke
+        InlineCache_t* ic; // quickened INVOKEVIRTUAL
+        Class_t* class; // quickened NEW
+    };
+};
+
+/*
+ * Object header, the first word of every instance: its class's vtable, or
+ * with `make HEADERS=compact` a 4-byte offset into class_vtables, which leaves
+ * the rest of the word to fields. Either way its low bit is clear, which the
+ * collector relies on (see gc.c).
+ */
+#ifdef COMPACT_HEADERS
+typedef uint32_t Header_t;
+extern Method_t*** class_vtables;
+#else
+typedef Method_t** Header_t;
+#endif
+
+// open addressing hash index into the fields or methods of a class, see index_members()
+typedef struct {
+    size_t cap; // a power of two, 0 when there is nothing to index
+    uint16_t* slots; // 1 + the index of a member, 0 for an empty slot
+} MemberIndex_t;
+
+enum ClassState {
+    CLASS_LOADING, // reading its class file, which loads its superclass
+    CLASS_LOADED, // its members read, its methods translated and verified
+    CLASS_INITIALIZED, // its natives bound and its instances recognisable, ready to use
+};
 
 struct _Class {
     struct {
@@ -101,9 +285,21 @@ struct _Class {
     } constant_pool;
     char const* name;
     Class_t* super;
+    uint8_t state; // enum ClassState
+    // the class file, mapped for as long as the class is loaded
+    struct {
+        uint8_t const* base;
+        size_t size;
+    } file;
 
     uint16_t flags;
-    size_t size;
+    size_t size; // of an instance, starting with its header
+    size_t hole; // offset of 4 free bytes between the fields of an instance, 0 if there are none
+    // offsets of the reference fields of an instance, inherited ones included
+    struct {
+        size_t size;
+        size_t* list;
+    } refs;
 
     struct {
         size_t size;
@@ -117,17 +313,81 @@ struct _Class {
         size_t size;
         Method_t* list;
     } methods;
+    MemberIndex_t field_index; // by name
+    MemberIndex_t method_index; // by name and descriptor
 
-    Method_t** vtable; // NULL-terminated
+    Method_t** vtable; // NULL-terminated, preceded by the class itself (see class_of())
+    Header_t header; // of its instances, set by register_class()
 
     char const* source_file;
+    size_t metadata_size; // bytes of class_metadata it took, those of its superclasses not included
 };
 
+/*
+ * Everything the loader builds for a class, the Class_t itself included, is
+ * allocated from this arena and lives until load_end() releases it at once.
+ * Only what the JIT grows or patches later stays on the C heap.
+ */
+extern Arena_t class_metadata;
+
 char const* resolve_utf8(Const_t* constant_pool_list, size_t i);
-char const* resolve_class(Const_t* constant_pool_list, size_t i);
-Field_t* resolve_fieldref(Const_t* constant_pool_list, size_t i);
-Method_t* resolve_methodref(Const_t* constant_pool_list, size_t i);
+char const* resolve_class_name(Const_t* constant_pool_list, size_t i);
 
+Class_t* resolve_class_slow(Const_t* constant_pool_list, size_t i);
+Field_t* resolve_fieldref_slow(Const_t* constant_pool_list, size_t i);
+Method_t* resolve_methodref_slow(Const_t* constant_pool_list, size_t i);
+
+// each constant pool entry takes the slow path at most once
+static inline Class_t* resolve_class(Const_t* constant_pool_list, size_t i)
+{
+    Class_t* c = constant_pool_list[i - 1].resolved.class;
+    return (c != NULL ? c : resolve_class_slow(constant_pool_list, i));
+}
+static inline Field_t* resolve_fieldref(Const_t* constant_pool_list, size_t i)
+{
+    Field_t* f = constant_pool_list[i - 1].resolved.field;
+    return (f != NULL ? f : resolve_fieldref_slow(constant_pool_list, i));
+}
+static inline Method_t* resolve_methodref(Const_t* constant_pool_list, size_t i)
+{
+    Method_t* m = constant_pool_list[i - 1].resolved.method;
+    return (m != NULL ? m : resolve_methodref_slow(constant_pool_list, i));
+}
+
+// index the members c declares, once its fields and methods are read
+void index_members(Class_t* c);
+// the member c itself declares, or NULL; names and descriptors are symbols (see symbol.h)
+Field_t* find_field(Class_t const* c, char const* name);
+Method_t* find_method(Class_t const* c, char const* name, char const* desc);
+// the member c declares or inherits, failing if there is none
 Method_t* get_method(Class_t* c, char const* methodname, char const* desc);
 
+// make instances of c, its vtable complete, recognisable by their header
+void register_class(Class_t* c);
+void unregister_classes(void);
+
+static inline Method_t** vtable_of(void const* o)
+{
+#ifdef COMPACT_HEADERS
+    return *(Method_t***)((uint8_t*)class_vtables + *(Header_t const*)o);
+#else
+    return *(Header_t const*)o;
+#endif
+}
+// class of the object o, from the word before its vtable
+static inline Class_t* class_of(void const* o)
+{
+    return ((Class_t**)vtable_of(o))[-1];
+}
+
+// number of arguments in the method descriptor desc, not counting any receiver
+size_t nr_desc_args(char const* desc);
+// parse desc into sig, sig->arg_types must have room for nr_desc_args(desc) + has_receiver entries
+void parse_desc(Signature_t* sig, char const* desc, int has_receiver);
+// fill in m->sig from m->desc and m->flags
+void parse_signature(Method_t* m);
+
+// descriptor of a CONST_FIELD or CONST_METHOD entry, without resolving it
+char const* resolve_ref_desc(Const_t* constant_pool_list, size_t i);
+
 #endif // CLASS_H
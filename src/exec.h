@@ -0,0 +1,11 @@
+#ifndef EXEC_H
+#define EXEC_H
+
+#include "class.h"
+
+#include <stddef.h>
+
+// run m on nr_args argument slots, one per argument including any receiver
+Slot_t call_method(Method_t* m, Slot_t* args, size_t nr_args);
+
+#endif // EXEC_H
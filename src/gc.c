@@ -0,0 +1,347 @@
+#include "class.h"
+#include "gc.h"
+#include "thread.h"
+#include "util.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define CARD_SIZE ((size_t)1 << CARD_SHIFT)
+#define NO_OBJECT UINT16_MAX
+
+typedef struct {
+    uint8_t* start;
+    uint8_t* top; // end of the allocated part
+    uint8_t* end;
+} Space_t;
+
+uintptr_t gc_card_bias;
+
+static struct {
+    uint8_t* base; // of eden, the survivor spaces and the old generation, in that order
+    size_t size;
+    size_t tlab_size;
+    uint32_t promotion_age;
+
+    Space_t eden;
+    // objects that survived a young collection are in survivor[0], survivor[1] takes them during the next
+    Space_t survivor[2];
+    uint8_t* ages[2]; // per 8 bytes of each survivor space, young collections the object starting there survived
+    // likewise for the old generation and full collections
+    Space_t old[2];
+    uint8_t* cards; // per card of the heap
+    uint16_t* first_object; // per card of the old generation, offset in it of the first object starting there
+
+    int full; // the collection under way empties the old generation as well
+    struct {
+        size_t nr, cap;
+        Slot_t** list;
+    } roots;
+
+    struct {
+        size_t young, full; // collections
+        size_t survived, promoted; // bytes young collections copied to a survivor space, and to the old generation
+        size_t kept; // bytes the last full collection copied
+    } stats;
+} heap;
+
+static size_t page_round(size_t size)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+static Space_t make_space(uint8_t** p, size_t size)
+{
+    Space_t s = { *p, *p, *p + size };
+    *p += size;
+    return s;
+}
+static size_t space_size(Space_t const* s)
+{
+    return s->end - s->start;
+}
+static int in_space(Space_t const* s, void const* p)
+{
+    return (uint8_t const*)p >= s->start && (uint8_t const*)p < s->top;
+}
+
+void gc_init(size_t heap_size, size_t young_size, size_t tlab_size, uint32_t promotion_age)
+{
+    if (young_size >= heap_size)
+        errorf("young generation of %lu bytes does not fit a heap of %lu", young_size, heap_size);
+    size_t survivor = page_round(young_size / 8);
+    // eden takes what the survivor spaces leave, and needs at least a page
+    if (young_size < 2 * survivor + page_round(1))
+        errorf("young generation of %lu bytes leaves no eden next to two survivor spaces of %lu", young_size, survivor);
+    size_t eden = page_round(young_size - 2 * survivor);
+    size_t old = page_round((heap_size - young_size) / 2);
+    size_t size = eden + 2 * survivor + 2 * old;
+
+    // pages are only committed when touched
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED)
+        errorf("unable to reserve %lu bytes of heap", size);
+
+    heap.base = p;
+    heap.size = size;
+    heap.tlab_size = tlab_size;
+    heap.promotion_age = promotion_age;
+
+    uint8_t* q = heap.base;
+    heap.eden = make_space(&q, eden);
+    for (size_t i = 0; i < 2; ++i) {
+        heap.survivor[i] = make_space(&q, survivor);
+        heap.ages[i] = malloc(survivor / 8);
+    }
+    for (size_t i = 0; i < 2; ++i)
+        heap.old[i] = make_space(&q, old);
+
+    heap.cards = calloc(size >> CARD_SHIFT, 1);
+    gc_card_bias = (uintptr_t)heap.cards - ((uintptr_t)heap.base >> CARD_SHIFT);
+    heap.first_object = malloc(sizeof(heap.first_object[0]) * (old >> CARD_SHIFT));
+    memset(heap.first_object, 0xff, sizeof(heap.first_object[0]) * (old >> CARD_SHIFT));
+}
+
+void gc_end(void)
+{
+    debugf("gc: %lu young and %lu full collections\n", heap.stats.young, heap.stats.full);
+    munmap(heap.base, heap.size);
+    for (size_t i = 0; i < 2; ++i)
+        free(heap.ages[i]);
+    free(heap.cards);
+    free(heap.first_object);
+    free(heap.roots.list);
+    heap.roots.list = NULL;
+    heap.roots.nr = heap.roots.cap = 0;
+}
+
+void gc_print_stats(void)
+{
+    fprintf(stderr, "gc statistics:\n");
+    fprintf(stderr, "  young generation: %lu collections, %lu bytes copied to survivor spaces, %lu bytes promoted"
+                    " (eden %lu bytes, survivor spaces %lu bytes, promotion age %u)\n",
+        heap.stats.young, heap.stats.survived, heap.stats.promoted,
+        space_size(&heap.eden), space_size(&heap.survivor[0]), heap.promotion_age);
+    fprintf(stderr, "  old generation: %lu collections, %lu bytes kept by the last, %lu of %lu bytes in use\n",
+        heap.stats.full, heap.stats.kept, (size_t)(heap.old[0].top - heap.old[0].start), space_size(&heap.old[0]));
+}
+
+void gc_add_root(Slot_t* root)
+{
+    if (heap.roots.nr == heap.roots.cap) {
+        heap.roots.cap = (heap.roots.cap == 0 ? 16 : 2 * heap.roots.cap);
+        heap.roots.list = realloc(heap.roots.list, sizeof(heap.roots.list[0]) * heap.roots.cap);
+    }
+    heap.roots.list[heap.roots.nr++] = root;
+}
+
+// size bytes at the top of the old generation being filled, keeping track of where objects start on each card
+static uint8_t* old_alloc(size_t size)
+{
+    Space_t* s = &heap.old[heap.full];
+    if ((size_t)(s->end - s->top) < size)
+        errorf("java/lang/OutOfMemoryError: old generation of %lu bytes is full", space_size(s));
+    uint8_t* p = s->top;
+    s->top += size;
+    size_t offset = p - s->start;
+    if (heap.first_object[offset >> CARD_SHIFT] == NO_OBJECT)
+        heap.first_object[offset >> CARD_SHIFT] = offset & (CARD_SIZE - 1);
+    return p;
+}
+
+static int evacuated(void const* p)
+{
+    return in_space(&heap.eden, p) || in_space(&heap.survivor[0], p) || (heap.full && in_space(&heap.old[0], p));
+}
+
+/*
+ * The copy of o, made on the first visit, after which the first word of o
+ * holds its address with the low bit set, which no header has (objects take
+ * a word at least, compact headers or not). Young objects go to the next
+ * survivor space until they are old enough or it is full. Anything the
+ * collection does not empty stays where it is: NULL, objects copied already,
+ * the old generation in a young collection and the objects natives keep
+ * outside the heap.
+ */
+static void* forward(void* o)
+{
+    if (!evacuated(o))
+        return o;
+    uintptr_t header = *(uintptr_t*)o;
+    if (header & 1)
+        return (void*)(header & ~(uintptr_t)1);
+    size_t size = object_size(class_of(o));
+
+    uint8_t* copy;
+    Space_t* to = &heap.survivor[1];
+    unsigned age = 1 + (in_space(&heap.survivor[0], o) ? heap.ages[0][((uint8_t*)o - heap.survivor[0].start) / 8] : 0);
+    if (!heap.full && age < heap.promotion_age && (size_t)(to->end - to->top) >= size) {
+        copy = to->top;
+        to->top += size;
+        heap.ages[1][(copy - to->start) / 8] = (age < UINT8_MAX ? age : UINT8_MAX);
+        heap.stats.survived += size;
+    } else {
+        copy = old_alloc(size);
+        if (!heap.full)
+            heap.stats.promoted += size;
+    }
+    memcpy(copy, o, size);
+    *(uintptr_t*)o = (uintptr_t)copy | 1;
+    return copy;
+}
+static void forward_slot(Slot_t* s)
+{
+    s->a = forward(s->a);
+}
+
+static void scan_roots(Thread_t* t)
+{
+    for (size_t i = 0; i < heap.roots.nr; ++i)
+        forward_slot(heap.roots.list[i]);
+    walk_frame_roots(t, forward_slot);
+}
+
+// forward the fields of the object at p, dirtying its card if it is old and still points at a young object
+static size_t scan_object(uint8_t* p, int old)
+{
+    Class_t const* c = class_of(p);
+    int young = 0;
+    for (size_t i = 0; i < c->refs.size; ++i) {
+        void** field = (void**)(p + c->refs.list[i]);
+        *field = forward(*field);
+        young |= in_space(&heap.survivor[1], *field);
+    }
+    if (old && young)
+        gc_write_barrier(p);
+    return object_size(c);
+}
+
+// the objects starting on the dirty cards of the old generation below end
+static void scan_cards(uint8_t* end)
+{
+    Space_t const* old = &heap.old[0];
+    uint8_t* cards = heap.cards + ((old->start - heap.base) >> CARD_SHIFT);
+    size_t nr = (end - old->start + CARD_SIZE - 1) >> CARD_SHIFT;
+    for (size_t i = 0; i < nr; ++i) {
+        if (!cards[i])
+            continue;
+        cards[i] = 0;
+        if (heap.first_object[i] == NO_OBJECT)
+            continue;
+        uint8_t* card_end = old->start + ((i + 1) << CARD_SHIFT);
+        for (uint8_t* p = old->start + (i << CARD_SHIFT) + heap.first_object[i]; p < card_end && p < end;)
+            p += scan_object(p, 1);
+    }
+}
+
+static void empty_eden(void)
+{
+    memset(heap.eden.start, 0, heap.eden.top - heap.eden.start);
+    heap.eden.top = heap.eden.start;
+}
+
+static void collect_young(Thread_t* t)
+{
+    Space_t* to = &heap.survivor[1];
+    Space_t* old = &heap.old[0];
+    uint8_t* promoted = old->top;
+    size_t survived = heap.stats.survived, promoted_before = heap.stats.promoted;
+
+    scan_roots(t);
+    scan_cards(promoted);
+    // copies not scanned yet are the queue, in the survivor space and in the old generation
+    for (uint8_t* scan = to->start; scan < to->top || promoted < old->top;) {
+        while (scan < to->top)
+            scan += scan_object(scan, 0);
+        while (promoted < old->top)
+            promoted += scan_object(promoted, 1);
+    }
+
+    empty_eden();
+    Space_t s = heap.survivor[0];
+    heap.survivor[0] = heap.survivor[1];
+    heap.survivor[1] = s;
+    heap.survivor[1].top = heap.survivor[1].start;
+    uint8_t* ages = heap.ages[0];
+    heap.ages[0] = heap.ages[1];
+    heap.ages[1] = ages;
+
+    heap.stats.young++;
+    debugf("gc: young collection %lu copied %lu bytes to a survivor space and promoted %lu\n",
+        heap.stats.young, heap.stats.survived - survived, heap.stats.promoted - promoted_before);
+}
+
+static void collect_full(Thread_t* t)
+{
+    Space_t* to = &heap.old[1];
+    size_t used = heap.old[0].top - heap.old[0].start;
+    heap.full = 1;
+    memset(heap.first_object, 0xff, sizeof(heap.first_object[0]) * (space_size(to) >> CARD_SHIFT));
+
+    scan_roots(t);
+    for (uint8_t* scan = to->start; scan < to->top;)
+        scan += scan_object(scan, 0);
+
+    heap.full = 0;
+    empty_eden();
+    heap.survivor[0].top = heap.survivor[0].start;
+    // nothing young is left for old objects to point at
+    memset(heap.cards, 0, heap.size >> CARD_SHIFT);
+    madvise(heap.old[0].start, space_size(&heap.old[0]), MADV_DONTNEED);
+    heap.old[0].top = heap.old[0].start;
+    Space_t s = heap.old[0];
+    heap.old[0] = heap.old[1];
+    heap.old[1] = s;
+
+    heap.stats.full++;
+    heap.stats.kept = heap.old[0].top - heap.old[0].start;
+    debugf("gc: full collection %lu kept %lu bytes, the old generation held %lu before\n", heap.stats.full, heap.stats.kept, used);
+}
+
+static void collect(Thread_t* t)
+{
+    // a young collection may have to promote all of the young generation
+    size_t young = (heap.eden.top - heap.eden.start) + (heap.survivor[0].top - heap.survivor[0].start);
+    if ((size_t)(heap.old[0].end - heap.old[0].top) < young)
+        collect_full(t);
+    else
+        collect_young(t);
+    t->tlab.top = t->tlab.end = NULL;
+}
+
+void* gc_alloc_slow(Thread_t* t, size_t size)
+{
+    for (int collected = 0;; collected = 1) {
+        size_t left = heap.eden.end - heap.eden.top;
+        size_t chunk = (size > heap.tlab_size ? size : heap.tlab_size);
+        if (chunk > left)
+            chunk = left;
+        if (chunk >= size) {
+            uint8_t* p = heap.eden.top;
+            heap.eden.top += chunk;
+            t->tlab.top = p + size;
+            t->tlab.end = p + chunk;
+            return p;
+        }
+        if (collected)
+            errorf("java/lang/OutOfMemoryError: no room for %lu bytes in an eden of %lu", size, space_size(&heap.eden));
+        collect(t);
+    }
+}
+
+void* alloc_object(Class_t* c)
+{
+    Thread_t* t = &main_thread;
+    size_t size = object_size(c);
+    uint8_t* o = t->tlab.top;
+    if ((size_t)(t->tlab.end - o) >= size)
+        t->tlab.top = o + size;
+    else
+        o = gc_alloc_slow(t, size);
+    *(Header_t*)o = c->header;
+    return o;
+}
@@ -0,0 +1,54 @@
+#ifndef GC_H
+#define GC_H
+
+#include "class.h"
+#include "thread.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Generational heap, reserved up front. New objects are allocated by bumping
+ * a pointer through a thread's TLAB, which is refilled from eden. When eden
+ * runs out a young collection copies the objects reachable from the static
+ * fields, the frames of the thread (see Frame_t) and the dirty cards of the
+ * old generation into a survivor space, or into the old generation once they
+ * have survived promotion_age young collections. A full collection copies
+ * everything reachable into the other half of the old generation (Cheney),
+ * when the old generation may not have room for what a young collection
+ * promotes. Eden is zeroed as it is emptied, so new objects read as zero.
+ */
+void gc_init(size_t heap_size, size_t young_size, size_t tlab_size, uint32_t promotion_age);
+void gc_end(void);
+void gc_print_stats(void);
+
+// a static field that may hold a reference, scanned by every collection
+void gc_add_root(Slot_t* root);
+
+// size of an instance of c on the heap
+static inline size_t object_size(Class_t const* c)
+{
+    return (c->size + 7) & ~(size_t)7;
+}
+
+// a new instance of c, its fields zero and its first word pointing at the vtable
+void* alloc_object(Class_t* c);
+// size bytes once the TLAB of t is exhausted, collecting if need be
+void* gc_alloc_slow(Thread_t* t, size_t size);
+
+/*
+ * One card byte per 1 << CARD_SHIFT bytes of the heap, set when a reference
+ * is stored into an object starting there. Young collections only scan the
+ * objects of the old generation on dirty cards for pointers into the young
+ * one. The table is addressed through gc_card_bias, so that the card of an
+ * object is a shift and an add away.
+ */
+#define CARD_SHIFT 9
+extern uintptr_t gc_card_bias;
+
+static inline void gc_write_barrier(void const* o)
+{
+    *(uint8_t*)(gc_card_bias + ((uintptr_t)o >> CARD_SHIFT)) = 1;
+}
+
+#endif // GC_H
@@ -0,0 +1,90 @@
+#include "class.h"
+#include "inline_cache.h"
+#include "opcode.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static InlineCache_t* inline_caches = NULL;
+static InlineCache_t** inline_caches_tail = &inline_caches;
+
+InlineCache_t* ic_new(Method_t* m, Method_t const* caller, Insn_t* insn)
+{
+    InlineCache_t* ic = calloc(1, sizeof(*ic));
+    ic->method = m;
+    ic->caller = caller;
+    ic->insn = insn;
+    ic->next = NULL;
+    *inline_caches_tail = ic;
+    inline_caches_tail = &ic->next;
+    return ic;
+}
+
+Method_t* ic_miss(InlineCache_t* ic, Insn_t* insn, void* o)
+{
+    Method_t** vtable = vtable_of(o);
+    Method_t* target = vtable[ic->method->vtable_offset];
+    ic->misses++;
+
+    if (insn->op == INVOKEVIRTUAL_MEGA)
+        return target;
+    if (ic->nr_entries == IC_MAX_ENTRIES) {
+        ic->megamorphic = 1;
+        insn->op = INVOKEVIRTUAL_MEGA;
+        return target;
+    }
+    ic->entries[ic->nr_entries].vtable = vtable;
+    ic->entries[ic->nr_entries].target = target;
+    ic->nr_entries++;
+    insn->op = (ic->nr_entries == 1 ? INVOKEVIRTUAL_MONO : INVOKEVIRTUAL_POLY);
+    return target;
+}
+
+Method_t* ic_lookup(InlineCache_t* ic, Insn_t* insn, void* o)
+{
+    if (insn->op == INVOKEVIRTUAL_DIRECT) {
+        ic->hits++;
+        return ic->method;
+    }
+    Method_t** vtable = vtable_of(o);
+    for (size_t i = 0; i < ic->nr_entries; ++i)
+        if (ic->entries[i].vtable == vtable) {
+            ic->hits++;
+            return ic->entries[i].target;
+        }
+    return ic_miss(ic, insn, o);
+}
+
+void ic_override(Method_t const* m)
+{
+    for (InlineCache_t* ic = inline_caches; ic != NULL; ic = ic->next)
+        if (ic->method == m && ic->insn->op == INVOKEVIRTUAL_DIRECT)
+            ic->insn->op = INVOKEVIRTUAL_MONO;
+}
+
+void ic_print_stats(void)
+{
+    fprintf(stderr, "inline cache statistics:\n");
+    for (InlineCache_t const* ic = inline_caches; ic != NULL; ic = ic->next) {
+        uint64_t total = ic->hits + ic->misses;
+        char const* state = (ic->insn->op == INVOKEVIRTUAL_DIRECT ? "direct"
+                : ic->megamorphic                               ? "megamorphic"
+                : ic->nr_entries > 1                            ? "polymorphic"
+                                                                : "monomorphic");
+        fprintf(stderr, "  %s.%s@%u -> %s.%s%s: %s, %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hit rate)\n",
+            ic->caller->c->name, ic->caller->name, ic->insn->pc,
+            ic->method->c->name, ic->method->name, ic->method->desc,
+            state, ic->hits, ic->misses, (total == 0 ? 0.0 : 100.0 * ic->hits / total));
+    }
+}
+
+void ic_end(void)
+{
+    while (inline_caches != NULL) {
+        InlineCache_t* next = inline_caches->next;
+        free(inline_caches);
+        inline_caches = next;
+    }
+    inline_caches_tail = &inline_caches;
+}
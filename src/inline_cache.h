@@ -0,0 +1,44 @@
+#ifndef INLINE_CACHE_H
+#define INLINE_CACHE_H
+
+#include "class.h"
+
+#include <stdint.h>
+
+#define IC_MAX_ENTRIES 4
+
+/*
+ * Per call site cache of INVOKEVIRTUAL targets keyed on the receiver's vtable
+ * pointer. The state of a site is encoded in the opcode of its instruction:
+ * INVOKEVIRTUAL_MONO checks a single entry, INVOKEVIRTUAL_POLY up to
+ * IC_MAX_ENTRIES of them and INVOKEVIRTUAL_MEGA gives up and indexes the vtable.
+ * INVOKEVIRTUAL_DIRECT calls the statically resolved target without looking at
+ * the receiver, for as long as no loaded class overrides it (see cha.h).
+ */
+struct InlineCache {
+    Method_t* method; // statically resolved target, its vtable_offset is used on misses
+    uint8_t nr_entries;
+    uint8_t megamorphic;
+    struct {
+        Method_t** vtable;
+        Method_t* target;
+    } entries[IC_MAX_ENTRIES];
+
+    uint64_t hits, misses;
+
+    Method_t const* caller;
+    Insn_t* insn;
+    InlineCache_t* next;
+};
+
+InlineCache_t* ic_new(Method_t* m, Method_t const* caller, Insn_t* insn);
+// look up the target for receiver o on a miss, filling the cache and moving insn to its next state
+Method_t* ic_miss(InlineCache_t* ic, Insn_t* insn, void* o);
+// look the target up in every entry before missing, whatever the state of insn
+Method_t* ic_lookup(InlineCache_t* ic, Insn_t* insn, void* o);
+// move the INVOKEVIRTUAL_DIRECT sites calling m to an empty monomorphic cache, as a loaded class overrides m
+void ic_override(Method_t const* m);
+void ic_print_stats(void);
+void ic_end(void);
+
+#endif // INLINE_CACHE_H
@@ -0,0 +1,971 @@
+#include "ir.h"
+#include "class.h"
+#include "inline_cache.h"
+#include "loader.h"
+#include "opcode.h"
+#include "typeflow.h"
+#include "util.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+// slot types in the order the JVM lays out typed opcode families
+static uint8_t const jvm_types[] = { I, L, F, D, A };
+
+static void* grow(void* buf, size_t* cap, size_t need, size_t size)
+{
+    if (need <= *cap)
+        return buf;
+    *cap = (*cap == 0 ? 8 : 2 * *cap);
+    if (*cap < need)
+        *cap = need;
+    return realloc(buf, *cap * size);
+}
+
+uint32_t ir_new_insn(IrFunc_t* f, uint32_t block, uint8_t op, uint8_t type, size_t nr_args)
+{
+    f->insns = grow(f->insns, &f->cap_insns, f->nr_insns + 1, sizeof(f->insns[0]));
+    f->args = grow(f->args, &f->cap_args, f->nr_args + nr_args, sizeof(f->args[0]));
+    uint32_t v = f->nr_insns++;
+    f->insns[v] = (IrInsn_t) {
+        .op = op,
+        .type = type,
+        .nr_args = nr_args,
+        .args = f->nr_args,
+        .block = block,
+    };
+    for (size_t k = 0; k < nr_args; ++k)
+        f->args[f->nr_args++] = IR_NONE;
+
+    IrBlock_t* b = &f->blocks[block];
+    b->insns = grow(b->insns, &b->cap_insns, b->nr_insns + 1, sizeof(b->insns[0]));
+    if (op == IR_PHI) {
+        // keep phis first
+        size_t at = 0;
+        while (at < b->nr_insns && f->insns[b->insns[at]].op == IR_PHI)
+            at++;
+        memmove(&b->insns[at + 1], &b->insns[at], sizeof(b->insns[0]) * (b->nr_insns - at));
+        b->insns[at] = v;
+        b->nr_insns++;
+    } else
+        b->insns[b->nr_insns++] = v;
+    return v;
+}
+
+uint32_t ir_new_block(IrFunc_t* f)
+{
+    f->blocks = grow(f->blocks, &f->cap_blocks, f->nr_blocks + 1, sizeof(f->blocks[0]));
+    memset(&f->blocks[f->nr_blocks], 0, sizeof(f->blocks[0]));
+    return f->nr_blocks++;
+}
+
+void ir_add_edge(IrFunc_t* f, uint32_t from, uint32_t to)
+{
+    IrBlock_t* b = &f->blocks[to];
+    f->blocks[from].succs[f->blocks[from].nr_succs++] = to;
+    b->preds = grow(b->preds, &b->cap_preds, b->nr_preds + 1, sizeof(b->preds[0]));
+    b->preds[b->nr_preds++] = from;
+}
+
+// drop the edge from -> to along with the phi arguments flowing over it
+void ir_remove_edge(IrFunc_t* f, uint32_t from, uint32_t to)
+{
+    IrBlock_t* a = &f->blocks[from];
+    for (size_t k = 0; k < a->nr_succs; ++k)
+        if (a->succs[k] == to) {
+            a->succs[k] = a->succs[--a->nr_succs];
+            break;
+        }
+
+    IrBlock_t* b = &f->blocks[to];
+    size_t k = 0;
+    while (k < b->nr_preds && b->preds[k] != from)
+        k++;
+    if (k == b->nr_preds)
+        panicf("no edge from block %u to %u", from, to);
+    memmove(&b->preds[k], &b->preds[k + 1], sizeof(b->preds[0]) * (b->nr_preds - k - 1));
+    b->nr_preds--;
+    for (size_t n = 0; n < b->nr_insns; ++n) {
+        IrInsn_t* phi = &f->insns[b->insns[n]];
+        if (phi->op != IR_PHI)
+            break;
+        memmove(&f->args[phi->args + k], &f->args[phi->args + k + 1], sizeof(f->args[0]) * (phi->nr_args - k - 1));
+        phi->nr_args--;
+    }
+}
+
+static void postorder(IrFunc_t* f, uint32_t b, uint8_t* seen, uint32_t* out, size_t* n)
+{
+    seen[b] = 1;
+    IrBlock_t* block = &f->blocks[b];
+    // visit the fall through successor, succs[1], last so it tends to directly follow b in reverse postorder
+    for (size_t k = 0; k < block->nr_succs; ++k)
+        if (!seen[block->succs[k]])
+            postorder(f, block->succs[k], seen, out, n);
+    out[(*n)++] = b;
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+static uint32_t intersect(IrFunc_t* f, uint32_t a, uint32_t b)
+{
+    while (a != b) {
+        while (f->blocks[a].rpo > f->blocks[b].rpo)
+            a = f->blocks[a].idom;
+        while (f->blocks[b].rpo > f->blocks[a].rpo)
+            b = f->blocks[b].idom;
+    }
+    return a;
+}
+
+void ir_compute_order(IrFunc_t* f)
+{
+    uint8_t* seen = calloc(f->nr_blocks, 1);
+    uint32_t* post = malloc(sizeof(post[0]) * f->nr_blocks);
+    size_t n = 0;
+    postorder(f, 0, seen, post, &n);
+
+    // edges out of blocks that just became unreachable must not feed phis
+    for (uint32_t b = 0; b < f->nr_blocks; ++b) {
+        IrBlock_t* block = &f->blocks[b];
+        if (seen[b] || block->dead)
+            continue;
+        block->dead = 1;
+        while (block->nr_succs > 0)
+            ir_remove_edge(f, b, block->succs[0]);
+    }
+
+    f->order = realloc(f->order, sizeof(f->order[0]) * n);
+    f->nr_order = n;
+    for (size_t k = 0; k < n; ++k) {
+        f->order[k] = post[n - 1 - k];
+        f->blocks[f->order[k]].rpo = k;
+        f->blocks[f->order[k]].idom = IR_NONE;
+    }
+    free(post);
+    free(seen);
+
+    f->blocks[0].idom = 0;
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (size_t k = 1; k < f->nr_order; ++k) {
+            IrBlock_t* block = &f->blocks[f->order[k]];
+            uint32_t idom = IR_NONE;
+            for (size_t p = 0; p < block->nr_preds; ++p) {
+                uint32_t pred = block->preds[p];
+                if (f->blocks[pred].idom == IR_NONE)
+                    continue;
+                idom = (idom == IR_NONE ? pred : intersect(f, pred, idom));
+            }
+            if (idom != block->idom) {
+                block->idom = idom;
+                changed = 1;
+            }
+        }
+    }
+}
+
+int ir_is_pure(IrInsn_t const* insn)
+{
+    switch (insn->op) {
+    case IR_CONST:
+    case IR_PARAM:
+    case IR_PHI:
+    case IR_COPY:
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_AND:
+    case IR_OR:
+    case IR_XOR:
+    case IR_SHL:
+    case IR_SHR:
+    case IR_USHR:
+    case IR_NEG:
+    case IR_CONV:
+    case IR_CMP:
+    case IR_GETSTATIC:
+    case IR_GETFIELD:
+        return 1;
+    case IR_DIV:
+    case IR_REM:
+        // integer division by zero throws
+        return ir_class(insn->type);
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Construction walks the basic blocks of the bytecode in reverse postorder,
+ * keeping the SSA value of every local variable and operand stack entry in
+ * cur. A block with a single predecessor starts from the state its
+ * predecessor ended with, a block with several starts with a phi for every
+ * slot infer_types() found live there; phi arguments are filled in once
+ * every block has been lifted. Phis that turn out to merge a single value
+ * are cleaned up by ir_optimize().
+ *
+ * Calls to small straight line methods whose target is known are inlined:
+ * the callee is lifted in place of the call with the arguments as its local
+ * variables, and what it returns replaces the call. The target of an
+ * INVOKEVIRTUAL is known when nothing can override it, when the receiver is
+ * allocated by the code being compiled, or when no loaded class overrides it
+ * so far (see cha.h). The latter is checked before the inlined code, falling
+ * back to the virtual call, and the rest of the bytecode block continues in a
+ * new block joining both. Object.<init> does nothing and is simply dropped.
+ */
+// callees of at most this many bytes of bytecode are inlined, up to this many calls deep
+#define INLINE_MAX_SIZE 35
+#define INLINE_MAX_DEPTH 6
+
+// a call site considered for inlining, for the report
+typedef struct {
+    uint8_t depth;
+    uint16_t pc;
+    Method_t const* callee;
+    char const* why; // it was not inlined, or NULL
+    int16_t uses; // opcode that could not be lifted, or -1
+} Inlining_t;
+typedef struct {
+    Inlining_t* list;
+    size_t size, cap;
+} Report_t;
+
+typedef struct Lift Lift_t;
+struct Lift {
+    IrFunc_t* f;
+    Method_t* m;
+    size_t width; // max_locals + max_stack
+    uint32_t* first; // first bytecode instruction of each block
+    uint32_t* block_at; // block starting at each bytecode instruction, or IR_NONE
+    uint32_t** exit; // state at the end of each lifted block
+    size_t nr_exit;
+    uint32_t* cur;
+    size_t sp;
+    uint32_t block;
+    int failed;
+
+    Lift_t const* caller; // of an inlined method, NULL for the method being compiled
+    size_t depth; // of inlining
+    Report_t* report;
+};
+
+static uint32_t konst(Lift_t* l, uint8_t type, int64_t imm)
+{
+    IrBlock_t* entry = &l->f->blocks[0];
+    for (size_t k = 0; k < entry->nr_insns; ++k) {
+        IrInsn_t const* insn = &l->f->insns[entry->insns[k]];
+        if (insn->op == IR_CONST && insn->type == type && insn->imm == imm)
+            return entry->insns[k];
+    }
+    uint32_t v = ir_new_insn(l->f, 0, IR_CONST, type, 0);
+    l->f->insns[v].imm = imm;
+    return v;
+}
+static void push(Lift_t* l, uint32_t v)
+{
+    l->cur[l->m->max_locals + l->sp++] = v;
+}
+static uint32_t pop(Lift_t* l)
+{
+    return l->cur[l->m->max_locals + --l->sp];
+}
+static uint32_t load(Lift_t* l, uint16_t index)
+{
+    uint32_t v = l->cur[index];
+    if (v == IR_NONE)
+        l->failed = 1;
+    return v;
+}
+static void store(Lift_t* l, uint16_t index, uint32_t v)
+{
+    uint8_t type = l->f->insns[v].type;
+    if (index > 0 && l->cur[index - 1] != IR_NONE && (l->f->insns[l->cur[index - 1]].type == L || l->f->insns[l->cur[index - 1]].type == D))
+        l->cur[index - 1] = IR_NONE;
+    l->cur[index] = v;
+    if (type == L || type == D)
+        l->cur[index + 1] = IR_NONE;
+}
+static uint32_t emit(Lift_t* l, uint8_t op, uint8_t type, size_t nr_args)
+{
+    uint32_t v = ir_new_insn(l->f, l->block, op, type, nr_args);
+    for (size_t k = nr_args; k-- > 0;)
+        l->f->args[l->f->insns[v].args + k] = pop(l);
+    return v;
+}
+static void emit_push(Lift_t* l, uint8_t op, uint8_t type, size_t nr_args)
+{
+    push(l, emit(l, op, type, nr_args));
+}
+static void emit_branch(Lift_t* l, enum IrCond cond, size_t nr_args)
+{
+    // IFxx compare against 0
+    if (nr_args == 1)
+        push(l, konst(l, I, 0));
+    uint32_t v = emit(l, IR_BRANCH, IR_VOID, 2);
+    l->f->insns[v].cond = cond;
+}
+
+static int is_quickened(Insn_t const* insn, enum opcode op)
+{
+    return insn->op != op;
+}
+static uint8_t ref_type(Method_t const* m, Insn_t const* insn)
+{
+    return get_value_type(resolve_ref_desc(m->c->constant_pool.list, insn->index)[0]);
+}
+
+static void assume(IrFunc_t* f, Method_t* m);
+static int is_final(Method_t const* callee);
+static Method_t* exact_target(Lift_t const* l, Insn_t const* insn, size_t nr_args);
+static int inline_call(Lift_t* l, Insn_t* insn, Method_t* callee, size_t nr_args, uint8_t ret_type, int bound);
+
+// lift a single bytecode instruction, returning 0 if it cannot be
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic" // case ranges
+static int lift_insn(Lift_t* l, Insn_t* insn)
+{
+    Method_t* m = l->m;
+    IrFunc_t* f = l->f;
+    enum opcode op = m->code[insn->pc];
+    switch (op) {
+    case NOP:
+        break;
+    case ACONST_NULL:
+        push(l, konst(l, A, 0));
+        break;
+    case ICONST_M1 ... ICONST_5:
+    case BIPUSH:
+    case SIPUSH:
+        push(l, konst(l, I, insn->i));
+        break;
+    case FCONST_0 ... FCONST_2:
+        push(l, konst(l, F, (uint32_t)insn->i));
+        break;
+    case LCONST_0:
+    case LCONST_1:
+        push(l, konst(l, L, insn->l));
+        break;
+    case DCONST_0:
+    case DCONST_1:
+        push(l, konst(l, D, insn->l));
+        break;
+    case LDC:
+    case LDC_W:
+    case LDC2_W:
+        push(l, konst(l, insn->type, insn->type == L || insn->type == D ? insn->l : insn->type == F ? (uint32_t)insn->i : insn->i));
+        break;
+    case ILOAD ... ALOAD:
+    case ILOAD_0 ... ALOAD_3:
+        push(l, load(l, insn->index));
+        break;
+    case ISTORE ... ASTORE:
+    case ISTORE_0 ... ASTORE_3:
+        store(l, insn->index, pop(l));
+        break;
+    case IINC:
+        push(l, load(l, insn->index));
+        push(l, konst(l, I, insn->i));
+        store(l, insn->index, emit(l, IR_ADD, I, 2));
+        break;
+    case POP:
+        pop(l);
+        break;
+    case DUP: {
+        uint32_t v = pop(l);
+        push(l, v);
+        push(l, v);
+    } break;
+    case SWAP: {
+        uint32_t b = pop(l), a = pop(l);
+        push(l, b);
+        push(l, a);
+    } break;
+    case IADD ... DREM:
+        emit_push(l, IR_ADD + (op - IADD) / 4, jvm_types[(op - IADD) % 4], 2);
+        break;
+    case INEG ... DNEG:
+        emit_push(l, IR_NEG, jvm_types[op - INEG], 1);
+        break;
+    case ISHL ... LUSHR:
+        emit_push(l, IR_SHL + (op - ISHL) / 2, jvm_types[(op - ISHL) % 2], 2);
+        break;
+    case IAND ... LXOR:
+        emit_push(l, IR_AND + (op - IAND) / 2, jvm_types[(op - IAND) % 2], 2);
+        break;
+    case I2L ... I2S: {
+        static uint8_t const to[] = { L, F, D, I, F, D, I, L, D, I, L, F, I, I, I };
+        uint32_t v = emit(l, IR_CONV, to[op - I2L], 1);
+        f->insns[v].imm = op;
+        push(l, v);
+    } break;
+    case LCMP ... DCMPG: {
+        uint32_t v = emit(l, IR_CMP, I, 2);
+        f->insns[v].imm = (op == FCMPG || op == DCMPG ? 1 : -1);
+        push(l, v);
+    } break;
+    case IFEQ ... IFLE:
+        emit_branch(l, op - IFEQ, 1);
+        break;
+    case IF_ICMPEQ ... IF_ICMPLE:
+        emit_branch(l, op - IF_ICMPEQ, 2);
+        break;
+    case IF_ACMPEQ:
+    case IF_ACMPNE:
+        emit_branch(l, op - IF_ACMPEQ, 2);
+        break;
+    case GOTO:
+        ir_new_insn(f, l->block, IR_JUMP, IR_VOID, 0);
+        break;
+    case IRETURN ... ARETURN:
+        emit(l, IR_RETURN, IR_VOID, 1);
+        break;
+    case RETURN:
+        emit(l, IR_RETURN, IR_VOID, 0);
+        break;
+
+    case GETSTATIC:
+    case PUTSTATIC:
+    case GETFIELD:
+    case PUTFIELD:
+    case NEW: {
+        uint8_t type = (op == NEW ? A : ref_type(m, insn));
+        if (type == ARR)
+            return 0;
+        uint32_t v;
+        switch (op) {
+        case GETSTATIC:
+            v = emit(l, IR_GETSTATIC, type, 0);
+            break;
+        case PUTSTATIC:
+            v = emit(l, IR_PUTSTATIC, IR_VOID, 1);
+            break;
+        case GETFIELD:
+            v = emit(l, IR_GETFIELD, type, 1);
+            break;
+        case PUTFIELD:
+            v = emit(l, IR_PUTFIELD, IR_VOID, 2);
+            break;
+        default:
+            v = emit(l, IR_NEW, A, 0);
+        }
+        f->insns[v].insn = insn;
+        f->insns[v].method = m;
+        f->insns[v].flags = (is_quickened(insn, op) ? 0 : IR_UNRESOLVED);
+        if (f->insns[v].type != IR_VOID)
+            push(l, v);
+    } break;
+
+    case INVOKEVIRTUAL:
+    case INVOKESPECIAL:
+    case INVOKESTATIC: {
+        int has_receiver = (op != INVOKESTATIC);
+        char const* desc;
+        size_t nr_args;
+        uint8_t ret_type = IR_VOID;
+        if (is_quickened(insn, op)) {
+            Method_t const* callee = (op == INVOKEVIRTUAL ? insn->ic->method : insn->method);
+            desc = callee->desc;
+            nr_args = insn->nr_args;
+        } else {
+            desc = resolve_ref_desc(m->c->constant_pool.list, insn->index);
+            nr_args = nr_desc_args(desc) + has_receiver;
+        }
+        char const* ret = strchr(desc, ')') + 1;
+        if (*ret == '[')
+            return 0;
+        if (*ret != 'V')
+            ret_type = get_value_type(*ret);
+        Method_t* callee = NULL;
+        if (is_quickened(insn, op)) {
+            callee = (op == INVOKEVIRTUAL ? insn->ic->method : insn->method);
+            Method_t* exact = (op == INVOKEVIRTUAL ? exact_target(l, insn, nr_args) : NULL);
+            int bound = (op != INVOKEVIRTUAL || exact != NULL || is_final(callee));
+            if (inline_call(l, insn, exact != NULL ? exact : callee, nr_args, ret_type, bound))
+                break;
+        }
+        uint32_t v = emit(l, IR_CALL, ret_type, nr_args);
+        f->insns[v].insn = insn;
+        f->insns[v].method = m;
+        f->insns[v].flags = (is_quickened(insn, op) ? 0 : IR_UNRESOLVED);
+        if (op == INVOKEVIRTUAL && callee != NULL && !callee->overridden) {
+            f->insns[v].flags |= IR_DIRECT;
+            assume(f, callee);
+        }
+        if (ret_type != IR_VOID)
+            push(l, v);
+    } break;
+
+    default:
+        return 0;
+    }
+    return 1;
+}
+#pragma GCC diagnostic pop
+
+static int ends_block(enum opcode op)
+{
+    return (op >= IFEQ && op <= GOTO) || (op >= IRETURN && op <= RETURN);
+}
+
+// whether the target of the INVOKEVIRTUAL insn can be called without looking at the receiver for good
+static int is_final(Method_t const* callee)
+{
+    return (callee->flags & (ACC_PRIVATE | ACC_FINAL)) || (callee->c->flags & ACC_FINAL);
+}
+
+// the target of the INVOKEVIRTUAL insn when its receiver is an object allocated by f, whose class is known, or NULL
+static Method_t* exact_target(Lift_t const* l, Insn_t const* insn, size_t nr_args)
+{
+    IrInsn_t const* receiver = &l->f->insns[l->cur[l->m->max_locals + l->sp - nr_args]];
+    if (receiver->op != IR_NEW || (receiver->flags & IR_UNRESOLVED))
+        return NULL;
+    return receiver->insn->class->vtable[insn->ic->method->vtable_offset];
+}
+// java/lang/Object.<init>, which every constructor ends up calling and which does nothing
+static int is_object_init(Method_t const* m)
+{
+    return m->c->super == NULL && m->name == init_name;
+}
+
+// code compiled from f calls m directly for as long as no loaded class overrides it
+static void assume(IrFunc_t* f, Method_t* m)
+{
+    if (is_final(m))
+        return;
+    for (size_t k = 0; k < f->nr_assumed; ++k)
+        if (f->assumed[k] == m)
+            return;
+    f->assumed = grow(f->assumed, &f->cap_assumed, f->nr_assumed + 1, sizeof(f->assumed[0]));
+    f->assumed[f->nr_assumed++] = m;
+}
+
+// why callee, the target of the quickened invoke insn of l->m, cannot be inlined, NULL if it can
+static char const* not_inlinable(Lift_t const* l, Method_t const* callee, int bound)
+{
+    if (!bound && callee->overridden)
+        return "overridden";
+    if (callee->insns == NULL)
+        return "no bytecode";
+    if (callee->code_length > INLINE_MAX_SIZE)
+        return "too big";
+    for (Lift_t const* c = l; c != NULL; c = c->caller)
+        if (c->m == callee)
+            return "recursive";
+    if (l->depth >= INLINE_MAX_DEPTH)
+        return "too deep";
+    for (size_t i = 0; i < callee->nr_insns; ++i) {
+        enum opcode op = callee->code[callee->insns[i].pc];
+        int returns = (op >= IRETURN && op <= RETURN);
+        if (i + 1 < callee->nr_insns ? op >= IFEQ && op <= RETURN : !returns)
+            return "not straight line code";
+    }
+    return NULL;
+}
+
+// make to the source of the edges leaving from, keeping its place among the predecessors of their targets
+static void move_succs(IrFunc_t* f, uint32_t from, uint32_t to)
+{
+    IrBlock_t* a = &f->blocks[from];
+    IrBlock_t* b = &f->blocks[to];
+    for (size_t k = 0; k < a->nr_succs; ++k) {
+        IrBlock_t* succ = &f->blocks[a->succs[k]];
+        for (size_t p = 0; p < succ->nr_preds; ++p)
+            if (succ->preds[p] == from)
+                succ->preds[p] = to;
+        b->succs[k] = a->succs[k];
+    }
+    b->nr_succs = a->nr_succs;
+    a->nr_succs = 0;
+}
+
+/*
+ * Lift callee in place of the call insn, returning 0 and leaving f as it was
+ * if it cannot be. Unless bound, callee is the target for as long as no
+ * loaded class overrides it. Afterwards l->block is the block the caller
+ * continues in.
+ */
+static int inline_call(Lift_t* l, Insn_t* insn, Method_t* callee, size_t nr_args, uint8_t ret_type, int bound)
+{
+    IrFunc_t* f = l->f;
+    Report_t* r = l->report;
+    size_t at = r->size;
+    r->list = grow(r->list, &r->cap, at + 1, sizeof(r->list[0]));
+    r->size++;
+    r->list[at] = (Inlining_t) { .depth = l->depth, .pc = insn->pc, .callee = callee, .uses = -1 };
+    if (is_object_init(callee)) {
+        l->sp -= nr_args;
+        return 1;
+    }
+    r->list[at].why = not_inlinable(l, callee, bound);
+    if (r->list[at].why != NULL)
+        return 0;
+
+    // callee goes to the end of the current block, or to a block of its own behind a check, and its constants to the entry block
+    int guarded = !bound;
+    size_t nr_insns = f->nr_insns, nr_ir_args = f->nr_args, nr_blocks = f->nr_blocks, nr_assumed = f->nr_assumed;
+    size_t in_entry = f->blocks[0].nr_insns, in_block = f->blocks[l->block].nr_insns;
+    uint32_t start = (guarded ? ir_new_block(f) : l->block);
+
+    Lift_t c = {
+        .f = f,
+        .m = callee,
+        .width = callee->max_locals + callee->max_stack,
+        .block = start,
+        .caller = l,
+        .depth = l->depth + 1,
+        .report = r,
+    };
+    c.cur = malloc(sizeof(c.cur[0]) * c.width);
+    for (size_t k = 0; k < c.width; ++k)
+        c.cur[k] = IR_NONE;
+    uint32_t* args = &l->cur[l->m->max_locals + l->sp - nr_args];
+    for (size_t k = 0, slot = 0; k < nr_args; ++k) {
+        store(&c, slot, args[k]);
+        slot += (f->insns[args[k]].type == L || f->insns[args[k]].type == D ? 2 : 1);
+    }
+
+    Insn_t* ret = &callee->insns[callee->nr_insns - 1];
+    for (Insn_t* i = callee->insns; i < ret; ++i)
+        if (!lift_insn(&c, i) || c.failed) {
+            // calls inlined behind a check moved the successors of start along
+            if (c.block != start)
+                move_succs(f, c.block, start);
+            for (size_t b = nr_blocks; b < f->nr_blocks; ++b) {
+                free(f->blocks[b].insns);
+                free(f->blocks[b].preds);
+            }
+            f->nr_blocks = nr_blocks;
+            f->nr_insns = nr_insns;
+            f->nr_args = nr_ir_args;
+            // nothing kept relies on what the callee assumed
+            f->nr_assumed = nr_assumed;
+            f->blocks[0].nr_insns = in_entry;
+            f->blocks[l->block].nr_insns = in_block;
+            r->size = at + 1;
+            r->list[at].why = "cannot lift";
+            r->list[at].uses = callee->code[i->pc];
+            free(c.cur);
+            return 0;
+        }
+    uint32_t result = (callee->code[ret->pc] != RETURN ? pop(&c) : IR_NONE);
+    free(c.cur);
+
+    if (guarded) {
+        // from: branch to slow if overridden, else fall through to start, slow: the virtual call, join: the rest of the caller
+        uint32_t from = l->block, slow = ir_new_block(f), join = ir_new_block(f);
+        move_succs(f, from, join);
+        uint32_t check = ir_new_insn(f, from, IR_OVERRIDDEN, I, 0);
+        f->insns[check].insn = insn;
+        f->insns[check].method = l->m;
+        uint32_t branch = ir_new_insn(f, from, IR_BRANCH, IR_VOID, 2);
+        f->insns[branch].cond = IR_NE;
+        f->args[f->insns[branch].args] = check;
+        f->args[f->insns[branch].args + 1] = konst(l, I, 0);
+        ir_add_edge(f, from, slow);
+        ir_add_edge(f, from, start);
+
+        uint32_t call = ir_new_insn(f, slow, IR_CALL, ret_type, nr_args);
+        f->insns[call].insn = insn;
+        f->insns[call].method = l->m;
+        for (size_t k = 0; k < nr_args; ++k)
+            f->args[f->insns[call].args + k] = args[k];
+        ir_new_insn(f, slow, IR_JUMP, IR_VOID, 0);
+        ir_add_edge(f, slow, join);
+        ir_new_insn(f, c.block, IR_JUMP, IR_VOID, 0);
+        ir_add_edge(f, c.block, join);
+        if (result != IR_NONE) {
+            uint32_t phi = ir_new_insn(f, join, IR_PHI, ret_type, 2);
+            f->args[f->insns[phi].args] = call;
+            f->args[f->insns[phi].args + 1] = result;
+            result = phi;
+        }
+        assume(f, callee);
+        c.block = join;
+    }
+    l->block = c.block;
+    l->sp -= nr_args;
+    if (result != IR_NONE)
+        push(l, result);
+    return 1;
+}
+
+static int lift_block(Lift_t* l, uint32_t b)
+{
+    IrFunc_t* f = l->f;
+    Method_t* m = l->m;
+    IrBlock_t* block = &f->blocks[b];
+    size_t i = l->first[b];
+    l->block = b;
+    l->sp = m->stack_depth[i];
+
+    if (block->nr_preds == 1) {
+        uint32_t* from = l->exit[block->preds[0]];
+        if (from == NULL)
+            panicf("predecessor of block %u not lifted", b);
+        memcpy(l->cur, from, sizeof(l->cur[0]) * l->width);
+    } else {
+        uint8_t const* types = local_types_at(m, &m->insns[i]);
+        for (size_t k = 0; k < l->width; ++k) {
+            int live = (k < m->max_locals ? types[k] != T_TOP : k - m->max_locals < l->sp);
+            l->cur[k] = (live ? ir_new_insn(f, b, IR_PHI, types[k], block->nr_preds) : IR_NONE);
+        }
+    }
+
+    for (;; ++i) {
+        Insn_t* insn = &m->insns[i];
+        if (!lift_insn(l, insn) || l->failed) {
+            debugf("opt: cannot compile %s.%s: %s\n", m->c->name, m->name, get_string(m->code[insn->pc]));
+            return 0;
+        }
+        enum opcode op = m->code[insn->pc];
+        if (ends_block(op))
+            break;
+        if (l->block_at[i + 1] != IR_NONE) {
+            ir_new_insn(f, l->block, IR_JUMP, IR_VOID, 0);
+            break;
+        }
+    }
+
+    // inlining may have moved the end of b to a block of its own
+    if (l->nr_exit < f->nr_blocks) {
+        l->exit = realloc(l->exit, sizeof(l->exit[0]) * f->nr_blocks);
+        memset(&l->exit[l->nr_exit], 0, sizeof(l->exit[0]) * (f->nr_blocks - l->nr_exit));
+        l->nr_exit = f->nr_blocks;
+    }
+    l->exit[l->block] = malloc(sizeof(l->cur[0]) * l->width);
+    memcpy(l->exit[l->block], l->cur, sizeof(l->cur[0]) * l->width);
+    return 1;
+}
+
+IrFunc_t* ir_build(Method_t* m, Insn_t const* entry)
+{
+    size_t start = (entry == NULL ? 0 : (size_t)(entry - m->insns));
+    if (m->stack_depth[start] != 0)
+        return NULL;
+
+    IrFunc_t* f = calloc(1, sizeof(*f));
+    f->m = m;
+    Report_t report = { 0 };
+    Lift_t l = { .f = f, .m = m, .width = m->max_locals + m->max_stack, .report = &report };
+
+    // blocks start at the first instruction, branch targets and after anything ending a block
+    l.block_at = malloc(sizeof(l.block_at[0]) * (m->nr_insns + 1));
+    uint8_t* leader = calloc(m->nr_insns + 1, 1);
+    leader[0] = 1;
+    for (size_t i = 0; i < m->nr_insns; ++i) {
+        if (m->stack_depth[i] == DEPTH_UNREACHED)
+            continue;
+        enum opcode op = m->code[m->insns[i].pc];
+        if (op >= IFEQ && op <= GOTO)
+            leader[m->insns[i].target - m->insns] = 1;
+        if (ends_block(op))
+            leader[i + 1] = 1;
+    }
+
+    ir_new_block(f);
+    for (size_t i = 0; i <= m->nr_insns; ++i) {
+        l.block_at[i] = IR_NONE;
+        if (i < m->nr_insns && leader[i] && m->stack_depth[i] != DEPTH_UNREACHED) {
+            l.block_at[i] = ir_new_block(f);
+            l.first = realloc(l.first, sizeof(l.first[0]) * f->nr_blocks);
+            l.first[l.block_at[i]] = i;
+        }
+    }
+    free(leader);
+
+    ir_add_edge(f, 0, l.block_at[start]);
+    for (uint32_t b = 1; b < f->nr_blocks; ++b) {
+        size_t i = l.first[b];
+        while (!ends_block(m->code[m->insns[i].pc]) && l.block_at[i + 1] == IR_NONE)
+            i++;
+        enum opcode op = m->code[m->insns[i].pc];
+        if (op >= IFEQ && op <= GOTO)
+            ir_add_edge(f, b, l.block_at[m->insns[i].target - m->insns]);
+        if (op != GOTO && !(op >= IRETURN && op <= RETURN))
+            ir_add_edge(f, b, l.block_at[i + 1]);
+    }
+    // a conditional branch to the next instruction
+    for (uint32_t b = 1; b < f->nr_blocks; ++b)
+        if (f->blocks[b].nr_succs == 2 && f->blocks[b].succs[0] == f->blocks[b].succs[1]) {
+            free(l.block_at);
+            free(l.first);
+            ir_free(f);
+            return NULL;
+        }
+
+    l.nr_exit = f->nr_blocks;
+    l.exit = calloc(l.nr_exit, sizeof(l.exit[0]));
+    l.cur = malloc(sizeof(l.cur[0]) * l.width);
+    for (size_t k = 0; k < l.width; ++k)
+        l.cur[k] = IR_NONE;
+    if (entry == NULL)
+        for (size_t i = 0, slot = 0; i < m->sig.nr_args; ++i) {
+            uint8_t type = (m->sig.arg_types[i] == ARR ? A : m->sig.arg_types[i]);
+            uint32_t v = ir_new_insn(f, 0, IR_PARAM, type, 0);
+            f->insns[v].imm = slot;
+            l.cur[slot] = v;
+            slot += (type == L || type == D ? 2 : 1);
+        }
+    else {
+        // every local live at the loop header comes from the interpreter's frame
+        uint8_t const* types = local_types_at(m, entry);
+        for (size_t slot = 0; slot < m->max_locals; ++slot) {
+            if (types[slot] == T_TOP)
+                continue;
+            uint32_t v = ir_new_insn(f, 0, IR_PARAM, types[slot] == ARR ? A : types[slot], 0);
+            f->insns[v].imm = slot;
+            l.cur[slot] = v;
+        }
+    }
+    l.exit[0] = malloc(sizeof(l.cur[0]) * l.width);
+    memcpy(l.exit[0], l.cur, sizeof(l.cur[0]) * l.width);
+
+    ir_compute_order(f);
+    int ok = 1;
+    size_t nr_lifted = f->nr_blocks;
+    for (size_t k = 1; k < f->nr_order && ok; ++k)
+        ok = lift_block(&l, f->order[k]);
+
+    // phi arguments, now that every predecessor has its final state
+    for (uint32_t b = 1; b < nr_lifted && ok; ++b) {
+        IrBlock_t* block = &f->blocks[b];
+        if (block->dead || block->nr_preds < 2)
+            continue;
+        // phis were created in slot order, for the slots live on entry
+        uint8_t const* types = local_types_at(m, &m->insns[l.first[b]]);
+        size_t depth = m->stack_depth[l.first[b]];
+        size_t n = 0;
+        for (size_t k = 0; k < l.width; ++k) {
+            int live = (k < m->max_locals ? types[k] != T_TOP : k - m->max_locals < depth);
+            if (!live)
+                continue;
+            IrInsn_t* phi = &f->insns[block->insns[n++]];
+            for (size_t p = 0; p < block->nr_preds; ++p) {
+                uint32_t v = l.exit[block->preds[p]][k];
+                if (v == IR_NONE) {
+                    debugf("opt: cannot compile %s.%s: undefined slot %lu\n", m->c->name, m->name, k);
+                    ok = 0;
+                }
+                f->args[phi->args + p] = v;
+            }
+        }
+    }
+    ir_new_insn(f, 0, IR_JUMP, IR_VOID, 0);
+
+    if (ok && report.size > 0) {
+        debugf("opt: inlining into %s.%s%s\n", m->c->name, m->name, m->desc);
+        for (size_t k = 0; k < report.size; ++k) {
+            Inlining_t const* in = &report.list[k];
+            debugf("%*s@%u %s.%s%s (%lu bytes): %s", 2 + 2 * in->depth, "", in->pc, in->callee->c->name, in->callee->name, in->callee->desc, in->callee->code_length, in->why == NULL ? "inlined" : in->why);
+            if (in->uses >= 0)
+                debugf(" %s", get_string((enum opcode)in->uses));
+            debugf("\n");
+        }
+    }
+    free(report.list);
+
+    for (uint32_t b = 0; b < l.nr_exit; ++b)
+        free(l.exit[b]);
+    free(l.exit);
+    free(l.cur);
+    free(l.block_at);
+    free(l.first);
+    if (!ok) {
+        ir_free(f);
+        return NULL;
+    }
+    ir_compute_order(f);
+    return f;
+}
+
+void ir_free(IrFunc_t* f)
+{
+    for (size_t b = 0; b < f->nr_blocks; ++b) {
+        free(f->blocks[b].insns);
+        free(f->blocks[b].preds);
+    }
+    free(f->blocks);
+    free(f->insns);
+    free(f->args);
+    free(f->order);
+    free(f->locs);
+    free(f->assumed);
+    free(f);
+}
+
+static char const* const op_names[] = {
+    [IR_CONST] = "const",
+    [IR_PARAM] = "param",
+    [IR_PHI] = "phi",
+    [IR_COPY] = "copy",
+    [IR_ADD] = "add",
+    [IR_SUB] = "sub",
+    [IR_MUL] = "mul",
+    [IR_DIV] = "div",
+    [IR_REM] = "rem",
+    [IR_AND] = "and",
+    [IR_OR] = "or",
+    [IR_XOR] = "xor",
+    [IR_SHL] = "shl",
+    [IR_SHR] = "shr",
+    [IR_USHR] = "ushr",
+    [IR_NEG] = "neg",
+    [IR_CONV] = "conv",
+    [IR_CMP] = "cmp",
+    [IR_GETSTATIC] = "getstatic",
+    [IR_PUTSTATIC] = "putstatic",
+    [IR_GETFIELD] = "getfield",
+    [IR_PUTFIELD] = "putfield",
+    [IR_NEW] = "new",
+    [IR_CALL] = "call",
+    [IR_OVERRIDDEN] = "overridden",
+    [IR_JUMP] = "jump",
+    [IR_BRANCH] = "branch",
+    [IR_RETURN] = "return",
+};
+static char const* const cond_names[] = { "eq", "ne", "lt", "ge", "gt", "le" };
+static char const type_names[] = { [I] = 'I', [F] = 'F', [A] = 'A', [L] = 'J', [D] = 'D' };
+
+void ir_print(IrFunc_t const* f)
+{
+    debugf("opt: IR of %s.%s%s\n", f->m->c->name, f->m->name, f->m->desc);
+    for (size_t k = 0; k < f->nr_order; ++k) {
+        uint32_t b = f->order[k];
+        IrBlock_t const* block = &f->blocks[b];
+        debugf("  b%u (idom b%u, preds", b, block->idom);
+        for (size_t p = 0; p < block->nr_preds; ++p)
+            debugf(" b%u", block->preds[p]);
+        debugf("):\n");
+        for (size_t n = 0; n < block->nr_insns; ++n) {
+            uint32_t v = block->insns[n];
+            IrInsn_t const* insn = &f->insns[v];
+            if (insn->type != IR_VOID)
+                debugf("    v%u:%c = ", v, type_names[insn->type]);
+            else
+                debugf("    ");
+            debugf("%s", op_names[insn->op]);
+            if (insn->op == IR_BRANCH)
+                debugf(".%s", cond_names[insn->cond]);
+            for (size_t a = 0; a < insn->nr_args; ++a)
+                debugf(" v%u", ir_arg(f, insn, a));
+            if (insn->op == IR_CONST || insn->op == IR_PARAM || insn->op == IR_CONV || insn->op == IR_CMP)
+                debugf(" #%" PRId64, insn->imm);
+            if (insn->op >= IR_GETSTATIC && insn->op <= IR_OVERRIDDEN && insn->method != f->m)
+                debugf(" @%s.%s:%u%s", insn->method->c->name, insn->method->name, insn->insn->pc, insn->flags & IR_UNRESOLVED ? " (unresolved)" : "");
+            else if (insn->op >= IR_GETSTATIC && insn->op <= IR_OVERRIDDEN)
+                debugf(" @%u%s", insn->insn->pc, insn->flags & IR_UNRESOLVED ? " (unresolved)" : "");
+            if (insn->flags & IR_DIRECT)
+                debugf(" (direct)");
+            for (size_t s = 0; s < block->nr_succs && n + 1 == block->nr_insns; ++s)
+                debugf(" b%u", block->succs[s]);
+            if (f->locs != NULL && insn->op != IR_CONST && insn->type != IR_VOID) {
+                if (f->locs[v].reg >= 0)
+                    debugf("  [r%d]", f->locs[v].reg);
+                else if (f->locs[v].spill >= 0)
+                    debugf("  [spill %d]", f->locs[v].spill);
+            }
+            debugf("\n");
+        }
+    }
+}
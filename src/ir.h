@@ -0,0 +1,170 @@
+#ifndef IR_H
+#define IR_H
+
+#include "class.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * SSA form of a method for the optimizing compiler. Values are instructions,
+ * named by their index in IrFunc_t::insns, and every operand stack entry and
+ * local variable of the bytecode becomes one of them: loads, stores and stack
+ * shuffles disappear during construction, leaving only computations, memory
+ * accesses, calls and control flow. Phis sit at the start of their block and
+ * take one argument per predecessor, in the order of IrBlock_t::preds.
+ */
+enum IrOp {
+    IR_CONST, // imm, the bits of a float or double for F and D
+    IR_PARAM, // imm is the local variable slot of the incoming argument
+    IR_PHI,
+    IR_COPY, // left behind by the optimizer, gone before register allocation
+
+    // arithmetic on type, whose arguments have the same type except for shift counts
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_REM,
+    IR_AND,
+    IR_OR,
+    IR_XOR,
+    IR_SHL,
+    IR_SHR,
+    IR_USHR,
+    IR_NEG,
+    IR_CONV, // imm is the conversion opcode, I2L to I2S
+    IR_CMP, // LCMP, FCMPx or DCMPx with imm the result when either is NaN
+
+    // memory, insn is the bytecode instruction the access was lifted from
+    IR_GETSTATIC,
+    IR_PUTSTATIC, // value
+    IR_GETFIELD, // object
+    IR_PUTFIELD, // object, value
+    IR_NEW,
+    IR_CALL, // arguments including any receiver
+    IR_OVERRIDDEN, // 1 once a loaded class overrides the target of the INVOKEVIRTUAL insn, 0 before
+
+    // control flow, ending every block
+    IR_JUMP,
+    IR_BRANCH, // a, b, jumping to succs[0] if a cond b and to succs[1] otherwise
+    IR_RETURN, // with the return value as argument, if any
+};
+
+enum IrCond {
+    IR_EQ,
+    IR_NE,
+    IR_LT,
+    IR_GE,
+    IR_GT,
+    IR_LE,
+};
+
+// type of values that produce nothing
+#define IR_VOID 0xff
+// a value never defined, such as a local variable nothing was stored to
+#define IR_NONE ((uint32_t)-1)
+
+// insn was not quickened when the method was compiled, so must be resolved at run time
+#define IR_UNRESOLVED 0x1
+// an INVOKEVIRTUAL calling its target directly until a loaded class overrides it
+#define IR_DIRECT 0x2
+
+typedef struct {
+    uint8_t op; // enum IrOp
+    uint8_t type; // enum ValueType, or IR_VOID
+    uint8_t cond; // enum IrCond, of IR_BRANCH
+    uint8_t flags;
+    uint16_t nr_args;
+    uint32_t args; // index of the first argument in IrFunc_t::args
+    uint32_t block;
+    union {
+        int64_t imm;
+        struct {
+            Insn_t* insn;
+            Method_t* method; // insn belongs to
+        };
+    };
+} IrInsn_t;
+
+typedef struct {
+    uint32_t* insns; // phis first, control flow last
+    size_t nr_insns, cap_insns;
+    uint32_t* preds;
+    size_t nr_preds, cap_preds;
+    uint32_t succs[2];
+    uint8_t nr_succs;
+    uint8_t dead; // unreachable, left out of every pass
+
+    uint32_t idom; // immediate dominator, the entry block is its own
+    uint32_t rpo; // position in reverse postorder
+} IrBlock_t;
+
+// where register allocation put a value, for values that are not constants
+typedef struct {
+    int16_t reg; // or -1
+    int16_t spill; // spill slot, or -1
+} IrLoc_t;
+
+typedef struct {
+    Method_t* m;
+
+    IrInsn_t* insns;
+    size_t nr_insns, cap_insns;
+    uint32_t* args;
+    size_t nr_args, cap_args;
+    IrBlock_t* blocks; // the entry block first
+    size_t nr_blocks, cap_blocks;
+
+    uint32_t* order; // live blocks in reverse postorder
+    size_t nr_order;
+
+    IrLoc_t* locs;
+    size_t nr_spills;
+
+    // methods the code calls directly or inlined on the grounds that no loaded class overrides them
+    Method_t** assumed;
+    size_t nr_assumed, cap_assumed;
+} IrFunc_t;
+
+static inline uint32_t ir_arg(IrFunc_t const* f, IrInsn_t const* insn, size_t k)
+{
+    return f->args[insn->args + k];
+}
+static inline int ir_is_const(IrFunc_t const* f, uint32_t v)
+{
+    return f->insns[v].op == IR_CONST;
+}
+// register class of values of type: 0 for integers and references, 1 for floating point
+static inline int ir_class(uint8_t type)
+{
+    return (type == F || type == D);
+}
+
+/*
+ * Lift m into SSA form, NULL if it uses anything the optimizer does not
+ * handle. The code starts at entry, a loop header with an empty operand stack
+ * whose live locals become the parameters, or at the start of m for NULL.
+ * Small callees known at compile time are inlined, which debug output reports
+ * on call site by call site.
+ */
+IrFunc_t* ir_build(Method_t* m, Insn_t const* entry);
+void ir_free(IrFunc_t* f);
+void ir_print(IrFunc_t const* f);
+
+// constant folding, copy propagation, common subexpressions, scalar replacement of objects and dead code
+void ir_optimize(IrFunc_t* f);
+// split every edge from a block with several successors to one with several predecessors
+void ir_split_critical_edges(IrFunc_t* f);
+
+// CFG maintenance shared by the passes
+uint32_t ir_new_insn(IrFunc_t* f, uint32_t block, uint8_t op, uint8_t type, size_t nr_args);
+uint32_t ir_new_block(IrFunc_t* f);
+void ir_add_edge(IrFunc_t* f, uint32_t from, uint32_t to);
+void ir_remove_edge(IrFunc_t* f, uint32_t from, uint32_t to);
+// recompute order, rpo and idom and mark blocks no longer reachable as dead
+void ir_compute_order(IrFunc_t* f);
+// a value with no effect beyond its result
+int ir_is_pure(IrInsn_t const* insn);
+
+#endif // IR_H
@@ -0,0 +1,741 @@
+#include "ir.h"
+#include "class.h"
+#include "jmath.h"
+#include "opcode.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_ROUNDS 8
+
+static uint32_t resolve(IrFunc_t const* f, uint32_t v)
+{
+    while (f->insns[v].op == IR_COPY)
+        v = ir_arg(f, &f->insns[v], 0);
+    return v;
+}
+static void resolve_args(IrFunc_t* f, IrInsn_t const* insn)
+{
+    for (size_t k = 0; k < insn->nr_args; ++k)
+        f->args[insn->args + k] = resolve(f, f->args[insn->args + k]);
+}
+
+static void unlink_insn(IrFunc_t* f, uint32_t v)
+{
+    IrBlock_t* b = &f->blocks[f->insns[v].block];
+    for (size_t n = 0; n < b->nr_insns; ++n)
+        if (b->insns[n] == v) {
+            memmove(&b->insns[n], &b->insns[n + 1], sizeof(b->insns[0]) * (b->nr_insns - n - 1));
+            b->nr_insns--;
+            return;
+        }
+}
+// make every use of v a use of by, v leaving its block for good
+static void replace(IrFunc_t* f, uint32_t v, uint32_t by)
+{
+    unlink_insn(f, v);
+    IrInsn_t* insn = &f->insns[v];
+    if (insn->nr_args == 0) {
+        if (f->nr_args == f->cap_args) {
+            f->cap_args *= 2;
+            f->args = realloc(f->args, sizeof(f->args[0]) * f->cap_args);
+        }
+        insn->args = f->nr_args++;
+    }
+    insn->op = IR_COPY;
+    insn->nr_args = 1;
+    f->args[insn->args] = by;
+}
+static void make_const(IrFunc_t* f, uint32_t v, int64_t imm)
+{
+    IrInsn_t* insn = &f->insns[v];
+    insn->op = IR_CONST;
+    insn->nr_args = 0;
+    insn->imm = imm;
+}
+
+static float as_float(int64_t imm)
+{
+    uint32_t bits = imm;
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+static double as_double(int64_t imm)
+{
+    double v;
+    memcpy(&v, &imm, sizeof(v));
+    return v;
+}
+static int64_t float_bits(float v)
+{
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+static int64_t double_bits(double v)
+{
+    int64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+// imm for op applied to constants a and b (b unused by unary ops), 0 if it cannot be folded
+static int fold_value(IrInsn_t const* insn, IrInsn_t const* a, IrInsn_t const* b, int64_t* imm)
+{
+    int64_t x = a->imm, y = (b != NULL ? b->imm : 0);
+    switch (insn->op) {
+    case IR_CONV:
+        switch (insn->imm) {
+        case I2L:
+            *imm = (int32_t)x;
+            return 1;
+        case L2I:
+            *imm = (int32_t)x;
+            return 1;
+        case I2B:
+            *imm = (int8_t)x;
+            return 1;
+        case I2C:
+            *imm = (uint16_t)x;
+            return 1;
+        case I2S:
+            *imm = (int16_t)x;
+            return 1;
+        case I2F:
+            *imm = float_bits((int32_t)x);
+            return 1;
+        case I2D:
+            *imm = double_bits((int32_t)x);
+            return 1;
+        case L2F:
+            *imm = float_bits(x);
+            return 1;
+        case L2D:
+            *imm = double_bits(x);
+            return 1;
+        case F2D:
+            *imm = double_bits(as_float(x));
+            return 1;
+        case D2F:
+            *imm = float_bits(as_double(x));
+            return 1;
+        case F2I:
+            *imm = java_d2i(as_float(x));
+            return 1;
+        case F2L:
+            *imm = java_d2l(as_float(x));
+            return 1;
+        case D2I:
+            *imm = java_d2i(as_double(x));
+            return 1;
+        case D2L:
+            *imm = java_d2l(as_double(x));
+            return 1;
+        default:
+            return 0;
+        }
+    case IR_CMP:
+        if (a->type == L)
+            *imm = (x > y) - (x < y);
+        else {
+            double p = (a->type == F ? as_float(x) : as_double(x));
+            double q = (a->type == F ? as_float(y) : as_double(y));
+            *imm = (p > q ? 1 : p < q ? -1 : p == q ? 0 : insn->imm);
+        }
+        return 1;
+    default:
+        break;
+    }
+
+    // single precision arithmetic must round as it would at run time
+    if (insn->type == F) {
+        float p = as_float(x), q = as_float(y), r;
+        switch (insn->op) {
+        case IR_ADD:
+            r = p + q;
+            break;
+        case IR_SUB:
+            r = p - q;
+            break;
+        case IR_MUL:
+            r = p * q;
+            break;
+        case IR_DIV:
+            r = p / q;
+            break;
+        case IR_NEG:
+            r = -p;
+            break;
+        default:
+            return 0;
+        }
+        *imm = float_bits(r);
+        return 1;
+    }
+    if (insn->type == D) {
+        double p = as_double(x), q = as_double(y), r;
+        switch (insn->op) {
+        case IR_ADD:
+            r = p + q;
+            break;
+        case IR_SUB:
+            r = p - q;
+            break;
+        case IR_MUL:
+            r = p * q;
+            break;
+        case IR_DIV:
+            r = p / q;
+            break;
+        case IR_NEG:
+            r = -p;
+            break;
+        default:
+            return 0;
+        }
+        *imm = double_bits(r);
+        return 1;
+    }
+
+    int wide = (insn->type == L);
+    uint64_t u = x, v = y;
+    uint64_t r;
+    switch (insn->op) {
+    case IR_ADD:
+        r = u + v;
+        break;
+    case IR_SUB:
+        r = u - v;
+        break;
+    case IR_MUL:
+        r = u * v;
+        break;
+    case IR_DIV:
+    case IR_REM:
+        if (y == 0)
+            return 0;
+        if (wide)
+            r = (insn->op == IR_DIV ? java_ldiv(x, y) : java_lrem(x, y));
+        else
+            r = (insn->op == IR_DIV ? java_idiv(x, y) : java_irem(x, y));
+        break;
+    case IR_AND:
+        r = u & v;
+        break;
+    case IR_OR:
+        r = u | v;
+        break;
+    case IR_XOR:
+        r = u ^ v;
+        break;
+    case IR_SHL:
+        r = u << (v & (wide ? 63 : 31));
+        break;
+    case IR_SHR:
+        r = (wide ? (uint64_t)(x >> (v & 63)) : (uint64_t)((int32_t)x >> (v & 31)));
+        break;
+    case IR_USHR:
+        r = (wide ? u >> (v & 63) : (uint32_t)u >> (v & 31));
+        break;
+    case IR_NEG:
+        r = -u;
+        break;
+    default:
+        return 0;
+    }
+    *imm = (wide ? (int64_t)r : (int32_t)r);
+    return 1;
+}
+
+static int is_const_value(IrFunc_t const* f, uint32_t v, int64_t imm)
+{
+    IrInsn_t const* insn = &f->insns[v];
+    return insn->op == IR_CONST && (insn->type == L ? insn->imm : (int32_t)insn->imm) == imm;
+}
+
+// the operand an integer operation reduces to, or IR_NONE
+static uint32_t identity(IrFunc_t* f, IrInsn_t const* insn, int* zero)
+{
+    *zero = 0;
+    if (insn->nr_args != 2 || (insn->type != I && insn->type != L))
+        return IR_NONE;
+    uint32_t a = ir_arg(f, insn, 0), b = ir_arg(f, insn, 1);
+    switch (insn->op) {
+    case IR_ADD:
+    case IR_OR:
+    case IR_XOR:
+        if (is_const_value(f, b, 0))
+            return a;
+        if (is_const_value(f, a, 0))
+            return b;
+        if (insn->op == IR_OR && a == b)
+            return a;
+        if (insn->op == IR_XOR && a == b)
+            *zero = 1;
+        return IR_NONE;
+    case IR_SUB:
+        if (is_const_value(f, b, 0))
+            return a;
+        if (a == b)
+            *zero = 1;
+        return IR_NONE;
+    case IR_MUL:
+        if (is_const_value(f, b, 1))
+            return a;
+        if (is_const_value(f, a, 1))
+            return b;
+        if (is_const_value(f, a, 0) || is_const_value(f, b, 0))
+            *zero = 1;
+        return IR_NONE;
+    case IR_AND:
+        if (is_const_value(f, b, -1) || a == b)
+            return a;
+        if (is_const_value(f, a, -1))
+            return b;
+        if (is_const_value(f, a, 0) || is_const_value(f, b, 0))
+            *zero = 1;
+        return IR_NONE;
+    case IR_SHL:
+    case IR_SHR:
+    case IR_USHR:
+        if (ir_is_const(f, b) && (f->insns[b].imm & (insn->type == L ? 63 : 31)) == 0)
+            return a;
+        return IR_NONE;
+    default:
+        return IR_NONE;
+    }
+}
+
+static int branch_taken(enum IrCond cond, int64_t x, int64_t y)
+{
+    switch (cond) {
+    case IR_EQ:
+        return x == y;
+    case IR_NE:
+        return x != y;
+    case IR_LT:
+        return x < y;
+    case IR_GE:
+        return x >= y;
+    case IR_GT:
+        return x > y;
+    default:
+        return x <= y;
+    }
+}
+
+// the value every argument of a phi but itself is, or IR_NONE
+static uint32_t trivial_phi(IrFunc_t const* f, uint32_t v)
+{
+    IrInsn_t const* phi = &f->insns[v];
+    uint32_t same = IR_NONE;
+    for (size_t k = 0; k < phi->nr_args; ++k) {
+        uint32_t a = resolve(f, ir_arg(f, phi, k));
+        if (a == v || a == same)
+            continue;
+        if (same != IR_NONE)
+            return IR_NONE;
+        same = a;
+    }
+    return same;
+}
+
+/*
+ * Constant folding, algebraic identities, trivial phis and branches on
+ * constants, in a single pass in reverse postorder. Sets *cfg_changed if an
+ * edge was removed.
+ */
+static int fold(IrFunc_t* f, int* cfg_changed)
+{
+    int changed = 0;
+    for (size_t k = 0; k < f->nr_order; ++k) {
+        IrBlock_t* block = &f->blocks[f->order[k]];
+        for (size_t n = 0; n < block->nr_insns; ++n) {
+            uint32_t v = block->insns[n];
+            IrInsn_t* insn = &f->insns[v];
+            resolve_args(f, insn);
+
+            if (insn->op == IR_PHI) {
+                uint32_t same = trivial_phi(f, v);
+                if (same != IR_NONE) {
+                    replace(f, v, same);
+                    n--;
+                    changed = 1;
+                }
+                continue;
+            }
+
+            if (insn->op == IR_BRANCH) {
+                uint32_t a = ir_arg(f, insn, 0), b = ir_arg(f, insn, 1);
+                int taken;
+                if (ir_is_const(f, a) && ir_is_const(f, b))
+                    taken = branch_taken(insn->cond, f->insns[a].imm, f->insns[b].imm);
+                else if (a == b)
+                    taken = branch_taken(insn->cond, 0, 0);
+                else
+                    continue;
+                uint32_t dead = block->succs[taken ? 1 : 0];
+                if (block->succs[0] != block->succs[1])
+                    ir_remove_edge(f, f->order[k], dead);
+                insn->op = IR_JUMP;
+                insn->nr_args = 0;
+                changed = *cfg_changed = 1;
+                continue;
+            }
+
+            if (insn->op < IR_ADD || insn->op > IR_CMP)
+                continue;
+            int all_const = 1;
+            for (size_t a = 0; a < insn->nr_args; ++a)
+                all_const &= ir_is_const(f, ir_arg(f, insn, a));
+            int64_t imm;
+            if (all_const && fold_value(insn, &f->insns[ir_arg(f, insn, 0)], insn->nr_args > 1 ? &f->insns[ir_arg(f, insn, 1)] : NULL, &imm)) {
+                make_const(f, v, imm);
+                changed = 1;
+                continue;
+            }
+            int zero;
+            uint32_t same = identity(f, insn, &zero);
+            if (same != IR_NONE) {
+                replace(f, v, same);
+                n--;
+                changed = 1;
+            } else if (zero) {
+                make_const(f, v, 0);
+                changed = 1;
+            }
+        }
+    }
+    return changed;
+}
+
+/*
+ * Common subexpression elimination over the dominator tree: a pure value
+ * is replaced by an equal one computed in a dominating position. Field and
+ * static loads are only reused within a block and up to the next store or
+ * call, and a field store makes the stored value available to later loads
+ * of the same field of the same object.
+ */
+typedef struct {
+    uint32_t v;
+    uint32_t epoch; // of loads, which only match within the same one
+    uint32_t forward; // value a load of v's field reads, for stores
+} Avail_t;
+
+typedef struct {
+    IrFunc_t* f;
+    uint32_t** children;
+    size_t* nr_children;
+    Avail_t* avail;
+    size_t nr_avail, cap_avail;
+    uint32_t epoch;
+    int changed;
+} Cse_t;
+
+static int is_load(IrInsn_t const* insn)
+{
+    return insn->op == IR_GETFIELD || insn->op == IR_GETSTATIC;
+}
+static int commutes(IrInsn_t const* insn)
+{
+    return insn->op == IR_ADD || insn->op == IR_MUL || insn->op == IR_AND || insn->op == IR_OR || insn->op == IR_XOR;
+}
+// the memory accessed, for loads and stores of the same field to be recognised
+static int same_field(IrInsn_t const* x, IrInsn_t const* y)
+{
+    int resolved = !(x->flags & IR_UNRESOLVED) && !(y->flags & IR_UNRESOLVED);
+    if (x->op == IR_GETFIELD || x->op == IR_PUTFIELD) {
+        if (resolved)
+            return x->insn->offset == y->insn->offset;
+    } else if (resolved)
+        return x->insn->field == y->insn->field;
+    return x->method->c == y->method->c && x->insn->index == y->insn->index;
+}
+static int same_value(IrFunc_t const* f, IrInsn_t const* x, IrInsn_t const* y)
+{
+    if (x->op != y->op || x->type != y->type || x->nr_args != y->nr_args)
+        return 0;
+    if (x->op == IR_CONST || x->op == IR_CONV || x->op == IR_CMP) {
+        if (x->imm != y->imm)
+            return 0;
+    } else if (is_load(x) && !same_field(x, y))
+        return 0;
+    if (x->nr_args == 2 && commutes(x) && ir_arg(f, x, 0) == ir_arg(f, y, 1) && ir_arg(f, x, 1) == ir_arg(f, y, 0))
+        return 1;
+    for (size_t k = 0; k < x->nr_args; ++k)
+        if (ir_arg(f, x, k) != ir_arg(f, y, k))
+            return 0;
+    return 1;
+}
+
+static void cse_add(Cse_t* c, uint32_t v, uint32_t forward)
+{
+    if (c->nr_avail == c->cap_avail) {
+        c->cap_avail = (c->cap_avail == 0 ? 64 : 2 * c->cap_avail);
+        c->avail = realloc(c->avail, sizeof(c->avail[0]) * c->cap_avail);
+    }
+    c->avail[c->nr_avail++] = (Avail_t) { .v = v, .epoch = c->epoch, .forward = forward };
+}
+
+static void cse_block(Cse_t* c, uint32_t b)
+{
+    IrFunc_t* f = c->f;
+    size_t mark = c->nr_avail;
+    c->epoch++;
+
+    IrBlock_t* block = &f->blocks[b];
+    for (size_t n = 0; n < block->nr_insns; ++n) {
+        uint32_t v = block->insns[n];
+        IrInsn_t* insn = &f->insns[v];
+        resolve_args(f, insn);
+
+        if (insn->op == IR_PUTFIELD || insn->op == IR_PUTSTATIC || insn->op == IR_CALL) {
+            c->epoch++;
+            if (insn->op != IR_CALL)
+                cse_add(c, v, ir_arg(f, insn, insn->nr_args - 1));
+            continue;
+        }
+        if (!ir_is_pure(insn) || insn->op == IR_PHI || insn->op == IR_PARAM)
+            continue;
+
+        uint32_t found = IR_NONE;
+        for (size_t k = c->nr_avail; k-- > 0 && found == IR_NONE;) {
+            Avail_t const* a = &c->avail[k];
+            IrInsn_t const* other = &f->insns[a->v];
+            if (is_load(insn) && a->epoch != c->epoch)
+                continue;
+            if (is_load(insn) && (other->op == IR_PUTFIELD || other->op == IR_PUTSTATIC)) {
+                int same_object = (insn->op == IR_GETSTATIC || ir_arg(f, insn, 0) == ir_arg(f, other, 0));
+                if ((insn->op == IR_GETFIELD) == (other->op == IR_PUTFIELD) && same_object && same_field(insn, other) && f->insns[a->forward].type == insn->type)
+                    found = a->forward;
+            } else if (same_value(f, insn, other))
+                found = a->v;
+        }
+        if (found != IR_NONE) {
+            replace(f, v, found);
+            n--;
+            c->changed = 1;
+        } else
+            cse_add(c, v, IR_NONE);
+    }
+
+    for (size_t k = 0; k < c->nr_children[b]; ++k)
+        cse_block(c, c->children[b][k]);
+    c->nr_avail = mark;
+}
+
+static int cse(IrFunc_t* f)
+{
+    Cse_t c = { .f = f };
+    c.children = calloc(f->nr_blocks, sizeof(c.children[0]));
+    c.nr_children = calloc(f->nr_blocks, sizeof(c.nr_children[0]));
+    for (size_t k = 1; k < f->nr_order; ++k) {
+        uint32_t b = f->order[k], idom = f->blocks[b].idom;
+        c.children[idom] = realloc(c.children[idom], sizeof(c.children[0][0]) * (c.nr_children[idom] + 1));
+        c.children[idom][c.nr_children[idom]++] = b;
+    }
+    cse_block(&c, 0);
+    for (size_t b = 0; b < f->nr_blocks; ++b)
+        free(c.children[b]);
+    free(c.children);
+    free(c.nr_children);
+    free(c.avail);
+    return c.changed;
+}
+
+// whether the object v allocates is used other than through its fields, or written to outside its own block
+static int escapes(IrFunc_t const* f, uint32_t v)
+{
+    for (size_t k = 0; k < f->nr_order; ++k) {
+        IrBlock_t const* block = &f->blocks[f->order[k]];
+        for (size_t n = 0; n < block->nr_insns; ++n) {
+            IrInsn_t const* insn = &f->insns[block->insns[n]];
+            for (size_t a = 0; a < insn->nr_args; ++a) {
+                if (resolve(f, ir_arg(f, insn, a)) != v)
+                    continue;
+                if (insn->flags & IR_UNRESOLVED)
+                    return 1;
+                if (insn->op == IR_GETFIELD)
+                    continue;
+                if (insn->op == IR_PUTFIELD && a == 0 && insn->block == f->insns[v].block && resolve(f, ir_arg(f, insn, 1)) != v)
+                    continue;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    size_t offset;
+    uint32_t v; // held in the field
+} FieldValue_t;
+
+static FieldValue_t* field_value(FieldValue_t* fields, size_t nr, size_t offset)
+{
+    for (size_t k = 0; k < nr; ++k)
+        if (fields[k].offset == offset)
+            return &fields[k];
+    return NULL;
+}
+static void load_from(IrFunc_t* f, uint32_t load, FieldValue_t* fields, size_t nr)
+{
+    FieldValue_t const* field = field_value(fields, nr, f->insns[load].insn->offset);
+    if (field != NULL)
+        replace(f, load, field->v);
+    else
+        make_const(f, load, 0);
+}
+
+/*
+ * Scalar replacement of objects that do not escape the code: an object only
+ * read and written through its fields, and written only in the block it is
+ * allocated in, is never allocated. Its fields become the values stored to
+ * them, or zero before the first store, so loads from them become copies.
+ * Replacing an object can leave those it referred to without escaping.
+ */
+static int scalar_replace(IrFunc_t* f)
+{
+    int changed = 0;
+    FieldValue_t* fields = NULL;
+    size_t cap_fields = 0;
+    for (size_t k = 0; k < f->nr_order; ++k) {
+        IrBlock_t* block = &f->blocks[f->order[k]];
+        for (size_t n = 0; n < block->nr_insns; ++n) {
+            uint32_t v = block->insns[n];
+            if (f->insns[v].op != IR_NEW || (f->insns[v].flags & IR_UNRESOLVED) || escapes(f, v))
+                continue;
+
+            // loads in the block see the stores before them, loads elsewhere all of them
+            size_t nr_fields = 0;
+            for (size_t i = n + 1; i < block->nr_insns;) {
+                uint32_t u = block->insns[i];
+                IrInsn_t* insn = &f->insns[u];
+                if (insn->op == IR_GETFIELD && resolve(f, ir_arg(f, insn, 0)) == v) {
+                    load_from(f, u, fields, nr_fields);
+                    if (f->insns[u].op == IR_COPY)
+                        continue; // left the block
+                } else if (insn->op == IR_PUTFIELD && resolve(f, ir_arg(f, insn, 0)) == v) {
+                    FieldValue_t* field = field_value(fields, nr_fields, insn->insn->offset);
+                    if (field == NULL) {
+                        if (nr_fields == cap_fields) {
+                            cap_fields = (cap_fields == 0 ? 8 : 2 * cap_fields);
+                            fields = realloc(fields, sizeof(fields[0]) * cap_fields);
+                        }
+                        field = &fields[nr_fields++];
+                        field->offset = insn->insn->offset;
+                    }
+                    field->v = resolve(f, ir_arg(f, insn, 1));
+                    unlink_insn(f, u);
+                    continue;
+                }
+                i++;
+            }
+            for (size_t j = 0; j < f->nr_order; ++j) {
+                IrBlock_t const* other = &f->blocks[f->order[j]];
+                for (size_t i = 0; i < other->nr_insns;) {
+                    uint32_t u = other->insns[i];
+                    if (f->insns[u].op == IR_GETFIELD && resolve(f, ir_arg(f, &f->insns[u], 0)) == v)
+                        load_from(f, u, fields, nr_fields);
+                    else
+                        i++;
+                }
+            }
+            IrInsn_t const* alloc = &f->insns[v];
+            debugf("opt: %s.%s: new %s at %s.%s:%u replaced by its fields\n", f->m->c->name, f->m->name, alloc->insn->class->name, alloc->method->c->name, alloc->method->name, alloc->insn->pc);
+            unlink_insn(f, v);
+            n--;
+            changed = 1;
+        }
+    }
+    free(fields);
+    return changed;
+}
+
+// drop every pure value nothing uses
+static void dce(IrFunc_t* f)
+{
+    uint8_t* live = calloc(f->nr_insns, 1);
+    uint32_t* work = malloc(sizeof(work[0]) * f->nr_insns);
+    size_t nr_work = 0;
+    for (size_t k = 0; k < f->nr_order; ++k) {
+        IrBlock_t const* block = &f->blocks[f->order[k]];
+        for (size_t n = 0; n < block->nr_insns; ++n)
+            if (!ir_is_pure(&f->insns[block->insns[n]])) {
+                live[block->insns[n]] = 1;
+                work[nr_work++] = block->insns[n];
+            }
+    }
+    while (nr_work > 0) {
+        IrInsn_t* insn = &f->insns[work[--nr_work]];
+        resolve_args(f, insn);
+        for (size_t a = 0; a < insn->nr_args; ++a) {
+            uint32_t v = ir_arg(f, insn, a);
+            if (!live[v]) {
+                live[v] = 1;
+                work[nr_work++] = v;
+            }
+        }
+    }
+    for (size_t k = 0; k < f->nr_order; ++k) {
+        IrBlock_t* block = &f->blocks[f->order[k]];
+        size_t kept = 0;
+        for (size_t n = 0; n < block->nr_insns; ++n)
+            if (live[block->insns[n]])
+                block->insns[kept++] = block->insns[n];
+        block->nr_insns = kept;
+    }
+    free(work);
+    free(live);
+}
+
+void ir_optimize(IrFunc_t* f)
+{
+    ir_compute_order(f);
+    for (int round = 0, changed = 1; changed && round < MAX_ROUNDS; ++round) {
+        int cfg_changed = 0;
+        changed = fold(f, &cfg_changed);
+        if (cfg_changed)
+            ir_compute_order(f);
+        changed |= cse(f);
+        changed |= scalar_replace(f);
+    }
+    // the code generator only places phi moves on jumps, so no phi may be left in a block reached by a branch
+    for (size_t k = 0; k < f->nr_order; ++k) {
+        IrBlock_t* block = &f->blocks[f->order[k]];
+        while (block->nr_preds == 1 && block->nr_insns > 0 && f->insns[block->insns[0]].op == IR_PHI)
+            replace(f, block->insns[0], resolve(f, ir_arg(f, &f->insns[block->insns[0]], 0)));
+    }
+    dce(f);
+}
+
+void ir_split_critical_edges(IrFunc_t* f)
+{
+    size_t nr_blocks = f->nr_blocks;
+    for (uint32_t b = 0; b < nr_blocks; ++b) {
+        if (f->blocks[b].dead || f->blocks[b].nr_succs < 2)
+            continue;
+        for (size_t k = 0; k < f->blocks[b].nr_succs; ++k) {
+            uint32_t to = f->blocks[b].succs[k];
+            if (f->blocks[to].nr_preds < 2)
+                continue;
+            uint32_t mid = ir_new_block(f);
+            ir_new_insn(f, mid, IR_JUMP, IR_VOID, 0);
+            // mid takes b's place among to's predecessors, which keeps the phi arguments in order
+            f->blocks[b].succs[k] = mid;
+            IrBlock_t* target = &f->blocks[to];
+            for (size_t p = 0; p < target->nr_preds; ++p)
+                if (target->preds[p] == b)
+                    target->preds[p] = mid;
+            IrBlock_t* m = &f->blocks[mid];
+            m->preds = malloc(sizeof(m->preds[0]));
+            m->preds[0] = b;
+            m->nr_preds = m->cap_preds = 1;
+            m->succs[0] = to;
+            m->nr_succs = 1;
+        }
+    }
+    ir_compute_order(f);
+}
@@ -0,0 +1,52 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "class.h"
+
+#include <stdint.h>
+
+/*
+ * Compilers built into the VM by `make ARCH=<arch>` (e.g. `make x86-64`) from
+ * src/arch/<arch>. The optimizing compiler lifts a method into SSA form (see
+ * ir.h), optimizes it and allocates registers. The baseline compiler
+ * translates every instruction on its own by a fixed template, and methods
+ * using anything without a template are left to the interpreter.
+ *
+ * Methods move up a tier as they get hot: call_method() counts invocations
+ * and exec() counts the back edges of every loop, see tier.c. Optimized code
+ * whose assumptions a newly loaded class breaks (see cha.h) goes back down to
+ * be compiled again.
+ */
+#ifdef JIT
+
+enum Tier {
+    TIER_INTERPRETER,
+    TIER_BASELINE,
+    TIER_OPT,
+};
+
+extern int jit_enabled;
+extern int opt_enabled;
+// invocations before a method is compiled by either compiler, and taken back edges before a loop is
+extern uint32_t jit_threshold, opt_threshold, osr_threshold;
+
+// compile m into m->jit.code, returning 0 (and marking m as failed) if it cannot be compiled
+int jit_compile(Method_t* m);
+// compile m into m->jit.code with the optimizing compiler, returning 0 if it cannot be
+int opt_compile(Method_t* m);
+// compile the rest of m from the loop header on into *out, to be entered with the locals of a frame there
+int opt_compile_osr(Method_t* m, Insn_t const* header, JitCode_t* out);
+void jit_free(Method_t const* m);
+
+// count an invocation of m, compiling it when it gets hot enough
+void tier_up(Method_t* m);
+// the code to continue m in from the loop header branch jumps back to, if the loop got hot and could be compiled
+Slot_t (*osr_entry(Method_t* m, Insn_t const* branch))(Slot_t* locals, struct Frame* frame);
+// have the optimized code of m, or of its loop if not -1, compiled again once it gets hot again
+void tier_invalidate(Method_t* m, int loop);
+// keep code until m is freed, as frames may still be running it, and clear *code
+void jit_retire(Method_t* m, JitCode_t* code);
+
+#endif
+
+#endif // JIT_H
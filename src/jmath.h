@@ -0,0 +1,56 @@
+#ifndef JMATH_H
+#define JMATH_H
+
+#include "util.h"
+
+#include <stdint.h>
+
+// Java semantics for the arithmetic C leaves undefined or implementation defined
+
+static inline int32_t java_idiv(int32_t a, int32_t b)
+{
+    if (b == 0)
+        errorf("java/lang/ArithmeticException: / by zero");
+    return (b == -1 ? (int32_t)-(uint32_t)a : a / b);
+}
+static inline int32_t java_irem(int32_t a, int32_t b)
+{
+    if (b == 0)
+        errorf("java/lang/ArithmeticException: / by zero");
+    return (b == -1 ? 0 : a % b);
+}
+static inline int64_t java_ldiv(int64_t a, int64_t b)
+{
+    if (b == 0)
+        errorf("java/lang/ArithmeticException: / by zero");
+    return (b == -1 ? (int64_t)-(uint64_t)a : a / b);
+}
+static inline int64_t java_lrem(int64_t a, int64_t b)
+{
+    if (b == 0)
+        errorf("java/lang/ArithmeticException: / by zero");
+    return (b == -1 ? 0 : a % b);
+}
+// floating point to integral conversions saturate and map NaN to 0
+static inline int32_t java_d2i(double d)
+{
+    if (d != d)
+        return 0;
+    if (d >= (double)INT32_MAX)
+        return INT32_MAX;
+    if (d <= (double)INT32_MIN)
+        return INT32_MIN;
+    return (int32_t)d;
+}
+static inline int64_t java_d2l(double d)
+{
+    if (d != d)
+        return 0;
+    if (d >= (double)INT64_MAX)
+        return INT64_MAX;
+    if (d <= (double)INT64_MIN)
+        return INT64_MIN;
+    return (int64_t)d;
+}
+
+#endif // JMATH_H
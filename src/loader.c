@@ -1,101 +1,108 @@
+#include "cha.h"
 #include "class.h"
+#include "gc.h"
+#include "jit.h"
 #include "loader.h"
 #include "native.h"
+#include "refmap.h"
+#include "superinsn.h"
+#include "symbol.h"
+#include "translate.h"
+#include "typeflow.h"
 #include "util.h"
 
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-static uint32_t u4_from_big_endian(uint32_t u)
-{
-    return ((u & 0xff) << 24 | (u & 0xff00) << 8 | (u & 0xff0000) >> 8 | (u & 0xff000000) >> 24);
-}
-
-static void* bytes(FILE* f, size_t sz, int is_str)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// bounds checked cursor over a class file mapped into memory
+typedef struct {
+    uint8_t const* p;
+    uint8_t const* end;
+} Reader_t;
+
+// the next size bytes, in place
+static uint8_t const* read_bytes(Reader_t* r, size_t size)
 {
-    void* buf = malloc(sz + (is_str ? 1 : 0));
-    if (fread(buf, 1, sz, f) != sz)
+    if ((size_t)(r->end - r->p) < size)
         errorf("unexpected eof");
-    if (is_str)
-        ((uint8_t*)buf)[sz] = '\0';
-    return buf;
+    uint8_t const* p = r->p;
+    r->p += size;
+    return p;
 }
-static uint32_t read_big_endian_u4(FILE* f)
+static uint32_t read_u4(Reader_t* r)
 {
-    uint32_t a;
-    if (fread(&a, sizeof(a), 1, f) != 1)
-        errorf("unexpected eof");
-    return u4_from_big_endian(a);
+    return u4_at(read_bytes(r, 4));
 }
-static uint16_t read_big_endian_u2(FILE* f)
+static uint16_t read_u2(Reader_t* r)
 {
-    uint16_t a;
-    if (fread(&a, sizeof(a), 1, f) != 1)
-        errorf("unexpected eof");
-    return u2_from_big_endian(a);
+    return u2_at(read_bytes(r, 2));
 }
-static uint8_t read_big_endian_u1(FILE* f)
+static uint8_t read_u1(Reader_t* r)
 {
-    uint8_t a;
-    if (fread(&a, sizeof(a), 1, f) != 1)
-        errorf("unexpected eof");
-    return a;
+    return *read_bytes(r, 1);
 }
 
-static Const_t* load_constant_pool(FILE* cf, size_t nr)
+static Const_t* load_constant_pool(Reader_t* r, size_t nr)
 {
     if (nr == 0)
         return NULL;
-    Const_t* list = malloc(sizeof(list[0]) * nr);
+    Const_t* list = arena_calloc(&class_metadata, nr, sizeof(list[0]));
     for (size_t i = 0; i < nr; ++i) {
         Const_t* c = &list[i];
-        c->tag = read_big_endian_u1(cf);
+        c->tag = read_u1(r);
+        c->resolved.class = NULL;
         switch (c->tag) {
         case CONST_UTF8: {
-            size_t l = read_big_endian_u2(cf);
-            c->utf8 = bytes(cf, l, 1);
+            size_t l = read_u2(r);
+            c->utf8 = intern_bytes((char const*)read_bytes(r, l), l);
         } break;
         case CONST_INT:
-            c->i = read_big_endian_u4(cf);
+            c->i = read_u4(r);
             break;
         case CONST_FLOAT: {
-            uint32_t i = read_big_endian_u4(cf);
-            c->f = *(float*)&i;
+            uint32_t i = read_u4(r);
+            memcpy(&c->f, &i, sizeof(c->f));
             break;
         } break;
         case CONST_LONG: {
-            uint32_t i1 = read_big_endian_u4(cf);
-            uint32_t i2 = read_big_endian_u4(cf);
+            uint32_t i1 = read_u4(r);
+            uint32_t i2 = read_u4(r);
             c->l = (((uint64_t)i1) << 32 | i2);
             // skip entry in constant pool
-            ++i;
+            if (++i == nr)
+                errorf("constant pool ends in the middle of a long");
             list[i].tag = 0;
         } break;
         case CONST_DOUBLE: {
-            uint32_t i1 = read_big_endian_u4(cf);
-            uint32_t i2 = read_big_endian_u4(cf);
+            uint32_t i1 = read_u4(r);
+            uint32_t i2 = read_u4(r);
             uint64_t l = (((uint64_t)i1) << 32 | i2);
-            c->d = *(double*)&l;
+            memcpy(&c->d, &l, sizeof(c->d));
             // skip entry in constant pool
-            ++i;
+            if (++i == nr)
+                errorf("constant pool ends in the middle of a double");
             list[i].tag = 0;
         } break;
         case CONST_CLASS:
-            c->name_index = read_big_endian_u2(cf);
+            c->name_index = read_u2(r);
             break;
         case CONST_STRING:
-            c->string_index = read_big_endian_u2(cf);
+            c->string_index = read_u2(r);
             break;
         case CONST_FIELD:
         case CONST_METHOD:
-            c->class_index = read_big_endian_u2(cf);
-            c->name_and_type_index = read_big_endian_u2(cf);
+            c->class_index = read_u2(r);
+            c->name_and_type_index = read_u2(r);
             break;
         case CONST_NAME_AND_TYPE:
-            c->name_index = read_big_endian_u2(cf);
-            c->desc_index = read_big_endian_u2(cf);
+            c->name_index = read_u2(r);
+            c->desc_index = read_u2(r);
             break;
         default:
             errorf("unsupported constant pool tag: %d", c->tag);
@@ -104,13 +111,57 @@ static Const_t* load_constant_pool(FILE* cf, size_t nr)
     return list;
 }
 
-static char const** load_interfaces(FILE* cf, size_t nr, Const_t* constant_pool_list)
+// index i of a constant pool of nr entries, which must hold a constant tagged tag
+static void check_constant_index(Const_t const* list, size_t nr, size_t i, enum ConstType tag)
+{
+    if (i == 0 || i > nr || list[i - 1].tag != tag)
+        errorf("bad constant pool index %lu (expected tag 0x%x)", i, tag);
+}
+// so that resolving an entry never follows an index out of the pool or to the wrong kind of entry
+static void check_constant_pool(Const_t const* list, size_t nr)
+{
+    for (size_t i = 0; i < nr; ++i) {
+        Const_t const* c = &list[i];
+        switch (c->tag) {
+        case CONST_CLASS:
+            check_constant_index(list, nr, c->name_index, CONST_UTF8);
+            break;
+        case CONST_STRING:
+            check_constant_index(list, nr, c->string_index, CONST_UTF8);
+            break;
+        case CONST_FIELD:
+        case CONST_METHOD:
+            check_constant_index(list, nr, c->class_index, CONST_CLASS);
+            check_constant_index(list, nr, c->name_and_type_index, CONST_NAME_AND_TYPE);
+            break;
+        case CONST_NAME_AND_TYPE:
+            check_constant_index(list, nr, c->name_index, CONST_UTF8);
+            check_constant_index(list, nr, c->desc_index, CONST_UTF8);
+            break;
+        default:
+            break;
+        }
+    }
+}
+// the index of a constant tagged tag in the constant pool of c
+static size_t read_constant_index(Reader_t* r, Class_t const* c, enum ConstType tag)
+{
+    size_t i = read_u2(r);
+    check_constant_index(c->constant_pool.list, c->constant_pool.size, i, tag);
+    return i;
+}
+static char const* read_utf8(Reader_t* r, Class_t const* c)
+{
+    return resolve_utf8(c->constant_pool.list, read_constant_index(r, c, CONST_UTF8));
+}
+
+static char const** load_interfaces(Reader_t* r, size_t nr, Class_t const* c)
 {
     if (nr == 0)
         return NULL;
-    char const** list = malloc(sizeof(list[0]) * nr);
+    char const** list = arena_calloc(&class_metadata, nr, sizeof(list[0]));
     for (size_t i = 0; i < nr; ++i)
-        list[i] = resolve_utf8(constant_pool_list, read_big_endian_u2(cf));
+        list[i] = resolve_class_name(c->constant_pool.list, read_constant_index(r, c, CONST_CLASS));
     return list;
 }
 
@@ -118,151 +169,213 @@ enum AttrType {
     ATTR_CODE,
     ATTR_SOURCE_FILE,
 };
+// names of the attributes the loader looks for, interned by load_init()
+static struct {
+    char const* code;
+    char const* source_file;
+    char const* stack_map_table;
+} attr_names;
+char const* init_name;
+
 static enum AttrType get_attr_type(char const* t)
 {
-    if (!strcmp(t, "Code"))
+    if (t == attr_names.code)
         return ATTR_CODE;
-    if (!strcmp(t, "SourceFile"))
+    if (t == attr_names.source_file)
         return ATTR_SOURCE_FILE;
     errorf("unknown attribute type: %s\n", t);
 }
 
-static void load_field_attrs(FILE* cf, Field_t* f, Const_t* constant_pool_list)
+static void load_field_attrs(Reader_t* r, Field_t* f, Class_t const* c)
 {
-    size_t nr = read_big_endian_u2(cf);
+    size_t nr = read_u2(r);
     for (size_t i = 0; i < nr; ++i) {
-        enum AttrType attr_type = get_attr_type(resolve_utf8(constant_pool_list, read_big_endian_u2(cf)));
+        enum AttrType attr_type = get_attr_type(read_utf8(r, c));
 
-        size_t size = read_big_endian_u4(cf);
-        void* attr_buf = bytes(cf, size, 0);
+        size_t size = read_u4(r);
+        uint8_t const* attr = read_bytes(r, size);
+        Reader_t a = { attr, attr + size };
 
         switch (attr_type) {
-        case ATTR_SOURCE_FILE: {
-            struct ClassFileAttrSourceFile {
-                uint16_t index;
-            };
-            struct ClassFileAttrSourceFile* p = attr_buf;
-
-            f->source_file = resolve_utf8(constant_pool_list, u2_from_big_endian(p->index));
-        } break;
+        case ATTR_SOURCE_FILE:
+            f->source_file = read_utf8(&a, c);
+            break;
         default:
             panicf("unknown attr for field 0x%x", attr_type);
         }
-
-        free(attr_buf);
     }
 }
-static void load_fields(FILE* cf, Class_t* c)
+/*
+ * Instance fields go by decreasing size, so each is naturally aligned with as
+ * little padding as possible. The first 4-byte field takes the hole the
+ * superclass left, between its fields or after them if its instances do not
+ * end on an 8-byte boundary, and the hole left unused passes to subclasses.
+ */
+static void layout_fields(Class_t* c, Field_t* fields, size_t nr)
 {
-    size_t nr = read_big_endian_u2(cf);
-    size_t off = c->super->size;
-    Field_t* fields = malloc(sizeof(fields[0]) * nr);
+    size_t end = c->super->size;
+    size_t hole = c->super->hole;
+    if (hole == 0 && end % 8 != 0) {
+        hole = end;
+        end += 4;
+    }
+    for (size_t size = 16; size >= 4; size /= 2)
+        for (size_t i = 0; i < nr; ++i) {
+            if ((fields[i].flags & ACC_STATIC) || get_size_from_desc(fields[i].desc[0]) != size)
+                continue;
+            if (size == 4 && hole != 0) {
+                fields[i].offset = hole;
+                hole = 0;
+            } else {
+                fields[i].offset = end;
+                end += size;
+            }
+        }
+    if (hole != 0 && hole + 4 == end) {
+        end = hole;
+        hole = 0;
+    }
+    c->size = end;
+    c->hole = hole;
+}
+static void load_fields(Reader_t* r, Class_t* c)
+{
+    size_t nr = read_u2(r);
+    Field_t* fields = arena_calloc(&class_metadata, nr, sizeof(fields[0]));
     for (size_t i = 0; i < nr; ++i) {
         Field_t f;
-        f.flags = read_big_endian_u2(cf);
-        f.name = resolve_utf8(c->constant_pool.list, read_big_endian_u2(cf));
-        f.desc = resolve_utf8(c->constant_pool.list, read_big_endian_u2(cf));
-        load_field_attrs(cf, &f, c->constant_pool.list);
+        f.flags = read_u2(r);
+        f.name = read_utf8(r, c);
+        f.desc = read_utf8(r, c);
+        load_field_attrs(r, &f, c);
 
-        f.offset = off;
-        off += get_size_from_desc(f.desc[0]);
+        // static_val shares its storage with offset, so it must not be left holding one
+        if (f.flags & ACC_STATIC)
+            f.static_val = (Slot_t) { 0 };
 
         fields[i] = f;
+        if ((f.flags & ACC_STATIC) && f.desc[0] == 'L')
+            gc_add_root(&fields[i].static_val);
     }
+    layout_fields(c, fields, nr);
+
+    size_t* refs = arena_calloc(&class_metadata, c->super->refs.size + nr, sizeof(refs[0]));
+    size_t nr_refs = c->super->refs.size;
+    if (nr_refs > 0)
+        memcpy(refs, c->super->refs.list, sizeof(refs[0]) * nr_refs);
+    for (size_t i = 0; i < nr; ++i)
+        if (!(fields[i].flags & ACC_STATIC) && fields[i].desc[0] == 'L')
+            refs[nr_refs++] = fields[i].offset;
+
     c->fields.list = fields;
     c->fields.size = nr;
-    c->size = off;
+    c->refs.list = refs;
+    c->refs.size = nr_refs;
 }
 
-static void load_method_attrs(FILE* cf, Method_t* m, Const_t* constant_pool_list)
+// also returns the StackMapTable attribute of the code, if there is one, in place
+static void load_method_attrs(Reader_t* r, Method_t* m, Class_t const* c, uint8_t const** stack_map, size_t* stack_map_size)
 {
-    size_t nr = read_big_endian_u2(cf);
+    size_t nr = read_u2(r);
     for (size_t i = 0; i < nr; ++i) {
-        enum AttrType attr_type = get_attr_type(resolve_utf8(constant_pool_list, read_big_endian_u2(cf)));
+        enum AttrType attr_type = get_attr_type(read_utf8(r, c));
 
-        size_t size = read_big_endian_u4(cf);
-        void* attr_buf = bytes(cf, size, 0);
+        size_t size = read_u4(r);
+        uint8_t const* attr = read_bytes(r, size);
+        Reader_t a = { attr, attr + size };
 
         switch (attr_type) {
         case ATTR_CODE: {
-            struct ClassFileAttrCode_Piece_1 {
-                uint16_t max_stack;
-                uint16_t max_locals;
-                uint32_t code_length;
-                uint8_t code[];
-            };
-            struct ClassFileAttrCode_Piece_1* p1 = attr_buf;
-
-            m->max_stack = u2_from_big_endian(p1->max_stack);
-
-            m->max_locals = u2_from_big_endian(p1->max_locals);
-
-            size_t code_length = u4_from_big_endian(p1->code_length);
-            m->code_length = code_length;
-
-            void* code = malloc(code_length);
-            memmove(code, &p1->code, code_length);
-            m->code = code;
-        } break;
-        case ATTR_SOURCE_FILE: {
-            struct ClassFileAttrSourceFile {
-                uint16_t index;
-            };
-            struct ClassFileAttrSourceFile* p = attr_buf;
-
-            m->source_file = resolve_utf8(constant_pool_list, u2_from_big_endian(p->index));
+            m->max_stack = read_u2(&a);
+            m->max_locals = read_u2(&a);
+            m->code_length = read_u4(&a);
+            m->code = read_bytes(&a, m->code_length);
+
+            // the exception table and the attributes of the code follow it
+            read_bytes(&a, 8 * read_u2(&a));
+            size_t nr_code_attrs = read_u2(&a);
+            for (size_t j = 0; j < nr_code_attrs; ++j) {
+                char const* name = read_utf8(&a, c);
+                size_t attr_size = read_u4(&a);
+                uint8_t const* p = read_bytes(&a, attr_size);
+                if (name == attr_names.stack_map_table) {
+                    *stack_map = p;
+                    *stack_map_size = attr_size;
+                }
+            }
         } break;
+        case ATTR_SOURCE_FILE:
+            m->source_file = read_utf8(&a, c);
+            break;
         default:
             panicf("unknown attr for method 0x%x", attr_type);
         }
-
-        free(attr_buf);
     }
 }
-static void load_methods(FILE* cf, Class_t* c)
+static void load_methods(Reader_t* r, Class_t* c)
 {
-    size_t nr = read_big_endian_u2(cf);
-    Method_t* methods = malloc(sizeof(methods[0]) * nr);
+    size_t nr = read_u2(r);
+    Method_t* methods = arena_calloc(&class_metadata, nr, sizeof(methods[0]));
     for (size_t i = 0; i < nr; ++i) {
-        Method_t m;
-        m.flags = read_big_endian_u2(cf);
-        m.name = resolve_utf8(c->constant_pool.list, read_big_endian_u2(cf));
-        m.desc = resolve_utf8(c->constant_pool.list, read_big_endian_u2(cf));
-        load_method_attrs(cf, &m, c->constant_pool.list);
+        Method_t m = { 0 };
+        m.flags = read_u2(r);
+        m.name = read_utf8(r, c);
+        m.desc = read_utf8(r, c);
+        m.c = c;
+        uint8_t const* stack_map = NULL;
+        size_t stack_map_size = 0;
+        load_method_attrs(r, &m, c, &stack_map, &stack_map_size);
+        parse_signature(&m);
+        if (m.code != NULL) {
+            translate_method(&m);
+            infer_types(&m);
+            if (stack_map != NULL)
+                check_stack_map(&m, stack_map, stack_map_size);
+            build_ref_maps(&m);
+#ifndef NO_SUPERINSNS
+            fuse_superinsns(&m);
+#endif
+        }
         methods[i] = m;
     }
     c->methods.size = nr;
     c->methods.list = methods;
 
+    // the nearest declaration in a superclass of each method, whose vtable slot it takes over
+    Method_t** overridden = calloc(nr, sizeof(overridden[0]));
     size_t nr_vtable = 0;
     for (size_t i = 0; c->super->vtable[i] != NULL; ++i)
         nr_vtable++;
-    size_t cap_vtable = nr_vtable + 1 + nr;
-    Method_t** vtable = malloc(sizeof(vtable[0]) * cap_vtable);
+    size_t cap_vtable = 1 + nr_vtable + 1;
+    for (size_t i = 0; i < nr; ++i) {
+        if (methods[i].name[0] == '<')
+            continue;
+        for (Class_t const* k = c->super; k != NULL && overridden[i] == NULL; k = k->super)
+            overridden[i] = find_method(k, methods[i].name, methods[i].desc);
+        if (overridden[i] == NULL)
+            cap_vtable++;
+    }
+    Method_t** vtable = (Method_t**)arena_calloc(&class_metadata, cap_vtable, sizeof(vtable[0])) + 1;
+    ((Class_t**)vtable)[-1] = c;
     memcpy(vtable, c->super->vtable, sizeof(vtable[0]) * (nr_vtable + 1));
 
     for (size_t i = 0; i < nr; ++i) {
-        methods[i].c = c;
         if (methods[i].name[0] == '<')
             continue;
-        int found = 0;
-        for (size_t j = 0; c->super->vtable[j] != NULL; ++j) {
-            if (strcmp(c->super->vtable[j]->desc, methods[i].desc) == 0
-                && strcmp(c->super->vtable[j]->name, methods[i].name) == 0) {
-                found = 1;
-                vtable[j] = &methods[i];
-                methods[i].vtable_offset = j;
-                break;
-            }
-        }
-        if (!found) {
+        if (overridden[i] != NULL) {
+            size_t j = overridden[i]->vtable_offset;
+            cha_override(vtable[j], c);
+            vtable[j] = &methods[i];
+            methods[i].vtable_offset = j;
+        } else {
             vtable[nr_vtable] = &methods[i];
             methods[i].vtable_offset = nr_vtable;
             vtable[nr_vtable + 1] = NULL;
             nr_vtable++;
         }
     }
-    c->vtable = realloc(vtable, sizeof(vtable[0]) * (nr_vtable + 1));
+    free(overridden);
+    c->vtable = vtable;
 }
 
 static void __attribute__((format(printf, 2, 3))) indentdebugf(int indent, char const* restrict fmt, ...)
@@ -303,148 +416,186 @@ static void print_class(Class_t const* c, size_t indent)
         print_method(&c->methods.list[i], indent + 1);
 }
 
-void load_class_attrs(FILE* cf, Class_t* c)
+static void load_class_attrs(Reader_t* r, Class_t* c)
 {
-    size_t nr = read_big_endian_u2(cf);
+    size_t nr = read_u2(r);
     for (size_t i = 0; i < nr; ++i) {
-        enum AttrType attr_type = get_attr_type(resolve_utf8(c->constant_pool.list, read_big_endian_u2(cf)));
+        enum AttrType attr_type = get_attr_type(read_utf8(r, c));
 
-        size_t size = read_big_endian_u4(cf);
-        void* attr_buf = bytes(cf, size, 0);
+        size_t size = read_u4(r);
+        uint8_t const* attr = read_bytes(r, size);
+        Reader_t a = { attr, attr + size };
 
         switch (attr_type) {
-        case ATTR_SOURCE_FILE: {
-            struct ClassFileAttrSourceFile {
-                uint16_t index;
-            };
-            struct ClassFileAttrSourceFile* p = attr_buf;
-
-            c->source_file = resolve_utf8(c->constant_pool.list, u2_from_big_endian(p->index));
-        } break;
+        case ATTR_SOURCE_FILE:
+            c->source_file = read_utf8(&a, c);
+            break;
         default:
             panicf("unknown attr for class 0x%x", attr_type);
         }
-
-        free(attr_buf);
     }
 }
 
-#define CAP 10
+// open addressing, linear probing, keyed by name; classes stay where they were allocated
 static struct {
     size_t nr, cap;
     Class_t** list;
-    size_t nr_head;
-} loaded_classes = { 0, 0, NULL };
+} classes = { 0, 0, NULL };
+// implemented natively, by native.c
+static Class_t builtins[3];
+// bytes of class_metadata taken by the classes loaded so far, so that a class is not charged for its superclasses
+static size_t metadata_charged;
+
+static Class_t** find_class_slot(Class_t** list, size_t cap, char const* name)
+{
+    size_t i = symbol_hash(name) & (cap - 1);
+    while (list[i] != NULL && list[i]->name != name)
+        i = (i + 1) & (cap - 1);
+    return &list[i];
+}
+static void add_class(Class_t* c)
+{
+    if (2 * (classes.nr + 1) > classes.cap) {
+        size_t cap = (classes.cap == 0 ? 64 : 2 * classes.cap);
+        Class_t** list = calloc(cap, sizeof(list[0]));
+        for (size_t i = 0; i < classes.cap; ++i)
+            if (classes.list[i] != NULL)
+                *find_class_slot(list, cap, classes.list[i]->name) = classes.list[i];
+        free(classes.list);
+        classes.list = list;
+        classes.cap = cap;
+    }
+    *find_class_slot(classes.list, classes.cap, c->name) = c;
+    classes.nr++;
+}
 
 Class_t* load_class(char const* classname)
 {
-    for (size_t i = 0; i < loaded_classes.nr - 1; ++i)
-        for (size_t j = 0; j < CAP; ++j)
-            if (strcmp(loaded_classes.list[i][j].name, classname) == 0)
-                return &loaded_classes.list[i][j];
-    for (size_t j = 0; j < loaded_classes.nr_head; ++j)
-        if (strcmp(loaded_classes.list[loaded_classes.nr - 1][j].name, classname) == 0)
-            return &loaded_classes.list[loaded_classes.nr - 1][j];
+    Class_t* c = *find_class_slot(classes.list, classes.cap, classname);
+    if (c != NULL) {
+        // only its superclass is loaded while a class is
+        if (c->state == CLASS_LOADING)
+            errorf("java/lang/ClassCircularityError: %s", classname);
+        return c;
+    }
 
     char* filename = malloc(strlen(classname) + strlen(".class") + 1);
     sprintf(filename, "%s.class", classname);
-    FILE* cf = fopen(filename, "r");
-    if (cf == NULL)
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
         errorf("unable to open file %s for reading", filename);
-    uint32_t magic = read_big_endian_u4(cf);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+        errorf("unable to read class file %s", filename);
+    // private and read only, so the code of its methods can point into it
+    void* file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (file == MAP_FAILED)
+        errorf("unable to map class file %s", filename);
+    close(fd);
+    Reader_t r = { file, (uint8_t const*)file + st.st_size };
+
+    uint32_t magic = read_u4(&r);
     if (magic != 0xcafebabe)
         errorf("bad magic number 0x%x for class file %s\n", magic, filename);
     free(filename);
 
-    uint16_t minor_version = read_big_endian_u2(cf), major_version = read_big_endian_u2(cf);
-
-    if (loaded_classes.nr_head == CAP) {
-        if (loaded_classes.nr == loaded_classes.cap) {
-            loaded_classes.cap *= 2;
-            loaded_classes.list = realloc(loaded_classes.list, sizeof(loaded_classes.list[0]) * loaded_classes.cap);
-        }
-        loaded_classes.list[loaded_classes.nr++] = malloc(sizeof(loaded_classes.list[0][0]) * CAP);
-        loaded_classes.nr_head = 0;
-    }
-    Class_t* c = &loaded_classes.list[loaded_classes.nr - 1][loaded_classes.nr_head++];
-
-    c->constant_pool.size = read_big_endian_u2(cf) - 1;
-    c->constant_pool.list = load_constant_pool(cf, c->constant_pool.size);
-
-    c->flags = read_big_endian_u2(cf);
-    c->name = resolve_class(c->constant_pool.list, read_big_endian_u2(cf));
-    c->super = load_class(resolve_class(c->constant_pool.list, read_big_endian_u2(cf)));
-
-    c->interfaces.size = read_big_endian_u2(cf);
-    c->interfaces.list = load_interfaces(cf, c->interfaces.size, c->constant_pool.list);
-
-    load_fields(cf, c);
-    load_methods(cf, c);
-    load_class_attrs(cf, c);
-
-    indentdebugf(1, "======= Loaded %s (classfile '%s' ver. %d.%d) =======\n", c->name, c->source_file, major_version, minor_version);
+    uint16_t minor_version = read_u2(&r), major_version = read_u2(&r);
+
+    size_t metadata_used = class_metadata.used, charged = metadata_charged;
+    c = arena_alloc(&class_metadata, sizeof(*c));
+    c->name = classname;
+    c->state = CLASS_LOADING;
+    c->file.base = file;
+    c->file.size = st.st_size;
+    add_class(c);
+
+    // the count includes the unused entry 0
+    size_t constant_pool_count = read_u2(&r);
+    if (constant_pool_count == 0)
+        errorf("bad constant pool count 0 in class file %s", classname);
+    c->constant_pool.size = constant_pool_count - 1;
+    c->constant_pool.list = load_constant_pool(&r, c->constant_pool.size);
+    check_constant_pool(c->constant_pool.list, c->constant_pool.size);
+
+    c->flags = read_u2(&r);
+    char const* name = resolve_class_name(c->constant_pool.list, read_constant_index(&r, c, CONST_CLASS));
+    if (name != classname)
+        errorf("java/lang/NoClassDefFoundError: %s (wrong name: %s)", classname, name);
+    c->super = resolve_class(c->constant_pool.list, read_constant_index(&r, c, CONST_CLASS));
+
+    c->interfaces.size = read_u2(&r);
+    c->interfaces.list = load_interfaces(&r, c->interfaces.size, c);
+
+    load_fields(&r, c);
+    load_methods(&r, c);
+    index_members(c);
+    load_class_attrs(&r, c);
+    c->state = CLASS_LOADED;
+    bind_natives(c);
+    register_class(c);
+    c->state = CLASS_INITIALIZED;
+    c->metadata_size = (class_metadata.used - metadata_used) - (metadata_charged - charged);
+    metadata_charged += c->metadata_size;
+
+    indentdebugf(1, "======= Loaded %s (classfile '%s' ver. %d.%d, %lu bytes of metadata) =======\n", c->name, c->source_file, major_version, minor_version, c->metadata_size);
     print_class(c, 2);
     indentdebugf(1, "=====================================================\n");
 
-    fclose(cf);
     return c;
 }
 
-static void free_field(Field_t const* f)
-{
-}
+// what a class holds outside class_metadata
 static void free_method(Method_t const* m)
 {
-    free(m->code);
+#ifdef JIT
+    jit_free(m);
+    free(m->jit.retired);
+#endif
 }
 static void free_class(Class_t const* c)
 {
-    free(c->interfaces.list);
-
-    for (size_t i = 0; i < c->fields.size; ++i)
-        free_field(&c->fields.list[i]);
-    free(c->fields.list);
-
-    free(c->vtable);
-
     for (size_t i = 0; i < c->methods.size; ++i)
         free_method(&c->methods.list[i]);
-    free(c->methods.list);
-
-    for (size_t i = 0; i < c->constant_pool.size; ++i)
-        if (c->constant_pool.list[i].tag == CONST_UTF8)
-            free(c->constant_pool.list[i].utf8);
-    free(c->constant_pool.list);
+    munmap((void*)c->file.base, c->file.size);
 }
 void load_init()
 {
-    loaded_classes.cap = 1;
-    loaded_classes.list = malloc(sizeof(loaded_classes.list[0]) * loaded_classes.cap);
-
-    loaded_classes.nr = 1;
-    loaded_classes.list[0] = malloc(sizeof(loaded_classes.list[0][0]) * CAP);
-
-    loaded_classes.nr_head = 3;
-
-    init_java_lang_Object(&loaded_classes.list[0][0]);
-    init_java_io_PrintStream(&loaded_classes.list[0][1]);
-    // load java/lang/System AFTER java/io/PrintStream as former depends on latter
-    init_java_lang_System(&loaded_classes.list[0][2]);
+    symbol_init();
+    attr_names.code = intern("Code");
+    attr_names.source_file = intern("SourceFile");
+    attr_names.stack_map_table = intern("StackMapTable");
+    init_name = intern("<init>");
+    native_init();
+
+    // java/lang/System AFTER java/io/PrintStream as former depends on latter
+    static void (*const init[])(Class_t*) = { init_java_lang_Object, init_java_io_PrintStream, init_java_lang_System };
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i) {
+        size_t metadata_used = class_metadata.used;
+        init[i](&builtins[i]);
+        index_members(&builtins[i]);
+        bind_natives(&builtins[i]);
+        builtins[i].state = CLASS_INITIALIZED;
+        builtins[i].metadata_size = class_metadata.used - metadata_used;
+        metadata_charged += builtins[i].metadata_size;
+        add_class(&builtins[i]);
+    }
 }
 void load_end()
 {
-    for (size_t j = 3; j < (loaded_classes.nr == 1 ? loaded_classes.nr_head : CAP); ++j)
-        free_class(&loaded_classes.list[0][j]);
-    free(loaded_classes.list[0]);
-    if (loaded_classes.nr > 1) {
-        for (size_t i = 1; i < loaded_classes.nr - 1; ++i) {
-            for (size_t j = 0; j < CAP; ++j)
-                free_class(&loaded_classes.list[i][j]);
-            free(loaded_classes.list[i]);
-        }
-        for (size_t j = 0; j < loaded_classes.nr_head; ++j)
-            free_class(&loaded_classes.list[loaded_classes.nr - 1][j]);
-        free(loaded_classes.list[loaded_classes.nr - 1]);
+    for (size_t i = 0; i < classes.cap; ++i) {
+        Class_t* c = classes.list[i];
+        if (c != NULL && !(c >= builtins && c < builtins + sizeof(builtins) / sizeof(builtins[0])))
+            free_class(c);
     }
-    free(loaded_classes.list);
+    free(classes.list);
+    classes.list = NULL;
+    classes.nr = classes.cap = 0;
+    unregister_classes();
+
+    debugf("Class metadata: %lu bytes in %lu bytes of arena\n", class_metadata.used, class_metadata.reserved);
+    arena_release(&class_metadata);
+    metadata_charged = 0;
+
+    native_end();
+    symbol_end();
 }
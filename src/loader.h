@@ -8,8 +8,21 @@ static inline uint16_t u2_from_big_endian(uint16_t u)
 {
     return ((u & 0xff) << 8 | (u & 0xff00) >> 8);
 }
+// big endian integers of class file data already in memory
+static inline uint16_t u2_at(uint8_t const* p)
+{
+    return p[0] << 8 | p[1];
+}
+static inline uint32_t u4_at(uint8_t const* p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// "<init>", the name of constructors, interned by load_init()
+extern char const* init_name;
 
-Class_t* load_class(char const* classfile);
+// classname is a symbol (see symbol.h)
+Class_t* load_class(char const* classname);
 void load_init(void);
 void load_end(void);
 
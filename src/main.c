@@ -1,7 +1,18 @@
+#include "cha.h"
 #include "class.h"
+#include "exec.h"
+#include "gc.h"
+#include "inline_cache.h"
 #include "loader.h"
 #include "native.h"
+#include "jit.h"
+#include "jmath.h"
 #include "opcode.h"
+#include "quicken.h"
+#include "superinsn.h"
+#include "symbol.h"
+#include "thread.h"
+#include "typeflow.h"
 #include "util.h"
 
 #include <argp.h>
@@ -10,21 +21,9 @@
 #include <stdlib.h>
 #include <string.h>
 
-typedef struct {
-    Class_t const* class;
-
-    size_t ip; // points to next code byte to be processed
-    uint8_t const* code;
-
-    Value_t* locals;
-
-    size_t sp; // points to top of the stack (-1 for empty stack)
-    Value_t* stack;
-} Frame_t;
-
-void print_value(Value_t v)
+void print_slot(Slot_t v, uint8_t type)
 {
-    switch (v.type) {
+    switch (type) {
     case I:
         debugfc(BOLD BLUE, "I:%d ", v.i);
         break;
@@ -42,92 +41,82 @@ void print_value(Value_t v)
         break;
     case ARR:
         panicf("unimplemented");
+    default:
+        debugfc(BOLD BLUE, "?:%lx ", v.l);
     }
 }
-void print_stack(Value_t* stack, size_t sp)
+// types is only consulted for untagged slots
+void print_stack(Slot_t const* stack, size_t sp, uint8_t const* types)
 {
     debugfc(BOLD BLUE, "[ ");
     if (sp + 1 != 0)
         for (size_t i = 0; i <= sp; ++i)
-            print_value(stack[i]);
+#ifdef TAGGED_SLOTS
+            print_slot(stack[i], stack[i].type);
+#else
+            print_slot(stack[i], types[i]);
+#endif
     debugfc(BOLD BLUE, "]");
 }
 
-struct desc_info {
-    uint16_t nr_args : 15;
-    uint16_t returns : 1;
-};
+Slot_t exec(Frame_t* f);
 
-static struct desc_info parse_desc(char const* desc)
+Slot_t call_method(Method_t* m, Slot_t* args, size_t nr_args)
 {
-    struct desc_info info = { 0, 0 };
-    char const* p = desc;
-    ++p;
-    for (; *p != ')'; ++p) {
-        info.nr_args++;
-        while (*p == '[')
-            ++p;
-        if (*p == 'L') {
-            ++p;
-            while (*p != ';')
-                ++p;
-        }
-    }
-    ++p;
-    if (*p != 'V')
-        info.returns = 1;
-    return info;
-}
-
-Value_t native(Method_t* m, Value_t const* args, size_t nr_args)
-{
-    Value_t ret = { 0 };
-    if (!strcmp(m->c->name, "java/io/PrintStream") && !strcmp(m->name, "println")) {
-        if (!strcmp(m->desc, "(I)V"))
-            native_println_I(args[0].a, args[1].i);
-        else if (!strcmp(m->desc, "(D)V"))
-            native_println_D(args[0].a, args[1].d);
-    } else if (!strcmp(m->c->name, "java/lang/Object") && !strcmp(m->name, "<init>")) {
-    }
-    return ret;
-}
-
-Value_t exec(Frame_t* f);
-Value_t call_method(Method_t* m, Value_t const* args, size_t nr_args)
-{
-    Value_t ret;
+    Slot_t ret;
     debugfc(BOLD YELLOW, "Entering function %s.%s\n", m->c->name, m->name);
 
     if (m->flags & ACC_NATIVE)
-        ret = native(m, args, nr_args);
+        ret = m->native(args);
     else {
-        Value_t* locals = malloc(sizeof(Value_t) * m->max_locals);
-        Value_t* stack = malloc(sizeof(Value_t) * m->max_stack);
+        Thread_t* t = &main_thread;
+        Slot_t* saved_top = t->stack.top;
+
+        // arguments pushed by an interpreted caller already are the callee's first locals
+        Slot_t* locals = args;
+        if (nr_args == 0 || !in_java_stack(t, args))
+            locals = t->stack.top;
+        // before anything is written to the frame, which may be past the limit
+        Slot_t* stack = locals + m->max_locals;
+        if (stack + m->max_stack > t->stack.limit)
+            errorf("java/lang/StackOverflowError in %s.%s", m->c->name, m->name);
+        if (locals != args)
+            memmove(locals, args, nr_args * sizeof(args[0]));
+        // longs and doubles take a single operand stack slot but two local variable slots
+        if (m->sig.nr_slots != nr_args)
+            for (size_t i = nr_args, slot = m->sig.nr_slots; i-- > 0;) {
+                slot -= (m->sig.arg_types[i] == L || m->sig.arg_types[i] == D ? 2 : 1);
+                locals[slot] = locals[i];
+            }
+        t->stack.top = stack + m->max_stack;
 
         // to placate valgrind
-        {
-            extern int debug;
-            if (debug) {
-                memset(locals, 0, sizeof(Value_t) * m->max_locals);
-                memset(stack, 0, sizeof(Value_t) * m->max_stack);
-            }
-        }
+        if (debug)
+            memset(locals + m->sig.nr_slots, 0, sizeof(Slot_t) * (m->max_locals + m->max_stack - m->sig.nr_slots));
 
         debugfc(BOLD YELLOW, "nr args: %lu\n", nr_args);
-        memmove(locals, args, nr_args * sizeof(args[0]));
 
         Frame_t f = {
+            .prev = t->frames,
             .class = m->c,
-            .ip = 0,
-            .code = m->code,
+            .method = m,
+            .ip = m->insns,
             .locals = locals,
             .sp = -1,
             .stack = stack,
         };
-        ret = exec(&f);
-
-        free(locals);
-        free(stack);
+        t->frames = &f;
+#ifdef JIT
+        if (m->jit.tier != TIER_OPT)
+            tier_up(m);
+        if (m->jit.code.entry != NULL)
+            ret = m->jit.code.entry(locals, &f);
+        else
+#endif
+            ret = exec(&f);
+
+        t->frames = f.prev;
+        t->stack.top = saved_top;
     }
 
     debugfc(BOLD YELLOW, "Exiting function %s.%s\n", m->c->name, m->name);
@@ -135,48 +124,7 @@ Value_t call_method(Method_t* m, Value_t const* args, size_t nr_args)
     return ret;
 }
 
-static inline Value_t makeI(int32_t i)
-{
-    return (Value_t) { .type = I, .i = i };
-}
-static inline Value_t makeL(int64_t l)
-{
-    return (Value_t) { .type = L, .l = l };
-}
-static inline Value_t makeF(float f)
-{
-    return (Value_t) { .type = F, .f = f };
-}
-static inline Value_t makeD(double d)
-{
-    return (Value_t) { .type = D, .d = d };
-}
-static inline Value_t makeA(void* a)
-{
-    return (Value_t) { .type = A, .a = a };
-}
-
-enum ValueType get_value_type(char desc)
-{
-    switch (desc) {
-    case 'I':
-        return I;
-    case 'F':
-        return F;
-    case 'J':
-        return L;
-    case 'D':
-        return D;
-    case 'L':
-        return A;
-    case '[':
-        return ARR;
-    default:
-        panicf("wtf");
-    }
-}
-
-static inline Value_t get_value(void* a, enum ValueType type)
+static inline Slot_t get_value(void* a, enum ValueType type)
 {
     switch (type) {
     case I:
@@ -195,9 +143,9 @@ static inline Value_t get_value(void* a, enum ValueType type)
         __builtin_unreachable();
     }
 }
-static inline void set_value(void* a, Value_t v)
+static inline void set_value(void* a, Slot_t v, enum ValueType type)
 {
-    switch (v.type) {
+    switch (type) {
     case I:
         *(int32_t*)a = v.i;
         break;
@@ -220,610 +168,671 @@ static inline void set_value(void* a, Value_t v)
     }
 }
 
-Value_t const_to_value(Const_t c)
-{
-    switch (c.tag) {
-    case CONST_INT:
-        return makeI(c.i);
-    case CONST_FLOAT:
-        return makeF(c.f);
-    case CONST_LONG:
-        return makeL(c.l);
-    case CONST_DOUBLE:
-        return makeD(c.d);
-    default:
-        panicf("unimplemented %d", c.tag);
-    }
-}
-
-Value_t exec(Frame_t* f)
+/*
+ * The interpreter loop is written once in terms of HANDLER()/NEXT() and
+ * compiled either as a switch inside a loop or, by default, as threaded code
+ * where every handler jumps straight to the next one through a label table
+ * generated from OPCODE_ENUM. Build with `make DISPATCH=switch` for the former.
+ */
+#if defined(__GNUC__) && !defined(SWITCH_DISPATCH)
+    #define THREADED_DISPATCH
+#endif
+
+#ifdef INSN_PROFILE
+    #define PROFILE() profile_insn(f->method, ip)
+#else
+    #define PROFILE()
+#endif
+#define TRACE()                                                    \
+    do {                                                           \
+        PROFILE();                                                 \
+        if (debug) {                                               \
+            print_stack(stack, sp, stack_types_at(f->method, ip)); \
+            debugf("\n%s\n", get_string(ip->op));                  \
+        }                                                          \
+    } while (0)
+
+#ifdef THREADED_DISPATCH
+    #define HANDLER(name) do_##name:
+    #define DISPATCH()              \
+        do {                        \
+            TRACE();                \
+            goto* handlers[ip->op]; \
+        } while (0)
+    #define HANDLER_ADDR(name, assign) [name] = &&do_##name,
+#else
+    #define HANDLER(name) case name:
+    #define DISPATCH() goto dispatch
+#endif
+#define NEXT()      \
+    do {            \
+        ip++;       \
+        DISPATCH(); \
+    } while (0)
+
+// a is the second topmost and b the topmost stack value
+#define BINARY(T, field, make, expr)                    \
+    do {                                                \
+        T a = stack[sp - 1].field, b = stack[sp].field; \
+        stack[sp - 1] = make(expr);                     \
+        sp--;                                           \
+    } while (0)
+// a NaN operand yields nan_result, telling apart the *CMPL and *CMPG variants
+#define COMPARE(T, field, nan_result)                                            \
+    do {                                                                         \
+        T a = stack[sp - 1].field, b = stack[sp].field;                          \
+        stack[sp - 1] = makeI(a > b ? 1 : a < b ? -1 : a == b ? 0 : nan_result); \
+        sp--;                                                                    \
+    } while (0)
+// the shift distance is an int regardless of the shifted type
+#define SHIFT(T, field, make, expr) \
+    do {                            \
+        T a = stack[sp - 1].field;  \
+        int32_t b = stack[sp].i;    \
+        stack[sp - 1] = make(expr); \
+        sp--;                       \
+    } while (0)
+
+#ifdef JIT
+// a taken branch back to a loop header, where a hot loop leaves for compiled code
+    #define BACK_EDGE(br)                                                                              \
+        do {                                                                                           \
+            if ((br)->target <= (br) && ++f->method->jit.backedges[(br)->loop] >= osr_threshold) {    \
+                Slot_t (*entry)(Slot_t*, Frame_t*) = osr_entry(f->method, (br));                       \
+                if (entry != NULL)                                                                     \
+                    return entry(locals, f);                                                           \
+            }                                                                                          \
+        } while (0)
+#else
+    #define BACK_EDGE(br) ((void)0)
+#endif
+
+#define BRANCH_IF(cond)        \
+    do {                       \
+        if (cond) {            \
+            BACK_EDGE(ip);     \
+            ip = ip->target;   \
+        } else                 \
+            ip++;              \
+        DISPATCH();            \
+    } while (0)
+#define BRANCH_IF_UNARY(cmp)       \
+    do {                           \
+        int32_t v = stack[sp--].i; \
+        BRANCH_IF(v cmp 0);        \
+    } while (0)
+#define BRANCH_IF_BINARY(field, cmp)                            \
+    do {                                                        \
+        int branch = (stack[sp - 1].field cmp stack[sp].field); \
+        sp -= 2;                                                \
+        BRANCH_IF(branch);                                      \
+    } while (0)
+
+// the branch ending a fused sequence of n instructions
+#define FUSED_BRANCH_IF(cond, n)      \
+    do {                              \
+        if (cond) {                   \
+            BACK_EDGE(&ip[(n) - 1]);  \
+            ip = ip[(n) - 1].target;  \
+        } else                        \
+            ip += (n);                \
+        DISPATCH();                   \
+    } while (0)
+#define ILOAD_ILOAD_IF_ICMP(cmp) FUSED_BRANCH_IF(locals[ip->index].i cmp locals[ip[1].index].i, 3)
+#define ILOAD_ICONST_IF_ICMP(cmp) FUSED_BRANCH_IF(locals[ip->index].i cmp ip[1].i, 3)
+
+// calls m with the arguments ending at the stack top and pushes its result
+#define INVOKE(m, args)                                 \
+    do {                                                \
+        f->ip = ip;                                     \
+        f->sp = sp - ip->nr_args;                       \
+        Slot_t ret = call_method(m, args, ip->nr_args); \
+        sp -= ip->nr_args;                              \
+        if (ip->returns)                                \
+            stack[++sp] = ret;                          \
+    } while (0)
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+Slot_t exec(Frame_t* f)
 {
-    Const_t* constant_pool_list = f->class->constant_pool.list;
-    Value_t* stack = f->stack;
-    Value_t* locals = f->locals;
+    Slot_t* stack = f->stack;
+    Slot_t* locals = f->locals;
     size_t sp = f->sp;
-    uint8_t const* code = f->code;
-    size_t ip = f->ip;
-
-    print_stack(stack, sp);
-    debugf("\n");
-
-    while (1) {
-        enum opcode op = (enum opcode)code[ip++];
-        debugf("%s\n", get_string(op));
-
-        switch (op) {
-        case NOP:
-            break;
-        case ACONST_NULL:
-            stack[++sp] = makeA(NULL);
-            break;
-        case ICONST_M1:
-        case ICONST_0:
-        case ICONST_1:
-        case ICONST_2:
-        case ICONST_3:
-        case ICONST_4:
-        case ICONST_5:
-            stack[++sp] = makeI((int32_t)op - (int32_t)ICONST_0);
-            break;
-        case LCONST_0:
-            stack[++sp] = makeL(0l);
-            break;
-        case LCONST_1:
-            stack[++sp] = makeL(1l);
-            break;
-        case FCONST_0:
-            stack[++sp] = makeF(0.0f);
-            break;
-        case FCONST_1:
-            stack[++sp] = makeF(1.0f);
-            break;
-        case FCONST_2:
-            stack[++sp] = makeF(2.0f);
-            break;
-        case DCONST_0:
-            stack[++sp] = makeD(0.0);
-            break;
-        case DCONST_1:
-            stack[++sp] = makeD(1.0);
-            break;
-        case BIPUSH:
-            stack[++sp] = makeI((int8_t)code[ip]);
-            ip++;
-            break;
-        case SIPUSH:
-            stack[++sp] = makeI((int16_t)u2_from_big_endian(*(uint16_t*)&code[ip]));
-            ip += 2;
-            break;
-        case LDC: {
-            size_t index = code[ip];
-            Const_t c = constant_pool_list[index - 1];
-            stack[++sp] = const_to_value(c);
-            ip++;
-        } break;
-        case LDC_W:
-        case LDC2_W: {
-            size_t index = u2_from_big_endian(*(uint16_t*)&code[ip]);
-            Const_t c = constant_pool_list[index - 1];
-            stack[++sp] = const_to_value(c);
-            ip += 2;
-        } break;
-        case ILOAD:
-        case LLOAD:
-        case FLOAD:
-        case DLOAD:
-        case ALOAD:
-            stack[++sp] = locals[code[ip]];
-            ip++;
-            break;
-        case ISTORE:
-        case LSTORE:
-        case FSTORE:
-        case DSTORE:
-        case ASTORE:
-            locals[code[ip]] = stack[sp--];
-            ip++;
-            break;
-        case ILOAD_0:
-        case ILOAD_1:
-        case ILOAD_2:
-        case ILOAD_3:
-            stack[++sp] = locals[op - ILOAD_0];
-            break;
-        case ISTORE_0:
-        case ISTORE_1:
-        case ISTORE_2:
-        case ISTORE_3:
-            locals[op - ISTORE_0] = stack[sp--];
-            break;
-        case LLOAD_0:
-        case LLOAD_1:
-        case LLOAD_2:
-        case LLOAD_3:
-            stack[++sp] = locals[op - LLOAD_0];
-            break;
-        case LSTORE_0:
-        case LSTORE_1:
-        case LSTORE_2:
-        case LSTORE_3:
-            locals[op - LSTORE_0] = stack[sp--];
-            break;
-        case FLOAD_0:
-        case FLOAD_1:
-        case FLOAD_2:
-        case FLOAD_3:
-            stack[++sp] = locals[op - FLOAD_0];
-            break;
-        case FSTORE_0:
-        case FSTORE_1:
-        case FSTORE_2:
-        case FSTORE_3:
-            locals[op - FSTORE_0] = stack[sp--];
-            break;
-        case DLOAD_0:
-        case DLOAD_1:
-        case DLOAD_2:
-        case DLOAD_3:
-            stack[++sp] = locals[op - DLOAD_0];
-            break;
-        case DSTORE_0:
-        case DSTORE_1:
-        case DSTORE_2:
-        case DSTORE_3:
-            locals[op - DSTORE_0] = stack[sp--];
-            break;
-        case ALOAD_0:
-        case ALOAD_1:
-        case ALOAD_2:
-        case ALOAD_3:
-            stack[++sp] = locals[op - ALOAD_0];
-            break;
-        case ASTORE_0:
-        case ASTORE_1:
-        case ASTORE_2:
-        case ASTORE_3:
-            locals[op - ASTORE_0] = stack[sp--];
-            break;
-        case POP:
-            sp--;
-            break;
-        case DUP:
-            stack[sp + 1] = stack[sp];
-            ++sp;
-            break;
-        case SWAP: {
-            Value_t v = stack[sp];
-            stack[sp - 1] = v;
-            stack[sp] = stack[sp - 1];
-        } break;
-        case IADD:
-        case ISUB:
-        case IMUL:
-        case IDIV:
-        case IREM:
-        case ISHL:
-        case ISHR:
-        case IUSHR:
-        case IAND:
-        case IOR:
-        case IXOR: {
-            int32_t a = stack[sp - 1].i, b = stack[sp].i, result;
-            switch (op) {
-            case IADD:
-                result = a + b;
-                break;
-            case ISUB:
-                result = a - b;
-                break;
-            case IMUL:
-                result = a * b;
-                break;
-            case IDIV:
-                result = a / b;
-                break;
-            case IREM:
-                result = a % b;
-                break;
-            case ISHL:
-                result = a << (uint8_t)(b & 0x1f);
-                break;
-            case ISHR:
-                result = a >> (uint8_t)(b & 0x1f);
-                break;
-            case IUSHR:
-                result = ((uint32_t)a) >> (uint8_t)(b & 0x1f);
-                break;
-            case IAND:
-                result = a & b;
-                break;
-            case IOR:
-                result = a | b;
-                break;
-            case IXOR:
-                result = a ^ b;
-                break;
-            default:
-                __builtin_unreachable();
-            }
-            stack[sp - 1] = makeI(result);
-            sp--;
-        } break;
-        case LADD:
-        case LSUB:
-        case LMUL:
-        case LDIV:
-        case LREM:
-        case LSHL:
-        case LSHR:
-        case LUSHR:
-        case LAND:
-        case LOR:
-        case LXOR: {
-            int64_t a = stack[sp - 1].l, b = stack[sp].l, result;
-            switch (op) {
-            case LADD:
-                result = a + b;
-                break;
-            case LSUB:
-                result = a - b;
-                break;
-            case LMUL:
-                result = a * b;
-                break;
-            case LDIV:
-                result = a / b;
-                break;
-            case LREM:
-                result = a % b;
-                break;
-            case LSHL:
-                result = a << (uint8_t)(b & 0x3f);
-                break;
-            case LSHR:
-                result = a >> (uint8_t)(b & 0x3f);
-                break;
-            case LUSHR:
-                result = ((uint64_t)a) >> (uint8_t)(b & 0x3f);
-                break;
-            case LAND:
-                result = a & b;
-                break;
-            case LOR:
-                result = a | b;
-                break;
-            case LXOR:
-                result = a ^ b;
-                break;
-            default:
-                __builtin_unreachable();
-            }
-            stack[sp - 1] = makeL(result);
-            sp--;
-        } break;
-        case FADD:
-        case FSUB:
-        case FMUL:
-        case FDIV:
-        case FREM: {
-            float a = stack[sp - 1].f, b = stack[sp].f, result;
-            switch (op) {
-            case FADD:
-                result = a + b;
-                break;
-            case FSUB:
-                result = a - b;
-                break;
-            case FMUL:
-                result = a * b;
-                break;
-            case FDIV:
-                result = a / b;
-                break;
-            case FREM:
-                result = (float)fmod(a, b);
-                break;
-            default:
-                __builtin_unreachable();
-            }
-            stack[sp - 2] = makeF(result);
-            sp--;
-        } break;
-        case DADD:
-        case DSUB:
-        case DMUL:
-        case DDIV:
-        case DREM: {
-            double a = stack[sp - 1].d, b = stack[sp].d, result;
-            switch (op) {
-            case DADD:
-                result = a + b;
-                break;
-            case DSUB:
-                result = a - b;
-                break;
-            case DMUL:
-                result = a * b;
-                break;
-            case DDIV:
-                result = a / b;
-                break;
-            case DREM:
-                result = fmod(a, b);
-                break;
-            default:
-                __builtin_unreachable();
-            }
-            stack[sp - 1] = makeD(result);
-            sp--;
-        } break;
-        case INEG:
-            stack[sp].i = -stack[sp].i;
-            break;
-        case LNEG:
-            stack[sp].l = -stack[sp].l;
-            break;
-        case FNEG:
-            stack[sp].f = -stack[sp].f;
-            break;
-        case DNEG:
-            stack[sp].d = -stack[sp].d;
-            break;
-        case I2L:
-            stack[sp] = makeL((int64_t)stack[sp].i);
-            break;
-        case I2F:
-            stack[sp] = makeF((float)stack[sp].i);
-            break;
-        case I2D:
-            stack[sp] = makeD((double)stack[sp].i);
-            break;
-        case L2I:
-            stack[sp] = makeI((int32_t)stack[sp].l);
-            break;
-        case L2F:
-            stack[sp] = makeF((float)stack[sp].l);
-            break;
-        case L2D:
-            stack[sp] = makeD((double)stack[sp].l);
-            break;
-        case F2I:
-            stack[sp] = makeI((int32_t)stack[sp].f);
-            break;
-        case F2L:
-            stack[sp] = makeL((int64_t)stack[sp].f);
-            break;
-        case F2D:
-            stack[sp] = makeD((double)stack[sp].f);
-            break;
-        case D2I:
-            stack[sp] = makeI((int32_t)stack[sp].d);
-            break;
-        case D2L:
-            stack[sp] = makeL((int64_t)stack[sp].d);
-            break;
-        case D2F:
-            stack[sp] = makeF((float)stack[sp].d);
-            break;
-        case I2B:
-            stack[sp] = makeI((int32_t)((uint32_t)stack[sp].i & 0xff));
-            break;
-        case I2C:
-            stack[sp] = makeI((uint32_t)((uint32_t)stack[sp].i & 0xff));
-            break;
-        case I2S:
-            stack[sp] = makeI((int32_t)((uint32_t)stack[sp].i & 0xffff));
-            break;
-        case LCMP:
-            stack[sp - 1] = makeI(stack[sp - 1].l > stack[sp].l ? 1 : stack[sp - 1].l < stack[sp].l ? -1
-                                                                                                    : 0);
-            sp--;
-            break;
-        case FCMPL:
-        case FCMPG:
-            stack[sp - 1] = makeI(stack[sp - 1].f > stack[sp].f ? 1 : stack[sp - 1].f < stack[sp].f ? -1
-                                                                                                    : 0);
-            sp--;
-            break;
-        case DCMPL:
-        case DCMPG:
-            stack[sp - 1] = makeI(stack[sp - 1].d > stack[sp].d ? 1 : stack[sp - 1].d < stack[sp].d ? -1
-                                                                                                    : 0);
-            sp--;
-            break;
-        case IFEQ:
-        case IFNE:
-        case IFLT:
-        case IFGE:
-        case IFGT:
-        case IFLE:
-        case IF_ICMPEQ:
-        case IF_ICMPNE:
-        case IF_ICMPLT:
-        case IF_ICMPGE:
-        case IF_ICMPGT:
-        case IF_ICMPLE:
-        case IF_ACMPEQ:
-        case IF_ACMPNE:
-        case GOTO: {
-            ssize_t off = (int16_t)u2_from_big_endian(*(uint16_t*)&code[ip]);
-            ip += 2;
-            int branch = 0;
-            switch (op) {
-            case IFEQ:
-                branch = (stack[sp--].i == 0);
-                break;
-            case IFNE:
-                branch = (stack[sp--].i != 0);
-                break;
-            case IFLT:
-                branch = (stack[sp--].i < 0);
-                break;
-            case IFGE:
-                branch = (stack[sp--].i >= 0);
-                break;
-            case IFGT:
-                branch = (stack[sp--].i > 0);
-                break;
-            case IFLE:
-                branch = (stack[sp--].i <= 0);
-                break;
-            case IF_ICMPEQ:
-                branch = (stack[sp - 1].i == stack[sp].i);
-                sp -= 2;
-                break;
-            case IF_ICMPNE:
-                branch = (stack[sp - 1].i != stack[sp].i);
-                sp -= 2;
-                break;
-            case IF_ICMPLT:
-                branch = (stack[sp - 1].i < stack[sp].i);
-                sp -= 2;
-                break;
-            case IF_ICMPGE:
-                branch = (stack[sp - 1].i >= stack[sp].i);
-                sp -= 2;
-                break;
-            case IF_ICMPGT:
-                branch = (stack[sp - 1].i > stack[sp].i);
-                sp -= 2;
-                break;
-            case IF_ICMPLE:
-                branch = (stack[sp - 1].i <= stack[sp].i);
-                sp -= 2;
-                break;
-            case IF_ACMPEQ:
-                branch = (stack[sp - 1].a == stack[sp].a);
-                sp -= 2;
-                break;
-            case IF_ACMPNE:
-                branch = (stack[sp - 1].a != stack[sp].a);
-                sp -= 2;
-                break;
-            case GOTO:
+    Insn_t* ip = f->ip;
+
+#ifdef THREADED_DISPATCH
+    static void* const handlers[256] = {
+        [0 ... 255] = &&unrecognised,
+        OPCODE_ENUM(HANDLER_ADDR)
+    };
+    DISPATCH();
+#else
+dispatch:
+    TRACE();
+    switch (ip->op) {
+#endif
+
+    HANDLER(NOP)
+        NEXT();
+    HANDLER(ACONST_NULL)
+        stack[++sp] = makeA(NULL);
+        NEXT();
+    HANDLER(ICONST_M1)
+    HANDLER(ICONST_0)
+    HANDLER(ICONST_1)
+    HANDLER(ICONST_2)
+    HANDLER(ICONST_3)
+    HANDLER(ICONST_4)
+    HANDLER(ICONST_5)
+        stack[++sp] = makeI(ip->i);
+        NEXT();
+    HANDLER(LCONST_0)
+    HANDLER(LCONST_1)
+        stack[++sp] = makeL(ip->l);
+        NEXT();
+    HANDLER(FCONST_0)
+    HANDLER(FCONST_1)
+    HANDLER(FCONST_2)
+        stack[++sp] = makeF(ip->f);
+        NEXT();
+    HANDLER(DCONST_0)
+    HANDLER(DCONST_1)
+        stack[++sp] = makeD(ip->d);
+        NEXT();
+    HANDLER(BIPUSH)
+    HANDLER(SIPUSH)
+        stack[++sp] = makeI(ip->i);
+        NEXT();
+    HANDLER(LDC)
+    HANDLER(LDC_W)
+    HANDLER(LDC2_W)
+        stack[++sp] = SLOT(ip->type, l, ip->l);
+        NEXT();
+    HANDLER(ILOAD)
+    HANDLER(LLOAD)
+    HANDLER(FLOAD)
+    HANDLER(DLOAD)
+    HANDLER(ALOAD)
+        stack[++sp] = locals[ip->index];
+        NEXT();
+    HANDLER(ISTORE)
+    HANDLER(LSTORE)
+    HANDLER(FSTORE)
+    HANDLER(DSTORE)
+    HANDLER(ASTORE)
+        locals[ip->index] = stack[sp--];
+        NEXT();
+    HANDLER(ILOAD_0)
+    HANDLER(ILOAD_1)
+    HANDLER(ILOAD_2)
+    HANDLER(ILOAD_3)
+        stack[++sp] = locals[ip->index];
+        NEXT();
+    HANDLER(LLOAD_0)
+    HANDLER(LLOAD_1)
+    HANDLER(LLOAD_2)
+    HANDLER(LLOAD_3)
+        stack[++sp] = locals[ip->index];
+        NEXT();
+    HANDLER(FLOAD_0)
+    HANDLER(FLOAD_1)
+    HANDLER(FLOAD_2)
+    HANDLER(FLOAD_3)
+        stack[++sp] = locals[ip->index];
+        NEXT();
+    HANDLER(DLOAD_0)
+    HANDLER(DLOAD_1)
+    HANDLER(DLOAD_2)
+    HANDLER(DLOAD_3)
+        stack[++sp] = locals[ip->index];
+        NEXT();
+    HANDLER(ALOAD_0)
+    HANDLER(ALOAD_1)
+    HANDLER(ALOAD_2)
+    HANDLER(ALOAD_3)
+        stack[++sp] = locals[ip->index];
+        NEXT();
+    HANDLER(ISTORE_0)
+    HANDLER(ISTORE_1)
+    HANDLER(ISTORE_2)
+    HANDLER(ISTORE_3)
+        locals[ip->index] = stack[sp--];
+        NEXT();
+    HANDLER(LSTORE_0)
+    HANDLER(LSTORE_1)
+    HANDLER(LSTORE_2)
+    HANDLER(LSTORE_3)
+        locals[ip->index] = stack[sp--];
+        NEXT();
+    HANDLER(FSTORE_0)
+    HANDLER(FSTORE_1)
+    HANDLER(FSTORE_2)
+    HANDLER(FSTORE_3)
+        locals[ip->index] = stack[sp--];
+        NEXT();
+    HANDLER(DSTORE_0)
+    HANDLER(DSTORE_1)
+    HANDLER(DSTORE_2)
+    HANDLER(DSTORE_3)
+        locals[ip->index] = stack[sp--];
+        NEXT();
+    HANDLER(ASTORE_0)
+    HANDLER(ASTORE_1)
+    HANDLER(ASTORE_2)
+    HANDLER(ASTORE_3)
+        locals[ip->index] = stack[sp--];
+        NEXT();
+    HANDLER(IINC)
+        locals[ip->index].i = (int32_t)((uint32_t)locals[ip->index].i + (uint32_t)ip->i);
+        NEXT();
+    HANDLER(POP)
+        sp--;
+        NEXT();
+    HANDLER(DUP)
+        stack[sp + 1] = stack[sp];
+        ++sp;
+        NEXT();
+    HANDLER(SWAP)
+    {
+        Slot_t v = stack[sp];
+        stack[sp] = stack[sp - 1];
+        stack[sp - 1] = v;
+    }
+        NEXT();
+
+    HANDLER(IADD)
+        BINARY(int32_t, i, makeI, (int32_t)((uint32_t)a + (uint32_t)b));
+        NEXT();
+    HANDLER(ISUB)
+        BINARY(int32_t, i, makeI, (int32_t)((uint32_t)a - (uint32_t)b));
+        NEXT();
+    HANDLER(IMUL)
+        BINARY(int32_t, i, makeI, (int32_t)((uint32_t)a * (uint32_t)b));
+        NEXT();
+    HANDLER(IDIV)
+        BINARY(int32_t, i, makeI, java_idiv(a, b));
+        NEXT();
+    HANDLER(IREM)
+        BINARY(int32_t, i, makeI, java_irem(a, b));
+        NEXT();
+    HANDLER(ISHL)
+        SHIFT(int32_t, i, makeI, (int32_t)((uint32_t)a << (b & 0x1f)));
+        NEXT();
+    HANDLER(ISHR)
+        SHIFT(int32_t, i, makeI, a >> (b & 0x1f));
+        NEXT();
+    HANDLER(IUSHR)
+        SHIFT(int32_t, i, makeI, (int32_t)((uint32_t)a >> (b & 0x1f)));
+        NEXT();
+    HANDLER(IAND)
+        BINARY(int32_t, i, makeI, a & b);
+        NEXT();
+    HANDLER(IOR)
+        BINARY(int32_t, i, makeI, a | b);
+        NEXT();
+    HANDLER(IXOR)
+        BINARY(int32_t, i, makeI, a ^ b);
+        NEXT();
+
+    HANDLER(LADD)
+        BINARY(int64_t, l, makeL, (int64_t)((uint64_t)a + (uint64_t)b));
+        NEXT();
+    HANDLER(LSUB)
+        BINARY(int64_t, l, makeL, (int64_t)((uint64_t)a - (uint64_t)b));
+        NEXT();
+    HANDLER(LMUL)
+        BINARY(int64_t, l, makeL, (int64_t)((uint64_t)a * (uint64_t)b));
+        NEXT();
+    HANDLER(LDIV)
+        BINARY(int64_t, l, makeL, java_ldiv(a, b));
+        NEXT();
+    HANDLER(LREM)
+        BINARY(int64_t, l, makeL, java_lrem(a, b));
+        NEXT();
+    HANDLER(LSHL)
+        SHIFT(int64_t, l, makeL, (int64_t)((uint64_t)a << (b & 0x3f)));
+        NEXT();
+    HANDLER(LSHR)
+        SHIFT(int64_t, l, makeL, a >> (b & 0x3f));
+        NEXT();
+    HANDLER(LUSHR)
+        SHIFT(int64_t, l, makeL, (int64_t)((uint64_t)a >> (b & 0x3f)));
+        NEXT();
+    HANDLER(LAND)
+        BINARY(int64_t, l, makeL, a & b);
+        NEXT();
+    HANDLER(LOR)
+        BINARY(int64_t, l, makeL, a | b);
+        NEXT();
+    HANDLER(LXOR)
+        BINARY(int64_t, l, makeL, a ^ b);
+        NEXT();
+
+    HANDLER(FADD)
+        BINARY(float, f, makeF, a + b);
+        NEXT();
+    HANDLER(FSUB)
+        BINARY(float, f, makeF, a - b);
+        NEXT();
+    HANDLER(FMUL)
+        BINARY(float, f, makeF, a * b);
+        NEXT();
+    HANDLER(FDIV)
+        BINARY(float, f, makeF, a / b);
+        NEXT();
+    HANDLER(FREM)
+        BINARY(float, f, makeF, fmodf(a, b));
+        NEXT();
+
+    HANDLER(DADD)
+        BINARY(double, d, makeD, a + b);
+        NEXT();
+    HANDLER(DSUB)
+        BINARY(double, d, makeD, a - b);
+        NEXT();
+    HANDLER(DMUL)
+        BINARY(double, d, makeD, a * b);
+        NEXT();
+    HANDLER(DDIV)
+        BINARY(double, d, makeD, a / b);
+        NEXT();
+    HANDLER(DREM)
+        BINARY(double, d, makeD, fmod(a, b));
+        NEXT();
+
+    HANDLER(INEG)
+        stack[sp].i = (int32_t)-(uint32_t)stack[sp].i;
+        NEXT();
+    HANDLER(LNEG)
+        stack[sp].l = (int64_t)-(uint64_t)stack[sp].l;
+        NEXT();
+    HANDLER(FNEG)
+        stack[sp].f = -stack[sp].f;
+        NEXT();
+    HANDLER(DNEG)
+        stack[sp].d = -stack[sp].d;
+        NEXT();
+
+    HANDLER(I2L)
+        stack[sp] = makeL((int64_t)stack[sp].i);
+        NEXT();
+    HANDLER(I2F)
+        stack[sp] = makeF((float)stack[sp].i);
+        NEXT();
+    HANDLER(I2D)
+        stack[sp] = makeD((double)stack[sp].i);
+        NEXT();
+    HANDLER(L2I)
+        stack[sp] = makeI((int32_t)stack[sp].l);
+        NEXT();
+    HANDLER(L2F)
+        stack[sp] = makeF((float)stack[sp].l);
+        NEXT();
+    HANDLER(L2D)
+        stack[sp] = makeD((double)stack[sp].l);
+        NEXT();
+    HANDLER(F2I)
+        stack[sp] = makeI(java_d2i(stack[sp].f));
+        NEXT();
+    HANDLER(F2L)
+        stack[sp] = makeL(java_d2l(stack[sp].f));
+        NEXT();
+    HANDLER(F2D)
+        stack[sp] = makeD((double)stack[sp].f);
+        NEXT();
+    HANDLER(D2I)
+        stack[sp] = makeI(java_d2i(stack[sp].d));
+        NEXT();
+    HANDLER(D2L)
+        stack[sp] = makeL(java_d2l(stack[sp].d));
+        NEXT();
+    HANDLER(D2F)
+        stack[sp] = makeF((float)stack[sp].d);
+        NEXT();
+    HANDLER(I2B)
+        stack[sp] = makeI((int8_t)stack[sp].i);
+        NEXT();
+    HANDLER(I2C)
+        stack[sp] = makeI((uint16_t)stack[sp].i);
+        NEXT();
+    HANDLER(I2S)
+        stack[sp] = makeI((int16_t)stack[sp].i);
+        NEXT();
+
+    HANDLER(LCMP)
+        COMPARE(int64_t, l, 0);
+        NEXT();
+    HANDLER(FCMPL)
+        COMPARE(float, f, -1);
+        NEXT();
+    HANDLER(FCMPG)
+        COMPARE(float, f, 1);
+        NEXT();
+    HANDLER(DCMPL)
+        COMPARE(double, d, -1);
+        NEXT();
+    HANDLER(DCMPG)
+        COMPARE(double, d, 1);
+        NEXT();
+
+    HANDLER(IFEQ)
+        BRANCH_IF_UNARY(==);
+    HANDLER(IFNE)
+        BRANCH_IF_UNARY(!=);
+    HANDLER(IFLT)
+        BRANCH_IF_UNARY(<);
+    HANDLER(IFGE)
+        BRANCH_IF_UNARY(>=);
+    HANDLER(IFGT)
+        BRANCH_IF_UNARY(>);
+    HANDLER(IFLE)
+        BRANCH_IF_UNARY(<=);
+    HANDLER(IF_ICMPEQ)
+        BRANCH_IF_BINARY(i, ==);
+    HANDLER(IF_ICMPNE)
+        BRANCH_IF_BINARY(i, !=);
+    HANDLER(IF_ICMPLT)
+        BRANCH_IF_BINARY(i, <);
+    HANDLER(IF_ICMPGE)
+        BRANCH_IF_BINARY(i, >=);
+    HANDLER(IF_ICMPGT)
+        BRANCH_IF_BINARY(i, >);
+    HANDLER(IF_ICMPLE)
+        BRANCH_IF_BINARY(i, <=);
+    HANDLER(IF_ACMPEQ)
+        BRANCH_IF_BINARY(a, ==);
+    HANDLER(IF_ACMPNE)
+        BRANCH_IF_BINARY(a, !=);
+    HANDLER(GOTO)
+        BRANCH_IF(1);
+
+    HANDLER(IRETURN)
+    HANDLER(LRETURN)
+    HANDLER(FRETURN)
+    HANDLER(DRETURN)
+    HANDLER(ARETURN)
+        return stack[sp];
+    HANDLER(RETURN)
+        return makeI(0);
+
+    HANDLER(GETSTATIC)
+    HANDLER(PUTSTATIC)
+    HANDLER(GETFIELD)
+    HANDLER(PUTFIELD)
+    HANDLER(NEW)
+    HANDLER(INVOKEVIRTUAL)
+    HANDLER(INVOKESPECIAL)
+    HANDLER(INVOKESTATIC)
+        quicken(ip, f->method);
+        DISPATCH();
+    HANDLER(GETSTATIC_QUICK)
+        stack[++sp] = ip->field->static_val;
+        NEXT();
+    HANDLER(PUTSTATIC_QUICK)
+        ip->field->static_val = stack[sp--];
+        NEXT();
+    HANDLER(GETFIELD_QUICK)
+        stack[sp] = get_value((uint8_t*)stack[sp].a + ip->offset, ip->type);
+        NEXT();
+    HANDLER(PUTFIELD_QUICK)
+        set_value((uint8_t*)stack[sp - 1].a + ip->offset, stack[sp], ip->type);
+        if (ip->type == A)
+            gc_write_barrier(stack[sp - 1].a);
+        sp -= 2;
+        NEXT();
+
+    HANDLER(NEW_QUICK)
+        f->ip = ip;
+        f->sp = sp;
+        stack[++sp] = makeA(alloc_object(ip->class));
+        NEXT();
+
+    HANDLER(INVOKEVIRTUAL_MONO)
+    {
+        Slot_t* args = &stack[sp - ip->nr_args + 1];
+        InlineCache_t* ic = ip->ic;
+        Method_t* m;
+        if (__builtin_expect(vtable_of(args[0].a) == ic->entries[0].vtable, 1)) {
+            ic->hits++;
+            m = ic->entries[0].target;
+        } else
+            m = ic_miss(ic, ip, args[0].a);
+        INVOKE(m, args);
+    }
+        NEXT();
+    HANDLER(INVOKEVIRTUAL_POLY)
+    {
+        Slot_t* args = &stack[sp - ip->nr_args + 1];
+        InlineCache_t* ic = ip->ic;
+        Method_t** vtable = vtable_of(args[0].a);
+        Method_t* m = NULL;
+        for (size_t i = 0; i < ic->nr_entries; ++i)
+            if (ic->entries[i].vtable == vtable) {
+                ic->hits++;
+                m = ic->entries[i].target;
                 break;
-            default:
-                __builtin_unreachable();
             }
-            if (branch)
-                ip += off - 3; // 3 bytes: 1 for opcode and 2 for offset
-        } break;
-        case IRETURN:
-        case LRETURN:
-        case FRETURN:
-        case DRETURN:
-        case ARETURN:
-            return stack[sp];
-        case RETURN:
-            return makeI(0);
-
-        case GETSTATIC: {
-            size_t s = u2_from_big_endian(*(uint16_t*)&code[ip]);
-            ip += 2;
-            Field_t* f = resolve_fieldref(constant_pool_list, s);
-            stack[++sp] = f->static_val;
-        } break;
-        case PUTSTATIC: {
-            size_t s = u2_from_big_endian(*(uint16_t*)&code[ip]);
-            ip += 2;
-            Field_t* f = resolve_fieldref(constant_pool_list, s);
-            f->static_val = stack[sp--];
-        } break;
-        case GETFIELD: {
-            size_t s = u2_from_big_endian(*(uint16_t*)&code[ip]);
-            ip += 2;
-            Field_t* f = resolve_fieldref(constant_pool_list, s);
-
-            void* a = (uint8_t*)stack[sp].a + f->offset;
-            stack[sp] = get_value(a, get_value_type(f->desc[0]));
-        } break;
-        case PUTFIELD: {
-            size_t s = u2_from_big_endian(*(uint16_t*)&code[ip]);
-            ip += 2;
-            Field_t* f = resolve_fieldref(constant_pool_list, s);
-
-            void* a = (uint8_t*)stack[sp - 1].a + f->offset;
-            set_value(a, stack[sp]);
-            sp -= 2;
-        } break;
-
-        case NEW: {
-            size_t s = u2_from_big_endian(*(uint16_t*)&code[ip]);
-            ip += 2;
-            Class_t* c = load_class(resolve_class(constant_pool_list, s));
-            Value_t v = makeA(malloc(c->size));
-            *(Method_t***)v.a = c->vtable;
-            stack[++sp] = v;
-        } break;
-        case INVOKEVIRTUAL: {
-            size_t s = u2_from_big_endian(*(uint16_t*)&code[ip]);
-            ip += 2;
-
-            Method_t* m = resolve_methodref(constant_pool_list, s);
-
-            struct desc_info info = parse_desc(m->desc);
-            info.nr_args++;
-
-            Value_t* args = &stack[sp - info.nr_args + 1];
-
-            // vtable lookup
-            m = (*(Method_t***)args[0].a)[m->vtable_offset];
-
-            Value_t ret = call_method(m, args, info.nr_args);
-            sp -= info.nr_args;
-            if (info.returns)
-                stack[++sp] = ret;
-        } break;
-        case INVOKESPECIAL: {
-            size_t s = u2_from_big_endian(*(uint16_t*)&code[ip]);
-            ip += 2;
-            Method_t* m = resolve_methodref(constant_pool_list, s);
-
-            struct desc_info info = parse_desc(m->desc);
-            info.nr_args++;
-
-            Value_t* args = &stack[sp - info.nr_args + 1];
-
-            Value_t ret = call_method(m, args, info.nr_args);
-            sp -= info.nr_args;
-            if (info.returns)
-                stack[++sp] = ret;
-        } break;
-        case INVOKESTATIC: {
-            size_t s = u2_from_big_endian(*(uint16_t*)&code[ip]);
-            ip += 2;
-            Method_t* m = resolve_methodref(constant_pool_list, s);
-
-            struct desc_info info = parse_desc(m->desc);
-
-            Value_t* args = &stack[sp - info.nr_args + 1];
-
-            Value_t ret = call_method(m, args, info.nr_args);
-            sp -= info.nr_args;
-            if (info.returns)
-                stack[++sp] = ret;
-        } break;
-        default:
-            errorf("unrecognised opcode 0x%x", op);
-        }
-
-        print_stack(stack, sp);
-        debugf("\n");
+        if (m == NULL)
+            m = ic_miss(ic, ip, args[0].a);
+        INVOKE(m, args);
     }
+        NEXT();
+    HANDLER(INVOKEVIRTUAL_MEGA)
+    {
+        Slot_t* args = &stack[sp - ip->nr_args + 1];
+        Method_t* m = ic_miss(ip->ic, ip, args[0].a);
+        INVOKE(m, args);
+    }
+        NEXT();
+    HANDLER(INVOKEVIRTUAL_DIRECT)
+    {
+        Slot_t* args = &stack[sp - ip->nr_args + 1];
+        ip->ic->hits++;
+        INVOKE(ip->ic->method, args);
+    }
+        NEXT();
+    HANDLER(INVOKESPECIAL_QUICK)
+    HANDLER(INVOKESTATIC_QUICK)
+    {
+        Slot_t* args = &stack[sp - ip->nr_args + 1];
+        INVOKE(ip->method, args);
+    }
+        NEXT();
+
+    // superinstructions, operands are read from the rest of the fused sequence
+    HANDLER(ILOAD_ILOAD)
+        stack[sp + 1] = locals[ip->index];
+        stack[sp + 2] = locals[ip[1].index];
+        sp += 2;
+        ip += 2;
+        DISPATCH();
+    HANDLER(ILOAD_ILOAD_IADD)
+        stack[++sp] = makeI((int32_t)((uint32_t)locals[ip->index].i + (uint32_t)locals[ip[1].index].i));
+        ip += 3;
+        DISPATCH();
+    HANDLER(ILOAD_ICONST_IADD_ISTORE)
+        locals[ip[3].index] = makeI((int32_t)((uint32_t)locals[ip->index].i + (uint32_t)ip[1].i));
+        ip += 4;
+        DISPATCH();
+    HANDLER(ILOAD_ILOAD_IF_ICMPEQ)
+        ILOAD_ILOAD_IF_ICMP(==);
+    HANDLER(ILOAD_ILOAD_IF_ICMPNE)
+        ILOAD_ILOAD_IF_ICMP(!=);
+    HANDLER(ILOAD_ILOAD_IF_ICMPLT)
+        ILOAD_ILOAD_IF_ICMP(<);
+    HANDLER(ILOAD_ILOAD_IF_ICMPGE)
+        ILOAD_ILOAD_IF_ICMP(>=);
+    HANDLER(ILOAD_ILOAD_IF_ICMPGT)
+        ILOAD_ILOAD_IF_ICMP(>);
+    HANDLER(ILOAD_ILOAD_IF_ICMPLE)
+        ILOAD_ILOAD_IF_ICMP(<=);
+    HANDLER(ILOAD_ICONST_IF_ICMPEQ)
+        ILOAD_ICONST_IF_ICMP(==);
+    HANDLER(ILOAD_ICONST_IF_ICMPNE)
+        ILOAD_ICONST_IF_ICMP(!=);
+    HANDLER(ILOAD_ICONST_IF_ICMPLT)
+        ILOAD_ICONST_IF_ICMP(<);
+    HANDLER(ILOAD_ICONST_IF_ICMPGE)
+        ILOAD_ICONST_IF_ICMP(>=);
+    HANDLER(ILOAD_ICONST_IF_ICMPGT)
+        ILOAD_ICONST_IF_ICMP(>);
+    HANDLER(ILOAD_ICONST_IF_ICMPLE)
+        ILOAD_ICONST_IF_ICMP(<=);
+    HANDLER(ALOAD_GETFIELD)
+        // the GETFIELD may already have been quickened by a branch into the sequence
+        if (ip[1].op == GETFIELD)
+            quicken(&ip[1], f->method);
+        ip->op = ALOAD_GETFIELD_QUICK;
+        DISPATCH();
+    HANDLER(ALOAD_GETFIELD_QUICK)
+        stack[++sp] = get_value((uint8_t*)locals[ip->index].a + ip[1].offset, ip[1].type);
+        ip += 2;
+        DISPATCH();
+
+#ifndef THREADED_DISPATCH
+    default:
+        goto unrecognised;
+    }
+#endif
+unrecognised:
+    errorf("unrecognised opcode 0x%x", ip->op);
 }
+#pragma GCC diagnostic pop
 
 int main(int argc, char** argv)
 {
     struct cmd_args cmd_args = parse_cmd_args(argc, argv);
 
+#ifdef JIT
+    jit_enabled = !cmd_args.no_jit;
+    opt_enabled = !cmd_args.no_opt;
+    jit_threshold = cmd_args.jit_threshold;
+    opt_threshold = cmd_args.opt_threshold;
+    osr_threshold = cmd_args.osr_threshold;
+#endif
+    thread_init(&main_thread, cmd_args.stack_size);
+    gc_init(cmd_args.heap_size, cmd_args.young_size, cmd_args.tlab_size, cmd_args.promotion_age);
     load_init();
 
-    Class_t* c = load_class(cmd_args.main_class);
-    Method_t* main_method = get_method(c, "main", "()V");
+    Class_t* c = load_class(intern(cmd_args.main_class));
+    Method_t* main_method = get_method(c, intern("main"), intern("()V"));
 
     call_method(main_method, NULL, 0);
 
+    if (cmd_args.ic_stats)
+        ic_print_stats();
+    if (cmd_args.gc_stats)
+        gc_print_stats();
+#ifdef INSN_PROFILE
+    print_insn_profile();
+#endif
+
     load_end();
+    ic_end();
+    cha_end();
+    gc_end();
+    thread_end(&main_thread);
 
     return 0;
 }
@@ -1,22 +1,115 @@
 #include "loader.h"
 #include "native.h"
+#include "symbol.h"
+#include "util.h"
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+    char const* classname;
+    char const* name;
+    char const* desc;
+    NativeFn fn;
+} Native_t;
+
+// open addressing, linear probing
+static struct {
+    size_t nr, cap;
+    Native_t* list;
+} natives = { 0, 0, NULL };
+
+static size_t hash_native(char const* classname, char const* name, char const* desc)
+{
+    return (symbol_hash(classname) * 31 + symbol_hash(name)) * 31 + symbol_hash(desc);
+}
+
+static Native_t* find_slot(Native_t* list, size_t cap, char const* classname, char const* name, char const* desc)
+{
+    size_t i = hash_native(classname, name, desc) & (cap - 1);
+    while (list[i].fn != NULL && (list[i].name != name || list[i].desc != desc || list[i].classname != classname))
+        i = (i + 1) & (cap - 1);
+    return &list[i];
+}
+
+void register_native(char const* classname, char const* name, char const* desc, NativeFn fn)
+{
+    if (2 * (natives.nr + 1) > natives.cap) {
+        size_t cap = (natives.cap == 0 ? 16 : 2 * natives.cap);
+        Native_t* list = calloc(cap, sizeof(list[0]));
+        for (size_t i = 0; i < natives.cap; ++i)
+            if (natives.list[i].fn != NULL)
+                *find_slot(list, cap, natives.list[i].classname, natives.list[i].name, natives.list[i].desc) = natives.list[i];
+        free(natives.list);
+        natives.list = list;
+        natives.cap = cap;
+    }
+    classname = intern(classname);
+    name = intern(name);
+    desc = intern(desc);
+    Native_t* slot = find_slot(natives.list, natives.cap, classname, name, desc);
+    if (slot->fn == NULL)
+        natives.nr++;
+    *slot = (Native_t) { classname, name, desc, fn };
+}
+
+NativeFn find_native(char const* classname, char const* name, char const* desc)
+{
+    if (natives.cap == 0)
+        return NULL;
+    return find_slot(natives.list, natives.cap, classname, name, desc)->fn;
+}
+
+void bind_natives(Class_t* c)
+{
+    for (size_t i = 0; i < c->methods.size; ++i) {
+        Method_t* m = &c->methods.list[i];
+        if (!(m->flags & ACC_NATIVE))
+            continue;
+        m->native = find_native(c->name, m->name, m->desc);
+        if (m->native == NULL)
+            errorf("java/lang/UnsatisfiedLinkError: %s.%s%s", c->name, m->name, m->desc);
+    }
+}
 
 struct java_io_PrintStream_object {
-    Method_t** vtable;
+    Header_t header;
     FILE* f;
 };
-void native_println_I(void* a, int32_t i)
+static Slot_t java_io_PrintStream_println_I(Slot_t const* args)
+{
+    FILE* f = ((struct java_io_PrintStream_object*)args[0].a)->f;
+    fprintf(f, "%d\n", args[1].i);
+    return (Slot_t) { 0 };
+}
+static Slot_t java_io_PrintStream_println_D(Slot_t const* args)
 {
-    FILE* f = ((struct java_io_PrintStream_object*)a)->f;
-    fprintf(f, "%d\n", i);
+    FILE* f = ((struct java_io_PrintStream_object*)args[0].a)->f;
+    fprintf(f, "%lf\n", args[1].d);
+    return (Slot_t) { 0 };
+}
+
+static Slot_t java_lang_Object_init(Slot_t const* args)
+{
+    return (Slot_t) { 0 };
+}
+
+void native_init(void)
+{
+    static Native_t const builtins[] = {
+        { "java/lang/Object", "<init>", "()V", java_lang_Object_init },
+        { "java/io/PrintStream", "println", "(I)V", java_io_PrintStream_println_I },
+        { "java/io/PrintStream", "println", "(D)V", java_io_PrintStream_println_D },
+    };
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i)
+        register_native(builtins[i].classname, builtins[i].name, builtins[i].desc, builtins[i].fn);
 }
-void native_println_D(void* a, double d)
+void native_end(void)
 {
-    FILE* f = ((struct java_io_PrintStream_object*)a)->f;
-    fprintf(f, "%lf\n", d);
+    free(natives.list);
+    natives.list = NULL;
+    natives.nr = natives.cap = 0;
 }
 
 void init_java_lang_Object(Class_t* c)
@@ -26,16 +119,21 @@ void init_java_lang_Object(Class_t* c)
         .name = "<init>",
         .desc = "()V",
     };
+    init.name = intern(init.name);
+    init.desc = intern(init.desc);
     init.c = c;
+    parse_signature(&init);
 
-    static Method_t* vtable[] = { NULL };
+    // preceded by the class, as for loaded classes
+    static Method_t* vtable[] = { NULL, NULL };
+    vtable[0] = (Method_t*)c;
 
     Class_t java_lang_Object = {
         .constant_pool = { 0, NULL },
-        .name = "java/lang/Object",
+        .name = intern("java/lang/Object"),
         .super = NULL,
         .flags = 0,
-        .size = sizeof(&vtable[0]),
+        .size = sizeof(Header_t),
         .interfaces = { 0, NULL },
         .fields = {
             0,
@@ -43,11 +141,12 @@ void init_java_lang_Object(Class_t* c)
         },
         .methods = { 1, &init },
 
-        .vtable = &vtable[0],
+        .vtable = &vtable[1],
 
         .source_file = NULL,
     };
     *c = java_lang_Object;
+    register_class(c);
 }
 void init_java_io_PrintStream(Class_t* c)
 {
@@ -70,35 +169,40 @@ void init_java_io_PrintStream(Class_t* c)
             .vtable_offset = 1,
         }
     };
-    methods[0].c = c;
-    methods[1].c = c;
-    methods[2].c = c;
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); ++i) {
+        methods[i].name = intern(methods[i].name);
+        methods[i].desc = intern(methods[i].desc);
+        methods[i].c = c;
+        parse_signature(&methods[i]);
+    }
 
-    static Method_t* vtable[] = { &methods[1], &methods[2], NULL };
+    static Method_t* vtable[] = { NULL, &methods[1], &methods[2], NULL };
+    vtable[0] = (Method_t*)c;
 
     Class_t java_io_PrintStream = {
         .constant_pool = { 0, NULL },
-        .name = "java/io/PrintStream",
+        .name = intern("java/io/PrintStream"),
         .super = NULL,
         .flags = 0,
-        .size = sizeof(&vtable[0]),
+        .size = sizeof(struct java_io_PrintStream_object),
         .interfaces = { 0, NULL },
         .fields = { 0, NULL },
         .methods = { sizeof(methods) / sizeof(methods[0]), methods },
 
-        .vtable = &vtable[0],
+        .vtable = &vtable[1],
 
         .source_file = NULL,
     };
     *c = java_io_PrintStream;
+    register_class(c);
 }
 void init_java_lang_System(Class_t* c)
 {
-    Class_t* java_io_PrintStream = load_class("java/io/PrintStream");
+    Class_t* java_io_PrintStream = load_class(intern("java/io/PrintStream"));
     static struct java_io_PrintStream_object out = { 0 }, err = { 0 };
-    out.vtable = java_io_PrintStream->vtable;
+    out.header = java_io_PrintStream->header;
     out.f = stdout;
-    err.vtable = java_io_PrintStream->vtable;
+    err.header = java_io_PrintStream->header;
     err.f = stderr;
 
     static Field_t streams[] = {
@@ -113,17 +217,22 @@ void init_java_lang_System(Class_t* c)
             .desc = "Ljava/io/PrintStream;",
         }
     };
-    streams[0].static_val = (Value_t) { .type = A, .a = &out };
-    streams[1].static_val = (Value_t) { .type = A, .a = &err };
+    for (size_t i = 0; i < sizeof(streams) / sizeof(streams[0]); ++i) {
+        streams[i].name = intern(streams[i].name);
+        streams[i].desc = intern(streams[i].desc);
+    }
+    streams[0].static_val = makeA(&out);
+    streams[1].static_val = makeA(&err);
 
-    Method_t* vtable[] = { NULL };
+    static Method_t* vtable[] = { NULL, NULL };
+    vtable[0] = (Method_t*)c;
 
     Class_t java_lang_System = {
         .constant_pool = { 0, NULL },
-        .name = "java/lang/System",
+        .name = intern("java/lang/System"),
         .super = NULL,
         .flags = 0,
-        .size = sizeof(&vtable[0]),
+        .size = sizeof(Header_t),
         .interfaces = { 0, NULL },
         .fields = {
             sizeof(streams) / sizeof(streams[0]),
@@ -131,9 +240,10 @@ void init_java_lang_System(Class_t* c)
         },
         .methods = { 0, NULL },
 
-        .vtable = &vtable[0],
+        .vtable = &vtable[1],
 
         .source_file = NULL,
     };
     *c = java_lang_System;
+    register_class(c);
 }
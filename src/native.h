@@ -10,7 +10,19 @@ void init_java_io_PrintStream(Class_t* c);
 // load java/lang/System AFTER java/io/PrintStream as former depends on latter
 void init_java_lang_System(Class_t* c);
 
-void native_println_I(void* a, int32_t i);
-void native_println_D(void* a, double d);
+/*
+ * Natives are looked up by class name, method name and descriptor when a
+ * class is loaded, and bound to their Method_t so that a call is a single
+ * indirect call. Register them from native_init() before any class loads.
+ * register_native() interns its names, find_native() takes symbols (see
+ * symbol.h).
+ */
+void register_native(char const* classname, char const* name, char const* desc, NativeFn fn);
+NativeFn find_native(char const* classname, char const* name, char const* desc);
+// bind every ACC_NATIVE method of c, failing if one has no registered implementation
+void bind_natives(Class_t* c);
+
+void native_init(void);
+void native_end(void);
 
 #endif // NATIVE_H
@@ -0,0 +1,46 @@
+#include "class.h"
+#include "inline_cache.h"
+#include "opcode.h"
+#include "quicken.h"
+#include "util.h"
+
+void quicken(Insn_t* insn, Method_t const* caller)
+{
+    Const_t* constant_pool_list = caller->c->constant_pool.list;
+    switch (insn->op) {
+    case GETSTATIC:
+    case PUTSTATIC:
+        insn->field = resolve_fieldref(constant_pool_list, insn->index);
+        insn->op = (insn->op == GETSTATIC ? GETSTATIC_QUICK : PUTSTATIC_QUICK);
+        break;
+    case GETFIELD:
+    case PUTFIELD: {
+        Field_t* f = resolve_fieldref(constant_pool_list, insn->index);
+        insn->offset = f->offset;
+        insn->type = get_value_type(f->desc[0]);
+        insn->op = (insn->op == GETFIELD ? GETFIELD_QUICK : PUTFIELD_QUICK);
+    } break;
+    case NEW:
+        insn->class = resolve_class(constant_pool_list, insn->index);
+        insn->op = NEW_QUICK;
+        break;
+    case INVOKEVIRTUAL: {
+        Method_t* m = resolve_methodref(constant_pool_list, insn->index);
+        insn->ic = ic_new(m, caller, insn);
+        insn->nr_args = m->sig.nr_args;
+        insn->returns = m->sig.returns;
+        // a target no loaded class overrides is called directly, otherwise an empty monomorphic cache misses and fills itself on first use
+        insn->op = (m->overridden ? INVOKEVIRTUAL_MONO : INVOKEVIRTUAL_DIRECT);
+    } break;
+    case INVOKESPECIAL:
+    case INVOKESTATIC: {
+        Method_t* m = resolve_methodref(constant_pool_list, insn->index);
+        insn->method = m;
+        insn->nr_args = m->sig.nr_args;
+        insn->returns = m->sig.returns;
+        insn->op = (insn->op == INVOKESPECIAL ? INVOKESPECIAL_QUICK : INVOKESTATIC_QUICK);
+    } break;
+    default:
+        panicf("cannot quicken opcode 0x%x", insn->op);
+    }
+}
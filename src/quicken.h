@@ -0,0 +1,13 @@
+#ifndef QUICKEN_H
+#define QUICKEN_H
+
+#include "class.h"
+
+/*
+ * Resolve the constant pool reference of insn, which belongs to caller, and
+ * rewrite it in place into its quick form: GETSTATIC, PUTSTATIC, GETFIELD,
+ * PUTFIELD, NEW, INVOKEVIRTUAL, INVOKESPECIAL and INVOKESTATIC.
+ */
+void quicken(Insn_t* insn, Method_t const* caller);
+
+#endif // QUICKEN_H
@@ -0,0 +1,65 @@
+#include "refmap.h"
+#include "opcode.h"
+#include "typeflow.h"
+#include "util.h"
+
+#include <stdlib.h>
+
+static int may_collect(enum opcode op)
+{
+    switch (op) {
+    case NEW:
+    case INVOKEVIRTUAL:
+    case INVOKESPECIAL:
+    case INVOKESTATIC:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static size_t map_words(Method_t const* m)
+{
+    return (m->max_locals + m->max_stack + 31) / 32;
+}
+
+void build_ref_maps(Method_t* m)
+{
+    size_t nr = 0;
+    for (size_t i = 0; i < m->nr_insns; ++i)
+        if ((i == 0 || may_collect(m->insns[i].op)) && m->stack_depth[i] != DEPTH_UNREACHED)
+            nr++;
+
+    size_t words = map_words(m);
+    m->ref_maps.size = nr;
+    m->ref_maps.pcs = arena_calloc(&class_metadata, nr, sizeof(m->ref_maps.pcs[0]));
+    m->ref_maps.bits = arena_calloc(&class_metadata, nr * words, sizeof(m->ref_maps.bits[0]));
+
+    size_t j = 0;
+    for (size_t i = 0; i < m->nr_insns; ++i) {
+        Insn_t const* insn = &m->insns[i];
+        if ((i != 0 && !may_collect(insn->op)) || m->stack_depth[i] == DEPTH_UNREACHED)
+            continue;
+        uint32_t* map = &m->ref_maps.bits[j * words];
+        uint8_t const* types = local_types_at(m, insn);
+        for (size_t s = 0; s < m->max_locals + m->stack_depth[i]; ++s)
+            if (types[s] == A)
+                map[s / 32] |= (uint32_t)1 << (s % 32);
+        m->ref_maps.pcs[j++] = insn->pc;
+    }
+}
+
+uint32_t const* ref_map_at(Method_t const* m, uint16_t pc)
+{
+    size_t lo = 0, hi = m->ref_maps.size;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (m->ref_maps.pcs[mid] < pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == m->ref_maps.size || m->ref_maps.pcs[lo] != pc)
+        panicf("no reference map at pc %u of %s.%s", pc, m->c->name, m->name);
+    return &m->ref_maps.bits[lo * map_words(m)];
+}
@@ -0,0 +1,26 @@
+#ifndef REFMAP_H
+#define REFMAP_H
+
+#include "class.h"
+
+#include <stdint.h>
+
+/*
+ * Reference maps say which locals and operand stack slots of a frame hold
+ * references, one bit per slot: the locals, then the stack from its bottom.
+ * A method gets one for its entry and one for each instruction a collection
+ * may happen at (allocations and calls), keyed by bytecode offset. They are
+ * built from the slot types at load time, so finding the roots of a frame
+ * needs neither tagged slots nor a walk of its code.
+ */
+void build_ref_maps(Method_t* m);
+
+// the map at the instruction at pc, which must have one
+uint32_t const* ref_map_at(Method_t const* m, uint16_t pc);
+
+static inline int ref_map_test(uint32_t const* map, size_t slot)
+{
+    return (map[slot / 32] >> (slot % 32)) & 1;
+}
+
+#endif // REFMAP_H
@@ -0,0 +1,267 @@
+#include "regalloc.h"
+#include "ir.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    uint32_t v;
+    int start, end; // positions
+    int crosses_call;
+    int crosses_safepoint;
+} Interval_t;
+
+typedef struct {
+    IrFunc_t* f;
+    size_t words; // per bitset
+    uint64_t* live_in; // per block
+    int* pos; // of each value
+    int* block_start;
+    int* block_end;
+} Live_t;
+
+static int has_location(IrInsn_t const* insn)
+{
+    return insn->type != IR_VOID && insn->op != IR_CONST;
+}
+static uint64_t* bits_of(Live_t* l, uint64_t* sets, uint32_t b)
+{
+    return &sets[b * l->words];
+}
+static void set_bit(uint64_t* set, uint32_t v)
+{
+    set[v / 64] |= 1ull << (v % 64);
+}
+static void clear_bit(uint64_t* set, uint32_t v)
+{
+    set[v / 64] &= ~(1ull << (v % 64));
+}
+
+// values live at the end of b: live into a successor or feeding one of its phis from b
+static void live_out(Live_t* l, uint32_t b, uint64_t* out)
+{
+    IrFunc_t* f = l->f;
+    memset(out, 0, sizeof(out[0]) * l->words);
+    IrBlock_t const* block = &f->blocks[b];
+    for (size_t s = 0; s < block->nr_succs; ++s) {
+        IrBlock_t const* succ = &f->blocks[block->succs[s]];
+        uint64_t const* in = bits_of(l, l->live_in, block->succs[s]);
+        for (size_t w = 0; w < l->words; ++w)
+            out[w] |= in[w];
+        size_t p = 0;
+        while (succ->preds[p] != b)
+            p++;
+        for (size_t n = 0; n < succ->nr_insns && f->insns[succ->insns[n]].op == IR_PHI; ++n) {
+            uint32_t a = ir_arg(f, &f->insns[succ->insns[n]], p);
+            if (has_location(&f->insns[a]))
+                set_bit(out, a);
+        }
+    }
+}
+
+static void compute_liveness(Live_t* l)
+{
+    IrFunc_t* f = l->f;
+    uint64_t* live = malloc(sizeof(live[0]) * l->words);
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (size_t k = f->nr_order; k-- > 0;) {
+            uint32_t b = f->order[k];
+            IrBlock_t const* block = &f->blocks[b];
+            live_out(l, b, live);
+            for (size_t n = block->nr_insns; n-- > 0;) {
+                uint32_t v = block->insns[n];
+                IrInsn_t const* insn = &f->insns[v];
+                clear_bit(live, v);
+                if (insn->op == IR_PHI)
+                    continue;
+                for (size_t a = 0; a < insn->nr_args; ++a)
+                    if (has_location(&f->insns[ir_arg(f, insn, a)]))
+                        set_bit(live, ir_arg(f, insn, a));
+            }
+            uint64_t* in = bits_of(l, l->live_in, b);
+            if (memcmp(in, live, sizeof(live[0]) * l->words) != 0) {
+                memcpy(in, live, sizeof(live[0]) * l->words);
+                changed = 1;
+            }
+        }
+    }
+    free(live);
+}
+
+static void extend(Interval_t* iv, int pos)
+{
+    if (pos < iv->start)
+        iv->start = pos;
+    if (pos > iv->end)
+        iv->end = pos;
+}
+
+static int by_start(void const* a, void const* b)
+{
+    Interval_t const* x = a;
+    Interval_t const* y = b;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+void ir_allocate_registers(IrFunc_t* f, RegInfo_t const* ri)
+{
+    Live_t l = { .f = f, .words = (f->nr_insns + 63) / 64 };
+    l.live_in = calloc(f->nr_blocks * l.words, sizeof(l.live_in[0]));
+    l.pos = malloc(sizeof(l.pos[0]) * f->nr_insns);
+    l.block_start = malloc(sizeof(l.block_start[0]) * f->nr_blocks);
+    l.block_end = malloc(sizeof(l.block_end[0]) * f->nr_blocks);
+
+    // number the instructions along the linear order, phis at the start of their block
+    int* calls = malloc(sizeof(calls[0]) * f->nr_insns);
+    size_t nr_calls = 0;
+    int* safepoints = malloc(sizeof(safepoints[0]) * f->nr_insns);
+    size_t nr_safepoints = 0;
+    int pos = 0;
+    for (size_t k = 0; k < f->nr_order; ++k) {
+        uint32_t b = f->order[k];
+        IrBlock_t const* block = &f->blocks[b];
+        l.block_start[b] = pos;
+        pos += 2;
+        for (size_t n = 0; n < block->nr_insns; ++n) {
+            uint32_t v = block->insns[n];
+            if (f->insns[v].op == IR_PHI) {
+                l.pos[v] = l.block_start[b];
+                continue;
+            }
+            l.pos[v] = pos;
+            if (ri->is_call(f, &f->insns[v]))
+                calls[nr_calls++] = pos;
+            if (ri->is_safepoint(f, &f->insns[v]))
+                safepoints[nr_safepoints++] = pos;
+            pos += 2;
+        }
+        l.block_end[b] = pos;
+        pos += 2;
+    }
+    compute_liveness(&l);
+
+    Interval_t* ivs = malloc(sizeof(ivs[0]) * f->nr_insns);
+    uint32_t* iv_of = malloc(sizeof(iv_of[0]) * f->nr_insns);
+    size_t nr_ivs = 0;
+    for (uint32_t v = 0; v < f->nr_insns; ++v)
+        iv_of[v] = IR_NONE;
+    for (size_t k = 0; k < f->nr_order; ++k) {
+        IrBlock_t const* block = &f->blocks[f->order[k]];
+        for (size_t n = 0; n < block->nr_insns; ++n) {
+            uint32_t v = block->insns[n];
+            if (!has_location(&f->insns[v]))
+                continue;
+            iv_of[v] = nr_ivs;
+            ivs[nr_ivs++] = (Interval_t) { .v = v, .start = INT_MAX, .end = -1 };
+        }
+    }
+
+    uint64_t* out = malloc(sizeof(out[0]) * l.words);
+    for (size_t k = 0; k < f->nr_order; ++k) {
+        uint32_t b = f->order[k];
+        IrBlock_t const* block = &f->blocks[b];
+        uint64_t const* in = bits_of(&l, l.live_in, b);
+        live_out(&l, b, out);
+        for (uint32_t v = 0; v < f->nr_insns; ++v) {
+            if (iv_of[v] == IR_NONE)
+                continue;
+            if (in[v / 64] >> (v % 64) & 1)
+                extend(&ivs[iv_of[v]], l.block_start[b]);
+            if (out[v / 64] >> (v % 64) & 1)
+                extend(&ivs[iv_of[v]], l.block_end[b]);
+        }
+        for (size_t n = 0; n < block->nr_insns; ++n) {
+            uint32_t v = block->insns[n];
+            IrInsn_t const* insn = &f->insns[v];
+            if (iv_of[v] != IR_NONE)
+                extend(&ivs[iv_of[v]], l.pos[v]);
+            if (insn->op == IR_PHI)
+                continue;
+            for (size_t a = 0; a < insn->nr_args; ++a)
+                if (iv_of[ir_arg(f, insn, a)] != IR_NONE)
+                    extend(&ivs[iv_of[ir_arg(f, insn, a)]], l.pos[v]);
+        }
+    }
+    free(out);
+
+    // operands of a call must survive it too, as the call sequence may clobber registers before reading them
+    for (size_t i = 0; i < nr_ivs; ++i)
+        for (size_t c = 0; c < nr_calls && !ivs[i].crosses_call; ++c)
+            ivs[i].crosses_call = (ivs[i].start < calls[c] && ivs[i].end >= calls[c]);
+    // only values still needed after a safepoint, its operands are read before the collector runs
+    for (size_t i = 0; i < nr_ivs; ++i)
+        for (size_t p = 0; p < nr_safepoints && !ivs[i].crosses_safepoint; ++p)
+            ivs[i].crosses_safepoint = (ivs[i].start < safepoints[p] && ivs[i].end > safepoints[p]);
+    qsort(ivs, nr_ivs, sizeof(ivs[0]), by_start);
+
+    f->locs = realloc(f->locs, sizeof(f->locs[0]) * f->nr_insns);
+    for (uint32_t v = 0; v < f->nr_insns; ++v)
+        f->locs[v] = (IrLoc_t) { .reg = -1, .spill = -1 };
+    f->nr_spills = 0;
+
+    Interval_t** active = malloc(sizeof(active[0]) * (nr_ivs + 1));
+    size_t nr_active = 0;
+    uint32_t used[2] = { 0, 0 };
+    for (size_t i = 0; i < nr_ivs; ++i) {
+        Interval_t* iv = &ivs[i];
+        int class = ir_class(f->insns[iv->v].type);
+
+        size_t kept = 0;
+        for (size_t a = 0; a < nr_active; ++a) {
+            if (active[a]->end < iv->start) {
+                int c = ir_class(f->insns[active[a]->v].type);
+                used[c] &= ~(1u << f->locs[active[a]->v].reg);
+            } else
+                active[kept++] = active[a];
+        }
+        nr_active = kept;
+
+        uint32_t allowed = (iv->crosses_call ? ri->preserved[class] : ~0u);
+        if (iv->crosses_safepoint && f->insns[iv->v].type == A)
+            allowed = 0;
+        int reg = -1;
+        // registers calls clobber first when they can be, as the others must be saved
+        for (int pass = 0; pass < 2 && reg < 0; ++pass)
+            for (size_t r = 0; r < ri->nr_regs[class] && reg < 0; ++r) {
+                int candidate = ri->regs[class][r];
+                int preserved = ri->preserved[class] >> candidate & 1;
+                if ((allowed >> candidate & 1) && !(used[class] >> candidate & 1) && preserved == pass)
+                    reg = candidate;
+            }
+
+        if (reg < 0) {
+            // spill whichever of iv and the intervals holding a register it may use lives longest
+            Interval_t** victim = NULL;
+            for (size_t a = 0; a < nr_active; ++a) {
+                Interval_t* other = active[a];
+                if (ir_class(f->insns[other->v].type) != class || !(allowed >> f->locs[other->v].reg & 1))
+                    continue;
+                if (victim == NULL || other->end > (*victim)->end)
+                    victim = &active[a];
+            }
+            if (victim == NULL || (*victim)->end <= iv->end) {
+                f->locs[iv->v].spill = f->nr_spills++;
+                continue;
+            }
+            reg = f->locs[(*victim)->v].reg;
+            f->locs[(*victim)->v] = (IrLoc_t) { .reg = -1, .spill = f->nr_spills++ };
+            *victim = active[--nr_active];
+        }
+
+        f->locs[iv->v].reg = reg;
+        used[class] |= 1u << reg;
+        active[nr_active++] = iv;
+    }
+
+    free(active);
+    free(ivs);
+    free(iv_of);
+    free(calls);
+    free(safepoints);
+    free(l.live_in);
+    free(l.pos);
+    free(l.block_start);
+    free(l.block_end);
+}
@@ -0,0 +1,30 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "ir.h"
+
+#include <stdint.h>
+
+// what the target offers, per register class (see ir_class())
+typedef struct {
+    uint8_t nr_regs[2];
+    uint8_t const* regs[2]; // allocatable registers, in order of preference
+    uint32_t preserved[2]; // mask of the registers calls preserve
+    // whether insn is compiled into a call, clobbering the registers calls do not preserve
+    int (*is_call)(IrFunc_t const* f, IrInsn_t const* insn);
+    // whether the collector may run during insn, moving the objects references point to
+    int (*is_safepoint)(IrFunc_t const* f, IrInsn_t const* insn);
+} RegInfo_t;
+
+/*
+ * Linear scan register allocation (Poletto and Sarkar) over f->order, filling
+ * in f->locs and f->nr_spills. Every value gets one location for its whole
+ * life, which is a register or a spill slot. Values live across a call only
+ * get registers calls preserve, and references live across a safepoint are
+ * always spilled, for the collector to find and update them in the frame.
+ * Constants get no location, the code generator materialises them where they
+ * are used.
+ */
+void ir_allocate_registers(IrFunc_t* f, RegInfo_t const* ri);
+
+#endif // REGALLOC_H
@@ -0,0 +1,168 @@
+#include "class.h"
+#include "opcode.h"
+#include "superinsn.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef INSN_PROFILE
+
+    #define PROFILE_SIZE (1 << 16)
+    #define PROFILE_TOP 30
+
+/*
+ * Dynamic counts of straight-line opcode sequences of 2 to SUPERINSN_MAX_LEN
+ * instructions, by original opcode. A sequence is broken by any taken branch,
+ * call or return, i.e. whenever the next instruction is not the one right
+ * after the previous.
+ */
+typedef struct {
+    uint8_t len;
+    uint8_t ops[SUPERINSN_MAX_LEN];
+    uint64_t count;
+} SeqCount_t;
+
+static SeqCount_t profile[PROFILE_SIZE];
+static uint8_t history[SUPERINSN_MAX_LEN];
+static size_t history_len = 0;
+static Insn_t const* last_ip = NULL;
+
+static void count_seq(uint8_t const* ops, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i)
+        h = (h ^ ops[i]) * 16777619u;
+    for (size_t i = h % PROFILE_SIZE;; i = (i + 1) % PROFILE_SIZE) {
+        SeqCount_t* s = &profile[i];
+        if (s->len == 0) {
+            s->len = len;
+            memcpy(s->ops, ops, len);
+        }
+        if (s->len == len && memcmp(s->ops, ops, len) == 0) {
+            s->count++;
+            return;
+        }
+    }
+}
+
+void profile_insn(Method_t const* m, Insn_t const* ip)
+{
+    // redispatch of a freshly quickened instruction
+    if (ip == last_ip)
+        return;
+    if (ip != last_ip + 1)
+        history_len = 0;
+    last_ip = ip;
+
+    if (history_len == SUPERINSN_MAX_LEN) {
+        memmove(history, history + 1, SUPERINSN_MAX_LEN - 1);
+        history_len--;
+    }
+    history[history_len++] = m->code[ip->pc];
+    for (size_t len = 2; len <= history_len; ++len)
+        count_seq(&history[history_len - len], len);
+}
+
+// by dispatches a fused instruction would save
+static int cmp_saved(void const* a, void const* b)
+{
+    SeqCount_t const* x = a;
+    SeqCount_t const* y = b;
+    uint64_t sx = x->count * (x->len - 1), sy = y->count * (y->len - 1);
+    return (sx < sy) - (sx > sy);
+}
+
+void print_insn_profile(void)
+{
+    qsort(profile, PROFILE_SIZE, sizeof(profile[0]), cmp_saved);
+    fprintf(stderr, "most frequent instruction sequences:\n");
+    for (size_t i = 0; i < PROFILE_TOP && profile[i].len != 0; ++i) {
+        fprintf(stderr, "  %12" PRIu64 " ", profile[i].count);
+        for (size_t k = 0; k < profile[i].len; ++k)
+            fprintf(stderr, " %s", get_string(profile[i].ops[k]));
+        fprintf(stderr, "\n");
+    }
+}
+
+#endif // INSN_PROFILE
+
+static int is_iload(Insn_t const* insn)
+{
+    return insn->op == ILOAD || (insn->op >= ILOAD_0 && insn->op <= ILOAD_3);
+}
+static int is_istore(Insn_t const* insn)
+{
+    return insn->op == ISTORE || (insn->op >= ISTORE_0 && insn->op <= ISTORE_3);
+}
+static int is_aload(Insn_t const* insn)
+{
+    return insn->op == ALOAD || (insn->op >= ALOAD_0 && insn->op <= ALOAD_3);
+}
+// any instruction pushing an int constant held in insn->i
+static int is_iconst(Insn_t const* insn)
+{
+    switch (insn->op) {
+    case ICONST_M1:
+    case ICONST_0:
+    case ICONST_1:
+    case ICONST_2:
+    case ICONST_3:
+    case ICONST_4:
+    case ICONST_5:
+    case BIPUSH:
+    case SIPUSH:
+        return 1;
+    case LDC:
+    case LDC_W:
+        return insn->type == I;
+    default:
+        return 0;
+    }
+}
+static int is_if_icmp(Insn_t const* insn)
+{
+    return insn->op >= IF_ICMPEQ && insn->op <= IF_ICMPLE;
+}
+
+/*
+ * The set below comes from `make INSN_PROFILE=on SUPERINSNS=off` runs of
+ * testdata/Main, Bench, Arith and Loop. Load/store
+ * index and constant kinds are folded together, so e.g. ILOAD_ILOAD covers
+ * every pair of int loads. Sequences are matched greedily, longest first,
+ * and never overlap.
+ */
+void fuse_superinsns(Method_t* m)
+{
+    Insn_t* insns = m->insns;
+    for (size_t i = 0; i < m->nr_insns; ++i) {
+        Insn_t* insn = &insns[i];
+        size_t left = m->nr_insns - i;
+
+        // the expanded form of i += c, as emitted when iinc is not
+        if (left >= 4 && is_iload(&insn[0]) && is_iconst(&insn[1]) && insn[2].op == IADD && is_istore(&insn[3])) {
+            insn->op = ILOAD_ICONST_IADD_ISTORE;
+            i += 3;
+        }
+        // loop conditions
+        else if (left >= 3 && is_iload(&insn[0]) && is_iload(&insn[1]) && is_if_icmp(&insn[2])) {
+            insn->op = ILOAD_ILOAD_IF_ICMPEQ + (insn[2].op - IF_ICMPEQ);
+            i += 2;
+        } else if (left >= 3 && is_iload(&insn[0]) && is_iconst(&insn[1]) && is_if_icmp(&insn[2])) {
+            insn->op = ILOAD_ICONST_IF_ICMPEQ + (insn[2].op - IF_ICMPEQ);
+            i += 2;
+        } else if (left >= 3 && is_iload(&insn[0]) && is_iload(&insn[1]) && insn[2].op == IADD) {
+            insn->op = ILOAD_ILOAD_IADD;
+            i += 2;
+        }
+        // this.x
+        else if (left >= 2 && is_aload(&insn[0]) && insn[1].op == GETFIELD) {
+            insn->op = ALOAD_GETFIELD;
+            i += 1;
+        } else if (left >= 2 && is_iload(&insn[0]) && is_iload(&insn[1])) {
+            insn->op = ILOAD_ILOAD;
+            i += 1;
+        }
+    }
+}
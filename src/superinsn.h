@@ -0,0 +1,33 @@
+#ifndef SUPERINSN_H
+#define SUPERINSN_H
+
+#include "class.h"
+#include "opcode.h"
+
+#define SUPERINSN_MAX_LEN 4
+
+/*
+ * Superinstructions replace the first instruction of a frequent sequence with
+ * a fused opcode that executes the whole sequence in one dispatch. The rest
+ * of the sequence stays in place, so the fused handler reads its operands
+ * from there and branches into the middle of a sequence still work.
+ */
+void fuse_superinsns(Method_t* m);
+
+static inline int is_superinsn(enum opcode op)
+{
+    return op >= ILOAD_ILOAD && op <= ALOAD_GETFIELD_QUICK;
+}
+// the opcode the first instruction of a fused sequence had before fusion
+static inline enum opcode unfused_op(Method_t const* m, Insn_t const* insn)
+{
+    return (is_superinsn(insn->op) ? m->code[insn->pc] : insn->op);
+}
+
+#ifdef INSN_PROFILE
+// record the dispatch of ip, used to pick the set of superinstructions
+void profile_insn(Method_t const* m, Insn_t const* ip);
+void print_insn_profile(void);
+#endif
+
+#endif // SUPERINSN_H
@@ -0,0 +1,85 @@
+#include "symbol.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    size_t hash;
+    size_t len;
+    char str[];
+} Symbol_t;
+
+// open addressing, linear probing
+static struct {
+    size_t nr, cap;
+    Symbol_t** list;
+} symbols = { 0, 0, NULL };
+
+// FNV-1a
+static size_t fnv1a(char const* s, size_t len)
+{
+    size_t h = 0xcbf29ce484222325;
+    for (size_t i = 0; i < len; ++i)
+        h = (h ^ (uint8_t)s[i]) * 0x100000001b3;
+    return h;
+}
+
+static Symbol_t** find_slot(Symbol_t** list, size_t cap, size_t hash, char const* s, size_t len)
+{
+    size_t i = hash & (cap - 1);
+    while (list[i] != NULL
+        && (list[i]->hash != hash || list[i]->len != len || memcmp(list[i]->str, s, len) != 0))
+        i = (i + 1) & (cap - 1);
+    return &list[i];
+}
+
+void symbol_init(void)
+{
+    symbols.cap = 256;
+    symbols.list = calloc(symbols.cap, sizeof(symbols.list[0]));
+}
+void symbol_end(void)
+{
+    for (size_t i = 0; i < symbols.cap; ++i)
+        free(symbols.list[i]);
+    free(symbols.list);
+    symbols.list = NULL;
+    symbols.nr = symbols.cap = 0;
+}
+
+char const* intern_bytes(char const* s, size_t len)
+{
+    if (2 * (symbols.nr + 1) > symbols.cap) {
+        size_t cap = 2 * symbols.cap;
+        Symbol_t** list = calloc(cap, sizeof(list[0]));
+        for (size_t i = 0; i < symbols.cap; ++i)
+            if (symbols.list[i] != NULL)
+                *find_slot(list, cap, symbols.list[i]->hash, symbols.list[i]->str, symbols.list[i]->len) = symbols.list[i];
+        free(symbols.list);
+        symbols.list = list;
+        symbols.cap = cap;
+    }
+    size_t hash = fnv1a(s, len);
+    Symbol_t** slot = find_slot(symbols.list, symbols.cap, hash, s, len);
+    if (*slot == NULL) {
+        Symbol_t* sym = malloc(sizeof(*sym) + len + 1);
+        sym->hash = hash;
+        sym->len = len;
+        memcpy(sym->str, s, len);
+        sym->str[len] = '\0';
+        *slot = sym;
+        symbols.nr++;
+    }
+    return (*slot)->str;
+}
+char const* intern(char const* s)
+{
+    return intern_bytes(s, strlen(s));
+}
+
+size_t symbol_hash(char const* sym)
+{
+    return ((Symbol_t const*)(sym - offsetof(Symbol_t, str)))->hash;
+}
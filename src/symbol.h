@@ -0,0 +1,22 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include <stddef.h>
+
+/*
+ * Interned strings. Every class, member and descriptor name the VM keeps is
+ * a symbol, the one copy of its characters in the symbol table, so names
+ * compare equal exactly when they are the same pointer. The hash of a symbol
+ * is computed once, when it is first interned, and kept in front of it.
+ */
+void symbol_init(void);
+// free every symbol, after which none of them may be used
+void symbol_end(void);
+
+// the symbol with the len characters at s, which need not be terminated
+char const* intern_bytes(char const* s, size_t len);
+char const* intern(char const* s);
+
+size_t symbol_hash(char const* sym);
+
+#endif // SYMBOL_H
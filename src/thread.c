@@ -0,0 +1,54 @@
+#include "class.h"
+#include "refmap.h"
+#include "thread.h"
+#include "util.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+Thread_t main_thread;
+
+void thread_init(Thread_t* t, size_t stack_size)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    stack_size = (stack_size + page_size - 1) & ~(page_size - 1);
+
+    // pages are only committed when touched, the trailing guard page catches any overrun
+    void* p = mmap(NULL, stack_size + page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED)
+        errorf("unable to reserve %lu bytes of Java stack", stack_size);
+    if (mprotect((uint8_t*)p + stack_size, page_size, PROT_NONE) != 0)
+        errorf("unable to set up Java stack guard page");
+
+    t->stack.base = p;
+    t->stack.limit = (Slot_t*)((uint8_t*)p + stack_size);
+    t->stack.top = t->stack.base;
+    t->stack.size = stack_size;
+
+    t->frames = NULL;
+    t->tlab.top = t->tlab.end = NULL;
+}
+
+void thread_end(Thread_t* t)
+{
+    munmap(t->stack.base, t->stack.size + sysconf(_SC_PAGESIZE));
+}
+
+void walk_frame_roots(Thread_t* t, void (*visit)(Slot_t* slot))
+{
+    for (Frame_t* f = t->frames; f != NULL; f = f->prev) {
+        if (f->ip == NULL) {
+            for (size_t i = 0; i < f->sp + 1; ++i)
+                visit(&f->stack[i]);
+            continue;
+        }
+        uint32_t const* map = ref_map_at(f->method, f->ip->pc);
+        size_t max_locals = f->method->max_locals;
+        for (size_t i = 0; i < max_locals; ++i)
+            if (ref_map_test(map, i))
+                visit(&f->locals[i]);
+        for (size_t i = 0; i < f->sp + 1; ++i)
+            if (ref_map_test(map, max_locals + i))
+                visit(&f->stack[i]);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include "class.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Activation of a Java method. The collector finds the references a frame
+ * holds from the reference map at ip (see refmap.h): locals, then
+ * stack[0..sp]. The interpreter and the baseline compiler publish ip and sp
+ * before anything that may allocate, leaving out the arguments of a call as
+ * the callee's frame covers those. Optimized code has no reference maps and
+ * sets ip to NULL instead, stack then being its spill slots for references,
+ * all of stack[0..sp].
+ */
+typedef struct Frame {
+    struct Frame* prev; // caller's
+    Class_t const* class;
+    Method_t* method; // not const, exec() counts its back edges
+
+    Insn_t* ip; // instruction being executed
+
+    Slot_t* locals;
+
+    size_t sp; // points to top of the stack (-1 for empty stack)
+    Slot_t* stack;
+} Frame_t;
+
+typedef struct Thread {
+    /*
+     * Java stack: frames are laid out back to back as [locals][operand stack]
+     * and a callee's locals start at the arguments its caller pushed.
+     */
+    struct {
+        Slot_t* base;
+        Slot_t* limit;
+        Slot_t* top; // first slot past the innermost frame
+        size_t size; // in bytes, excluding the guard page
+    } stack;
+    Frame_t* frames; // innermost
+    // thread local allocation buffer, the part of the heap only this thread allocates from (see gc.h)
+    struct {
+        uint8_t* top;
+        uint8_t* end;
+    } tlab;
+} Thread_t;
+
+extern Thread_t main_thread;
+
+void thread_init(Thread_t* t, size_t stack_size);
+void thread_end(Thread_t* t);
+
+// call visit on each slot of the frames of t holding a reference, innermost frame first
+void walk_frame_roots(Thread_t* t, void (*visit)(Slot_t* slot));
+
+static inline int in_java_stack(Thread_t const* t, Slot_t const* p)
+{
+    return p >= t->stack.base && p < t->stack.limit;
+}
+
+#endif // THREAD_H
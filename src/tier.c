@@ -0,0 +1,51 @@
+#include "class.h"
+#include "jit.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef JIT
+
+uint32_t jit_threshold, opt_threshold, osr_threshold;
+
+void tier_up(Method_t* m)
+{
+    uint32_t n = ++m->jit.invocations;
+    // a single attempt for the optimizing compiler, the baseline one marks failures itself
+    if (n == opt_threshold && opt_compile(m))
+        return;
+    if (m->jit.code.entry == NULL && !m->jit.failed && n >= jit_threshold)
+        jit_compile(m);
+}
+
+Slot_t (*osr_entry(Method_t* m, Insn_t const* branch))(Slot_t* locals, struct Frame* frame)
+{
+    JitCode_t* osr = &m->jit.osr[branch->loop];
+    // counting goes on past the threshold, so a loop that cannot be compiled is only tried once
+    if (osr->code == NULL && m->jit.backedges[branch->loop] == osr_threshold)
+        opt_compile_osr(m, branch->target, osr);
+    return osr->entry;
+}
+
+void tier_invalidate(Method_t* m, int loop)
+{
+    // the code stays correct until replaced, its checks failing over to virtual calls
+    if (loop >= 0) {
+        jit_retire(m, &m->jit.osr[loop]);
+        m->jit.backedges[loop] = 0;
+    } else if (m->jit.tier == TIER_OPT) {
+        m->jit.tier = TIER_BASELINE;
+        m->jit.invocations = 0;
+    }
+}
+
+void jit_retire(Method_t* m, JitCode_t* code)
+{
+    if (code->code == NULL)
+        return;
+    m->jit.retired = realloc(m->jit.retired, sizeof(m->jit.retired[0]) * (m->jit.nr_retired + 1));
+    m->jit.retired[m->jit.nr_retired++] = *code;
+    *code = (JitCode_t) { 0 };
+}
+
+#endif
@@ -0,0 +1,301 @@
+#include "class.h"
+#include "loader.h"
+#include "opcode.h"
+#include "translate.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static size_t insn_length(Method_t const* m, size_t pc)
+{
+    enum opcode op = m->code[pc];
+    switch (op) {
+    case BIPUSH:
+    case LDC:
+    case ILOAD:
+    case LLOAD:
+    case FLOAD:
+    case DLOAD:
+    case ALOAD:
+    case ISTORE:
+    case LSTORE:
+    case FSTORE:
+    case DSTORE:
+    case ASTORE:
+        return 2;
+    case SIPUSH:
+    case IINC:
+    case LDC_W:
+    case LDC2_W:
+    case IFEQ:
+    case IFNE:
+    case IFLT:
+    case IFGE:
+    case IFGT:
+    case IFLE:
+    case IF_ICMPEQ:
+    case IF_ICMPNE:
+    case IF_ICMPLT:
+    case IF_ICMPGE:
+    case IF_ICMPGT:
+    case IF_ICMPLE:
+    case IF_ACMPEQ:
+    case IF_ACMPNE:
+    case GOTO:
+    case GETSTATIC:
+    case PUTSTATIC:
+    case GETFIELD:
+    case PUTFIELD:
+    case INVOKEVIRTUAL:
+    case INVOKESPECIAL:
+    case INVOKESTATIC:
+    case NEW:
+        return 3;
+    default:
+        if (op >= GETSTATIC_QUICK || get_string(op)[0] == '\0')
+            errorf("unsupported opcode 0x%x at %s.%s:%lu", op, m->c->name, m->name, pc);
+        return 1;
+    }
+}
+
+static uint16_t u2_operand(Method_t const* m, size_t pc)
+{
+    uint16_t u;
+    memcpy(&u, &m->code[pc + 1], sizeof(u));
+    return u2_from_big_endian(u);
+}
+
+// constant pool index i, the operand of the instruction at pc, checked to be in the pool and tagged tag, or tag2 if that is not 0
+static size_t constant_operand(Method_t const* m, size_t pc, size_t i, enum ConstType tag, enum ConstType tag2)
+{
+    Const_t const* list = m->c->constant_pool.list;
+    if (i == 0 || i > m->c->constant_pool.size || (list[i - 1].tag != tag && (tag2 == 0 || list[i - 1].tag != tag2)))
+        errorf("bad constant pool index %lu for %s at %s.%s:%lu", i, get_string(m->code[pc]), m->c->name, m->name, pc);
+    return i;
+}
+
+static void decode_constant(Insn_t* insn, Const_t const* c)
+{
+    switch (c->tag) {
+    case CONST_INT:
+        insn->type = I;
+        insn->i = c->i;
+        break;
+    case CONST_FLOAT:
+        insn->type = F;
+        insn->f = c->f;
+        break;
+    case CONST_LONG:
+        insn->type = L;
+        insn->l = c->l;
+        break;
+    case CONST_DOUBLE:
+        insn->type = D;
+        insn->d = c->d;
+        break;
+    default:
+        errorf("unsupported constant tag 0x%x for ldc", c->tag);
+    }
+}
+
+void translate_method(Method_t* m)
+{
+    size_t nr_insns = 0;
+    // maps bytecode offsets to instruction indices, (size_t)-1 if not an instruction boundary
+    size_t* insn_at = malloc(sizeof(insn_at[0]) * m->code_length);
+    for (size_t pc = 0; pc < m->code_length; ++pc)
+        insn_at[pc] = -1;
+    for (size_t pc = 0, length; pc < m->code_length; pc += length) {
+        length = insn_length(m, pc);
+        // its operands must not run past the end of the code
+        if (length > m->code_length - pc)
+            errorf("truncated instruction %s at %s.%s:%lu", get_string(m->code[pc]), m->c->name, m->name, pc);
+        insn_at[pc] = nr_insns++;
+    }
+
+    Insn_t* insns = arena_calloc(&class_metadata, nr_insns, sizeof(insns[0]));
+    Const_t const* constant_pool_list = m->c->constant_pool.list;
+    for (size_t pc = 0; pc < m->code_length; pc += insn_length(m, pc)) {
+        Insn_t* insn = &insns[insn_at[pc]];
+        memset(insn, 0, sizeof(*insn));
+        enum opcode op = m->code[pc];
+        insn->op = op;
+        insn->pc = pc;
+
+        switch (op) {
+        case ICONST_M1:
+        case ICONST_0:
+        case ICONST_1:
+        case ICONST_2:
+        case ICONST_3:
+        case ICONST_4:
+        case ICONST_5:
+            insn->i = (int32_t)op - (int32_t)ICONST_0;
+            break;
+        case LCONST_0:
+        case LCONST_1:
+            insn->l = op - LCONST_0;
+            break;
+        case FCONST_0:
+        case FCONST_1:
+        case FCONST_2:
+            insn->f = op - FCONST_0;
+            break;
+        case DCONST_0:
+        case DCONST_1:
+            insn->d = op - DCONST_0;
+            break;
+        case BIPUSH:
+            insn->i = (int8_t)m->code[pc + 1];
+            break;
+        case SIPUSH:
+            insn->i = (int16_t)u2_operand(m, pc);
+            break;
+        case LDC:
+            decode_constant(insn, &constant_pool_list[constant_operand(m, pc, m->code[pc + 1], CONST_INT, CONST_FLOAT) - 1]);
+            break;
+        case LDC_W:
+            decode_constant(insn, &constant_pool_list[constant_operand(m, pc, u2_operand(m, pc), CONST_INT, CONST_FLOAT) - 1]);
+            break;
+        case LDC2_W:
+            decode_constant(insn, &constant_pool_list[constant_operand(m, pc, u2_operand(m, pc), CONST_LONG, CONST_DOUBLE) - 1]);
+            break;
+        case ILOAD:
+        case LLOAD:
+        case FLOAD:
+        case DLOAD:
+        case ALOAD:
+        case ISTORE:
+        case LSTORE:
+        case FSTORE:
+        case DSTORE:
+        case ASTORE:
+            insn->index = m->code[pc + 1];
+            break;
+        case ILOAD_0:
+        case ILOAD_1:
+        case ILOAD_2:
+        case ILOAD_3:
+            insn->index = op - ILOAD_0;
+            break;
+        case LLOAD_0:
+        case LLOAD_1:
+        case LLOAD_2:
+        case LLOAD_3:
+            insn->index = op - LLOAD_0;
+            break;
+        case FLOAD_0:
+        case FLOAD_1:
+        case FLOAD_2:
+        case FLOAD_3:
+            insn->index = op - FLOAD_0;
+            break;
+        case DLOAD_0:
+        case DLOAD_1:
+        case DLOAD_2:
+        case DLOAD_3:
+            insn->index = op - DLOAD_0;
+            break;
+        case ALOAD_0:
+        case ALOAD_1:
+        case ALOAD_2:
+        case ALOAD_3:
+            insn->index = op - ALOAD_0;
+            break;
+        case ISTORE_0:
+        case ISTORE_1:
+        case ISTORE_2:
+        case ISTORE_3:
+            insn->index = op - ISTORE_0;
+            break;
+        case LSTORE_0:
+        case LSTORE_1:
+        case LSTORE_2:
+        case LSTORE_3:
+            insn->index = op - LSTORE_0;
+            break;
+        case FSTORE_0:
+        case FSTORE_1:
+        case FSTORE_2:
+        case FSTORE_3:
+            insn->index = op - FSTORE_0;
+            break;
+        case DSTORE_0:
+        case DSTORE_1:
+        case DSTORE_2:
+        case DSTORE_3:
+            insn->index = op - DSTORE_0;
+            break;
+        case ASTORE_0:
+        case ASTORE_1:
+        case ASTORE_2:
+        case ASTORE_3:
+            insn->index = op - ASTORE_0;
+            break;
+        case IINC:
+            insn->index = m->code[pc + 1];
+            insn->i = (int8_t)m->code[pc + 2];
+            break;
+        case IFEQ:
+        case IFNE:
+        case IFLT:
+        case IFGE:
+        case IFGT:
+        case IFLE:
+        case IF_ICMPEQ:
+        case IF_ICMPNE:
+        case IF_ICMPLT:
+        case IF_ICMPGE:
+        case IF_ICMPGT:
+        case IF_ICMPLE:
+        case IF_ACMPEQ:
+        case IF_ACMPNE:
+        case GOTO: {
+            size_t target = pc + (int16_t)u2_operand(m, pc);
+            if (target >= m->code_length || insn_at[target] == (size_t)-1)
+                errorf("bad branch target %lu at %s.%s:%lu", target, m->c->name, m->name, pc);
+            insn->target = &insns[insn_at[target]];
+        } break;
+        case GETSTATIC:
+        case PUTSTATIC:
+        case GETFIELD:
+        case PUTFIELD:
+            insn->index = constant_operand(m, pc, u2_operand(m, pc), CONST_FIELD, 0);
+            break;
+        case INVOKEVIRTUAL:
+        case INVOKESPECIAL:
+        case INVOKESTATIC:
+            insn->index = constant_operand(m, pc, u2_operand(m, pc), CONST_METHOD, 0);
+            break;
+        case NEW:
+            insn->index = constant_operand(m, pc, u2_operand(m, pc), CONST_CLASS, 0);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // number the loops, one per header some backward branch jumps to
+    uint16_t* loop_at = malloc(sizeof(loop_at[0]) * nr_insns);
+    for (size_t i = 0; i < nr_insns; ++i)
+        loop_at[i] = (uint16_t)-1;
+    for (size_t i = 0; i < nr_insns; ++i) {
+        Insn_t* insn = &insns[i];
+        if (insn->op < IFEQ || insn->op > GOTO || insn->target > insn)
+            continue;
+        size_t header = insn->target - insns;
+        if (loop_at[header] == (uint16_t)-1)
+            loop_at[header] = m->nr_loops++;
+        insn->loop = loop_at[header];
+    }
+#ifdef JIT
+    m->jit.backedges = arena_calloc(&class_metadata, m->nr_loops, sizeof(m->jit.backedges[0]));
+    m->jit.osr = arena_calloc(&class_metadata, m->nr_loops, sizeof(m->jit.osr[0]));
+#endif
+
+    free(loop_at);
+    free(insn_at);
+    m->insns = insns;
+    m->nr_insns = nr_insns;
+}
@@ -0,0 +1,9 @@
+#ifndef TRANSLATE_H
+#define TRANSLATE_H
+
+#include "class.h"
+
+// decode m->code into m->insns, numbering its loops (see Method_t::nr_loops)
+void translate_method(Method_t* m);
+
+#endif // TRANSLATE_H
@@ -0,0 +1,555 @@
+#include "typeflow.h"
+#include "class.h"
+#include "inline_cache.h"
+#include "loader.h"
+#include "opcode.h"
+#include "superinsn.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// slot types in the order the JVM lays out typed opcode families
+static uint8_t const jvm_types[] = { I, L, F, D, A };
+// operand and result types of I2L to I2S
+static uint8_t const conversions[][2] = {
+    { I, L }, { I, F }, { I, D },
+    { L, I }, { L, F }, { L, D },
+    { F, I }, { F, L }, { F, D },
+    { D, I }, { D, L }, { D, F },
+    { I, I }, { I, I }, { I, I },
+};
+
+typedef struct {
+    Method_t const* m;
+    Insn_t const* insn;
+    uint8_t* locals;
+    uint8_t* stack;
+    size_t sp; // number of live stack entries
+} TypeState_t;
+
+// arrays are references as far as slots are concerned
+static uint8_t slot_type(uint8_t type)
+{
+    return (type == ARR ? A : type);
+}
+static char const* type_name(uint8_t type)
+{
+    switch (type) {
+    case I:
+        return "int";
+    case F:
+        return "float";
+    case L:
+        return "long";
+    case D:
+        return "double";
+    case T_TOP:
+        return "nothing usable";
+    default:
+        return "a reference";
+    }
+}
+
+static void push(TypeState_t* s, uint8_t type)
+{
+    if (s->sp == s->m->max_stack)
+        errorf("operand stack overflow at %s.%s:%u", s->m->c->name, s->m->name, s->insn->pc);
+    s->stack[s->sp++] = slot_type(type);
+}
+static uint8_t pop(TypeState_t* s)
+{
+    if (s->sp == 0)
+        errorf("operand stack underflow at %s.%s:%u", s->m->c->name, s->m->name, s->insn->pc);
+    return s->stack[--s->sp];
+}
+// pop a value that must be of type
+static void pop_type(TypeState_t* s, uint8_t type)
+{
+    uint8_t found = pop(s);
+    if (found != slot_type(type))
+        errorf("expected %s but found %s on the operand stack at %s.%s:%u", type_name(type), type_name(found), s->m->c->name, s->m->name, s->insn->pc);
+}
+static void pop_types(TypeState_t* s, uint8_t type, size_t n)
+{
+    while (n-- > 0)
+        pop_type(s, type);
+}
+static void check_range(TypeState_t* s, uint16_t index, uint8_t type)
+{
+    int wide = (type == L || type == D);
+    if (index + wide >= s->m->max_locals)
+        errorf("local variable %u out of range at %s.%s:%u", index, s->m->c->name, s->m->name, s->insn->pc);
+}
+static void check_local(TypeState_t* s, uint16_t index, uint8_t type)
+{
+    check_range(s, index, type);
+    if (s->locals[index] != type)
+        errorf("local variable %u holds %s, not %s, at %s.%s:%u", index, type_name(s->locals[index]), type_name(type), s->m->c->name, s->m->name, s->insn->pc);
+}
+static void store(TypeState_t* s, uint16_t index, uint8_t type)
+{
+    int wide = (type == L || type == D);
+    check_range(s, index, type);
+    // overwriting the second half of a long or double clobbers the whole value
+    if (index > 0 && (s->locals[index - 1] == L || s->locals[index - 1] == D))
+        s->locals[index - 1] = T_TOP;
+    s->locals[index] = type;
+    if (wide)
+        s->locals[index + 1] = T_TOP;
+}
+static void invoke(TypeState_t* s, Signature_t const* sig)
+{
+    for (size_t i = sig->nr_args; i-- > 0;)
+        pop_type(s, sig->arg_types[i]);
+    if (sig->returns)
+        push(s, sig->ret_type);
+}
+static void invoke_ref(TypeState_t* s, int has_receiver)
+{
+    char const* desc = resolve_ref_desc(s->m->c->constant_pool.list, s->insn->index);
+    uint8_t arg_types[256];
+    Signature_t sig = { .arg_types = arg_types };
+    if (nr_desc_args(desc) + has_receiver > sizeof(arg_types))
+        errorf("too many arguments in %s at %s.%s:%u", desc, s->m->c->name, s->m->name, s->insn->pc);
+    parse_desc(&sig, desc, has_receiver);
+    invoke(s, &sig);
+}
+static uint8_t field_type(TypeState_t* s)
+{
+    return get_value_type(resolve_ref_desc(s->m->c->constant_pool.list, s->insn->index)[0]);
+}
+
+// apply the effect of s->insn to the types in s
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic" // case ranges
+static void transfer(TypeState_t* s)
+{
+    Insn_t const* insn = s->insn;
+    enum opcode op = unfused_op(s->m, insn);
+    switch (op) {
+    case NOP:
+        break;
+    case ACONST_NULL:
+        push(s, A);
+        break;
+    case ICONST_M1:
+    case ICONST_0:
+    case ICONST_1:
+    case ICONST_2:
+    case ICONST_3:
+    case ICONST_4:
+    case ICONST_5:
+    case BIPUSH:
+    case SIPUSH:
+        push(s, I);
+        break;
+    case LCONST_0:
+    case LCONST_1:
+        push(s, L);
+        break;
+    case FCONST_0:
+    case FCONST_1:
+    case FCONST_2:
+        push(s, F);
+        break;
+    case DCONST_0:
+    case DCONST_1:
+        push(s, D);
+        break;
+    case LDC:
+    case LDC_W:
+    case LDC2_W:
+        push(s, insn->type);
+        break;
+    case ILOAD:
+    case LLOAD:
+    case FLOAD:
+    case DLOAD:
+    case ALOAD:
+    case ILOAD_0 ... ALOAD_3: {
+        uint8_t type = (op <= ALOAD ? jvm_types[op - ILOAD] : jvm_types[(op - ILOAD_0) / 4]);
+        check_local(s, insn->index, type);
+        push(s, type);
+    } break;
+    case ISTORE:
+    case LSTORE:
+    case FSTORE:
+    case DSTORE:
+    case ASTORE:
+    case ISTORE_0 ... ASTORE_3: {
+        uint8_t type = (op <= ASTORE ? jvm_types[op - ISTORE] : jvm_types[(op - ISTORE_0) / 4]);
+        pop_type(s, type);
+        store(s, insn->index, type);
+    } break;
+    case IINC:
+        check_local(s, insn->index, I);
+        break;
+    case POP:
+        pop(s);
+        break;
+    case DUP: {
+        uint8_t t = pop(s);
+        push(s, t);
+        push(s, t);
+    } break;
+    case SWAP: {
+        uint8_t b = pop(s), a = pop(s);
+        push(s, b);
+        push(s, a);
+    } break;
+    case IADD ... DREM:
+        pop_types(s, jvm_types[(op - IADD) % 4], 2);
+        push(s, jvm_types[(op - IADD) % 4]);
+        break;
+    case INEG ... DNEG:
+        pop_type(s, jvm_types[op - INEG]);
+        push(s, jvm_types[op - INEG]);
+        break;
+    case ISHL ... LUSHR:
+        // shift counts are ints whatever the type shifted
+        pop_type(s, I);
+        pop_type(s, jvm_types[(op - ISHL) % 2]);
+        push(s, jvm_types[(op - ISHL) % 2]);
+        break;
+    case IAND ... LXOR:
+        pop_types(s, jvm_types[(op - IAND) % 2], 2);
+        push(s, jvm_types[(op - IAND) % 2]);
+        break;
+    case I2L ... I2S:
+        pop_type(s, conversions[op - I2L][0]);
+        push(s, conversions[op - I2L][1]);
+        break;
+    case LCMP:
+        pop_types(s, L, 2);
+        push(s, I);
+        break;
+    case FCMPL:
+    case FCMPG:
+        pop_types(s, F, 2);
+        push(s, I);
+        break;
+    case DCMPL:
+    case DCMPG:
+        pop_types(s, D, 2);
+        push(s, I);
+        break;
+    case IFEQ ... IFLE:
+        pop_type(s, I);
+        break;
+    case IF_ICMPEQ ... IF_ICMPLE:
+        pop_types(s, I, 2);
+        break;
+    case IF_ACMPEQ:
+    case IF_ACMPNE:
+        pop_types(s, A, 2);
+        break;
+    case GOTO:
+        break;
+    case IRETURN ... ARETURN:
+        if (!s->m->sig.returns || slot_type(s->m->sig.ret_type) != jvm_types[op - IRETURN])
+            errorf("%s does not match the return type at %s.%s:%u", get_string(op), s->m->c->name, s->m->name, insn->pc);
+        pop_type(s, jvm_types[op - IRETURN]);
+        break;
+    case RETURN:
+        if (s->m->sig.returns)
+            errorf("RETURN does not match the return type at %s.%s:%u", s->m->c->name, s->m->name, insn->pc);
+        break;
+    case GETSTATIC:
+        push(s, field_type(s));
+        break;
+    case PUTSTATIC:
+        pop_type(s, field_type(s));
+        break;
+    case GETFIELD:
+        pop_type(s, A);
+        push(s, field_type(s));
+        break;
+    case PUTFIELD:
+        pop_type(s, field_type(s));
+        pop_type(s, A);
+        break;
+    case INVOKEVIRTUAL:
+    case INVOKESPECIAL:
+        invoke_ref(s, 1);
+        break;
+    case INVOKESTATIC:
+        invoke_ref(s, 0);
+        break;
+    case NEW:
+    case NEW_QUICK:
+        push(s, A);
+        break;
+
+    // quickened instructions, for code rewritten after loading
+    case GETSTATIC_QUICK:
+        push(s, get_value_type(insn->field->desc[0]));
+        break;
+    case PUTSTATIC_QUICK:
+        pop_type(s, get_value_type(insn->field->desc[0]));
+        break;
+    case GETFIELD_QUICK:
+        pop_type(s, A);
+        push(s, insn->type);
+        break;
+    case PUTFIELD_QUICK:
+        pop_type(s, insn->type);
+        pop_type(s, A);
+        break;
+    case INVOKEVIRTUAL_MONO:
+    case INVOKEVIRTUAL_POLY:
+    case INVOKEVIRTUAL_MEGA:
+    case INVOKEVIRTUAL_DIRECT:
+        invoke(s, &insn->ic->method->sig);
+        break;
+    case INVOKESPECIAL_QUICK:
+    case INVOKESTATIC_QUICK:
+        invoke(s, &insn->method->sig);
+        break;
+    default:
+        errorf("unsupported opcode 0x%x at %s.%s:%u", op, s->m->c->name, s->m->name, insn->pc);
+    }
+}
+#pragma GCC diagnostic pop
+
+static int falls_through(enum opcode op)
+{
+    return op != GOTO && !(op >= IRETURN && op <= RETURN);
+}
+static int branches(enum opcode op)
+{
+    return op >= IFEQ && op <= GOTO;
+}
+
+/*
+ * Forward dataflow over the instruction stream: a worklist of instructions
+ * whose entry row changed, where joining two rows turns every slot that
+ * disagrees into T_TOP. Rows only ever move towards T_TOP, so this
+ * terminates.
+ */
+void infer_types(Method_t* m)
+{
+    size_t width = m->max_locals + m->max_stack;
+    uint8_t* types = arena_alloc(&class_metadata, width * m->nr_insns + 1);
+    uint16_t* depth = arena_calloc(&class_metadata, m->nr_insns, sizeof(depth[0]));
+    for (size_t i = 0; i < m->nr_insns; ++i)
+        depth[i] = DEPTH_UNREACHED;
+
+    size_t nr_pending = 0;
+    size_t* pending = malloc(sizeof(pending[0]) * m->nr_insns);
+    uint8_t* queued = calloc(m->nr_insns, 1);
+
+    // entry: the arguments, wide ones taking two locals
+    memset(types, T_TOP, width);
+    if (m->sig.nr_slots > m->max_locals)
+        errorf("arguments of %s.%s do not fit its locals", m->c->name, m->name);
+    for (size_t i = 0, slot = 0; i < m->sig.nr_args; ++i) {
+        types[slot] = slot_type(m->sig.arg_types[i]);
+        slot += (types[slot] == L || types[slot] == D ? 2 : 1);
+    }
+    depth[0] = 0;
+    pending[nr_pending++] = 0;
+    queued[0] = 1;
+
+    uint8_t* row = malloc(width + 1);
+    TypeState_t s = { .m = m, .locals = row, .stack = row + m->max_locals };
+    while (nr_pending > 0) {
+        size_t i = pending[--nr_pending];
+        queued[i] = 0;
+
+        memcpy(row, &types[i * width], width);
+        s.insn = &m->insns[i];
+        s.sp = depth[i];
+        transfer(&s);
+        memset(s.stack + s.sp, T_TOP, m->max_stack - s.sp);
+
+        size_t succ[2], nr_succ = 0;
+        if (falls_through(s.insn->op)) {
+            if (i + 1 == m->nr_insns)
+                errorf("control falls off the end of %s.%s", m->c->name, m->name);
+            succ[nr_succ++] = i + 1;
+        }
+        if (branches(s.insn->op))
+            succ[nr_succ++] = s.insn->target - m->insns;
+
+        for (size_t k = 0; k < nr_succ; ++k) {
+            size_t j = succ[k];
+            uint8_t* to = &types[j * width];
+            int changed = 0;
+            if (depth[j] == DEPTH_UNREACHED) {
+                memcpy(to, row, width);
+                depth[j] = s.sp;
+                changed = 1;
+            } else {
+                if (depth[j] != s.sp)
+                    errorf("inconsistent stack depth at %s.%s:%u", m->c->name, m->name, m->insns[j].pc);
+                for (size_t n = 0; n < width; ++n)
+                    if (to[n] != row[n] && to[n] != T_TOP) {
+                        // locals may disagree until they are used, the operand stack may not
+                        if (n >= m->max_locals)
+                            errorf("inconsistent stack types at %s.%s:%u", m->c->name, m->name, m->insns[j].pc);
+                        to[n] = T_TOP;
+                        changed = 1;
+                    }
+            }
+            if (changed && !queued[j]) {
+                pending[nr_pending++] = j;
+                queued[j] = 1;
+            }
+        }
+    }
+
+    free(row);
+    free(queued);
+    free(pending);
+    for (size_t i = 0; i < m->nr_insns; ++i)
+        if (depth[i] == DEPTH_UNREACHED)
+            memset(&types[i * width], T_TOP, width);
+
+    m->slot_types = types;
+    m->stack_depth = depth;
+}
+
+// a verification_type_info of a StackMapTable frame as a slot type, returning where the next one starts
+static uint8_t const* map_type(Method_t const* m, uint8_t const* p, uint8_t const* end, uint8_t* type)
+{
+    if (p >= end)
+        errorf("truncated StackMapTable in %s.%s", m->c->name, m->name);
+    switch (*p++) {
+    case 0:
+        *type = T_TOP;
+        break;
+    case 1:
+        *type = I;
+        break;
+    case 2:
+        *type = F;
+        break;
+    case 3:
+        *type = D;
+        break;
+    case 4:
+        *type = L;
+        break;
+    case 5: // null
+    case 6: // uninitialized this
+        *type = A;
+        break;
+    case 7: // object, by class
+    case 8: // uninitialized, by the offset of its NEW
+        if (p + 2 > end)
+            errorf("truncated StackMapTable in %s.%s", m->c->name, m->name);
+        p += 2;
+        *type = A;
+        break;
+    default:
+        errorf("bad StackMapTable entry in %s.%s", m->c->name, m->name);
+    }
+    return p;
+}
+
+// the types of a frame must hold on entry to the instruction at pc, where a local of type T_TOP may hold anything
+static void check_frame(Method_t const* m, size_t pc, uint8_t const* locals, size_t nr_locals, uint8_t const* stack, size_t nr_stack)
+{
+    size_t lo = 0, hi = m->nr_insns;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (m->insns[mid].pc < pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == m->nr_insns || m->insns[lo].pc != pc)
+        errorf("StackMapTable frame at %s.%s:%lu is not at an instruction", m->c->name, m->name, pc);
+    Insn_t const* insn = &m->insns[lo];
+    if (m->stack_depth[lo] == DEPTH_UNREACHED)
+        return;
+
+    int agrees = (nr_stack == m->stack_depth[lo]);
+    uint8_t const* types = local_types_at(m, insn);
+    for (size_t k = 0, slot = 0; k < nr_locals && agrees; ++k) {
+        agrees = (locals[k] == T_TOP || locals[k] == types[slot]);
+        slot += (locals[k] == L || locals[k] == D ? 2 : 1);
+    }
+    for (size_t k = 0; k < nr_stack && agrees; ++k)
+        agrees = (stack[k] == stack_types_at(m, insn)[k]);
+    if (!agrees)
+        errorf("types at %s.%s:%u contradict its StackMapTable", m->c->name, m->name, insn->pc);
+}
+
+void check_stack_map(Method_t const* m, uint8_t const* map, size_t size)
+{
+    uint8_t const* end = map + size;
+    if (size < 2)
+        errorf("truncated StackMapTable in %s.%s", m->c->name, m->name);
+    size_t nr_frames = u2_at(map);
+    uint8_t const* p = map + 2;
+
+    // frames describe locals one entry per value, longs and doubles included
+    uint8_t* locals = malloc(m->max_locals + 1);
+    uint8_t* stack = malloc(m->max_stack + 1);
+    size_t nr_locals = 0, nr_stack = 0;
+    for (size_t i = 0; i < m->sig.nr_args; ++i)
+        locals[nr_locals++] = slot_type(m->sig.arg_types[i]);
+
+    size_t pc = 0;
+    for (size_t k = 0; k < nr_frames; ++k) {
+        if (p >= end)
+            errorf("truncated StackMapTable in %s.%s", m->c->name, m->name);
+        uint8_t tag = *p++;
+        size_t delta = tag;
+        if (tag >= 64 && tag < 128)
+            delta = tag - 64;
+        else if (tag >= 128) {
+            if (tag < 247 || p + 2 > end)
+                errorf("bad StackMapTable frame in %s.%s", m->c->name, m->name);
+            delta = u2_at(p);
+            p += 2;
+        }
+
+        size_t nr_new = 0;
+        nr_stack = 0;
+        if (tag < 64 || tag == 251)
+            ; // same locals, no stack
+        else if (tag < 128 || tag == 247)
+            p = map_type(m, p, end, &stack[nr_stack++]);
+        else if (tag < 251) {
+            if (nr_locals < (size_t)(251 - tag))
+                errorf("bad StackMapTable frame in %s.%s", m->c->name, m->name);
+            nr_locals -= 251 - tag;
+        } else if (tag < 255)
+            nr_new = tag - 251;
+        else {
+            if (p + 2 > end)
+                errorf("truncated StackMapTable in %s.%s", m->c->name, m->name);
+            nr_locals = 0;
+            nr_new = u2_at(p);
+            p += 2;
+        }
+        for (size_t n = 0; n < nr_new; ++n) {
+            if (nr_locals == m->max_locals)
+                errorf("StackMapTable of %s.%s has too many locals", m->c->name, m->name);
+            p = map_type(m, p, end, &locals[nr_locals++]);
+        }
+        if (tag == 255) {
+            if (p + 2 > end)
+                errorf("truncated StackMapTable in %s.%s", m->c->name, m->name);
+            size_t nr = u2_at(p);
+            p += 2;
+            if (nr > m->max_stack)
+                errorf("StackMapTable of %s.%s has too deep a stack", m->c->name, m->name);
+            for (size_t n = 0; n < nr; ++n)
+                p = map_type(m, p, end, &stack[nr_stack++]);
+        }
+
+        size_t slots = 0;
+        for (size_t n = 0; n < nr_locals; ++n)
+            slots += (locals[n] == L || locals[n] == D ? 2 : 1);
+        if (slots > m->max_locals)
+            errorf("StackMapTable of %s.%s has too many locals", m->c->name, m->name);
+        pc = (k == 0 ? delta : pc + delta + 1);
+        check_frame(m, pc, locals, nr_locals, stack, nr_stack);
+    }
+    free(locals);
+    free(stack);
+}
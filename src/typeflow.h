@@ -0,0 +1,41 @@
+#ifndef TYPEFLOW_H
+#define TYPEFLOW_H
+
+#include "class.h"
+
+#include <stdint.h>
+
+/*
+ * Every instruction of a method gets a row of max_locals + max_stack slot
+ * types describing the frame on entry to it: the locals followed by the
+ * operand stack, of which only the bottom stack_depth entries are live.
+ * Slot types are enum ValueType, or T_TOP for a local that is unset, holds
+ * the second half of a long or double, or holds different types on
+ * different paths.
+ */
+#define T_TOP 0xff
+// stack_depth of instructions no path reaches
+#define DEPTH_UNREACHED ((uint16_t)-1)
+
+/*
+ * Fill in m->slot_types and m->stack_depth from m->insns, verifying m on the
+ * way: code that overflows or underflows the operand stack, uses a local out
+ * of range or one not holding the type it is used as, gives an instruction an
+ * operand of the wrong type, reaches a point with different operand stacks
+ * or falls off its end is rejected with errorf(). The interpreter and the
+ * compilers rely on this instead of checking at run time.
+ */
+void infer_types(Method_t* m);
+// reject m if the types infer_types() found contradict the StackMapTable attribute of its code
+void check_stack_map(Method_t const* m, uint8_t const* map, size_t size);
+
+static inline uint8_t const* local_types_at(Method_t const* m, Insn_t const* insn)
+{
+    return &m->slot_types[(insn - m->insns) * (m->max_locals + m->max_stack)];
+}
+static inline uint8_t const* stack_types_at(Method_t const* m, Insn_t const* insn)
+{
+    return local_types_at(m, insn) + m->max_locals;
+}
+
+#endif // TYPEFLOW_H
@@ -2,6 +2,7 @@
 
 #include <argp.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -51,10 +52,74 @@ void debugf(char const* restrict fmt, ...)
     }
 }
 
+enum {
+    OPT_IC_STATS = 0x100,
+    OPT_STACK_SIZE,
+    OPT_HEAP_SIZE,
+    OPT_YOUNG_SIZE,
+    OPT_TLAB_SIZE,
+    OPT_PROMOTION_AGE,
+    OPT_GC_STATS,
+    OPT_NO_JIT,
+    OPT_NO_OPT,
+    OPT_JIT_THRESHOLD,
+    OPT_OPT_THRESHOLD,
+    OPT_OSR_THRESHOLD,
+};
+
+// a byte count with an optional K, M or G suffix
+static size_t parse_size(char const* arg, struct argp_state* state)
+{
+    char* end;
+    size_t size = strtoull(arg, &end, 10);
+    switch (*end) {
+    case 'g':
+    case 'G':
+        size <<= 10;
+        // fallthrough
+    case 'm':
+    case 'M':
+        size <<= 10;
+        // fallthrough
+    case 'k':
+    case 'K':
+        size <<= 10;
+        ++end;
+        break;
+    }
+    if (end == arg || *end != '\0' || size == 0)
+        argp_error(state, "invalid size '%s'", arg);
+    return size;
+}
+
+// a positive count
+static uint32_t parse_count(char const* arg, uint32_t min, struct argp_state* state)
+{
+    char* end;
+    unsigned long count = strtoul(arg, &end, 10);
+    if (end == arg || *end != '\0' || count < min || count > UINT32_MAX)
+        argp_error(state, "invalid count '%s'", arg);
+    return count;
+}
+
 static char args_doc[] = "MAIN_CLASS";
 static char doc[] = "ajvm -- an implementation of a JVM";
 static struct argp_option options[] = {
     { "debug", 'd', 0, 0, "Produce debugging output" },
+    { "ic-stats", OPT_IC_STATS, 0, 0, "Print inline cache statistics of every INVOKEVIRTUAL site on exit" },
+    { "stack-size", OPT_STACK_SIZE, "SIZE", 0, "Size of the Java stack (default 1M)" },
+    { "heap-size", OPT_HEAP_SIZE, "SIZE", 0, "Size of the heap (default 64M)" },
+    { "young-size", OPT_YOUNG_SIZE, "SIZE", 0, "Size of the young generation, part of the heap (default a quarter of it)" },
+    { "tlab-size", OPT_TLAB_SIZE, "SIZE", 0, "Size of the chunks of heap a thread allocates from without synchronising (default 32K)" },
+    { "promotion-age", OPT_PROMOTION_AGE, "N", 0, "Young collections an object survives before it moves to the old generation (default 3)" },
+    { "gc-stats", OPT_GC_STATS, 0, 0, "Print statistics of each generation of the heap on exit" },
+#ifdef JIT
+    { "no-jit", OPT_NO_JIT, 0, 0, "Run every method in the interpreter" },
+    { "no-opt", OPT_NO_OPT, 0, 0, "Compile every method with the baseline compiler only" },
+    { "jit-threshold", OPT_JIT_THRESHOLD, "N", 0, "Invocations before a method is compiled (default 2)" },
+    { "opt-threshold", OPT_OPT_THRESHOLD, "N", 0, "Invocations before a method is compiled by the optimizing compiler (default 1000)" },
+    { "osr-threshold", OPT_OSR_THRESHOLD, "N", 0, "Taken back edges before a loop running in the interpreter is compiled (default 10000)" },
+#endif
     { 0 },
 };
 static error_t parse_opt(int key, char* arg, struct argp_state* state)
@@ -65,6 +130,42 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state)
     case 'd':
         debug = 1;
         break;
+    case OPT_IC_STATS:
+        cmd_args->ic_stats = 1;
+        break;
+    case OPT_STACK_SIZE:
+        cmd_args->stack_size = parse_size(arg, state);
+        break;
+    case OPT_HEAP_SIZE:
+        cmd_args->heap_size = parse_size(arg, state);
+        break;
+    case OPT_YOUNG_SIZE:
+        cmd_args->young_size = parse_size(arg, state);
+        break;
+    case OPT_TLAB_SIZE:
+        cmd_args->tlab_size = parse_size(arg, state);
+        break;
+    case OPT_PROMOTION_AGE:
+        cmd_args->promotion_age = parse_count(arg, 0, state);
+        break;
+    case OPT_GC_STATS:
+        cmd_args->gc_stats = 1;
+        break;
+    case OPT_NO_JIT:
+        cmd_args->no_jit = 1;
+        break;
+    case OPT_NO_OPT:
+        cmd_args->no_opt = 1;
+        break;
+    case OPT_JIT_THRESHOLD:
+        cmd_args->jit_threshold = parse_count(arg, 1, state);
+        break;
+    case OPT_OPT_THRESHOLD:
+        cmd_args->opt_threshold = parse_count(arg, 1, state);
+        break;
+    case OPT_OSR_THRESHOLD:
+        cmd_args->osr_threshold = parse_count(arg, 1, state);
+        break;
     case ARGP_KEY_ARG:
         if (state->arg_num >= 2)
             argp_usage(state);
@@ -81,8 +182,21 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state)
 }
 struct cmd_args parse_cmd_args(int argc, char** argv)
 {
-    struct cmd_args cmd_args = { NULL };
+    struct cmd_args cmd_args = {
+        .main_class = NULL,
+        .stack_size = 1 << 20,
+        .heap_size = 64 << 20,
+        .tlab_size = 32 << 10,
+        .promotion_age = 3,
+        // the first call runs in the interpreter, which quickens the instructions and counts back edges for OSR
+        .jit_threshold = 2,
+        .opt_threshold = 1000,
+        // a loop of a method called once, such as main(), runs 1% of a 1M iteration run in the interpreter
+        .osr_threshold = 10000,
+    };
     static struct argp argp = { options, parse_opt, args_doc, doc };
     argp_parse(&argp, argc, argv, 0, 0, &cmd_args);
+    if (cmd_args.young_size == 0)
+        cmd_args.young_size = cmd_args.heap_size / 4;
     return cmd_args;
 }
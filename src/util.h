@@ -2,6 +2,8 @@
 #define UTIL_H
 
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #define BOLD "\x1b[1m"
 #define RED "\x1b[31m"
@@ -10,8 +12,20 @@
 #define BLUE "\x1b[34m"
 #define RESET "\x1b[0m"
 
+extern int debug;
+
 struct cmd_args {
     char const* main_class;
+    int ic_stats;
+    size_t stack_size;
+    // see gc.h
+    size_t heap_size, young_size, tlab_size;
+    uint32_t promotion_age;
+    int gc_stats;
+    int no_jit;
+    int no_opt;
+    // see jit.h
+    uint32_t jit_threshold, opt_threshold, osr_threshold;
 };
 struct cmd_args parse_cmd_args(int argc, char** argv);
 
@@ -0,0 +1,16 @@
+package testdata;
+import java.lang.System;
+
+// a tight int loop: no calls, no allocation
+public class Arith {
+    public static void main()
+    {
+        int s = 0;
+        for (int i = 0; i < 20000000; i++) {
+            s = (s + i) << (i & 3) ^ i;
+            if (i > 7)
+                s--;
+        }
+        System.out.println(s);
+    }
+}
@@ -0,0 +1,43 @@
+package testdata;
+import java.lang.System;
+
+// int, long, double and float arithmetic, static and virtual calls, allocation
+public class Bench {
+    static int count;
+
+    static int f(int a, int b)
+    {
+        return (a ^ b) + 1;
+    }
+
+    public static void main()
+    {
+        count = 0;
+        int s = 0;
+        long l = 0;
+        double d = 0;
+        Point p;
+        float fl = 0;
+        for (int i = 0; i < 300000; i++) {
+            s += i * 3;
+            s = f(s, i);
+            l = l * 31 + i;
+            d += i * 0.5;
+            fl += 1.5f;
+
+            p = new Point(i, 1);
+            s += p.call(2);
+            if ((i & 1) != 0)
+                p = new Point3(i, 2, 3);
+            s ^= p.call(1);
+            s += p.getX();
+
+            count++;
+        }
+        System.out.println(s);
+        System.out.println((int)l);
+        System.out.println(d);
+        System.out.println((double)fl);
+        System.out.println(count);
+    }
+}
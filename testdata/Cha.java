@@ -0,0 +1,24 @@
+package testdata;
+import java.lang.System;
+
+// calls devirtualized while ChaBase has no subclass, until ChaSub is loaded halfway through
+public class Cha {
+    static int call(ChaBase b)
+    {
+        return b.f() + b.g();
+    }
+
+    public static void main()
+    {
+        int s = 0;
+        for (int i = 0; i < 40000; i++) {
+            ChaBase b;
+            if (i < 20000)
+                b = new ChaBase();
+            else
+                b = new ChaSub();
+            s = s + call(b) + b.f() + b.g();
+        }
+        System.out.println(s);
+    }
+}
@@ -0,0 +1,16 @@
+package testdata;
+
+public class ChaBase {
+    public int f()
+    {
+        return 1;
+    }
+    // too big to inline
+    public int g()
+    {
+        int s = 0;
+        for (int i = 0; i < 10; i++)
+            s += 3;
+        return s / 10 + 0 + 0 + 0 + 0;
+    }
+}
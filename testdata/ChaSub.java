@@ -0,0 +1,15 @@
+package testdata;
+
+public class ChaSub extends ChaBase {
+    public int f()
+    {
+        return 2;
+    }
+    public int g()
+    {
+        int s = 0;
+        for (int i = 0; i < 10; i++)
+            s += 5;
+        return s / 10 + 0 + 0 + 0 + 0;
+    }
+}
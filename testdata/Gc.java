@@ -0,0 +1,47 @@
+package testdata;
+import java.lang.System;
+
+// a list built before heavy allocation must survive the collections it causes, run with a small heap;
+// keep is old by the time fresh nodes are linked to it, so they are only reachable through its card
+public class Gc {
+    public static void main()
+    {
+        GcNode keep = new GcNode(-1);
+        int j = 0;
+        int k = 0;
+        GcNode head = new GcNode(0);
+        for (int i = 1; i < 1000; i++) {
+            GcNode t = new GcNode(i);
+            t.next = head;
+            head = t;
+        }
+        int junk = 0;
+        for (int i = 0; i < 200000; i++) {
+            GcNode t = new GcNode(i);
+            t.next = new GcNode(i);
+            junk = junk + t.next.value - t.value + 1;
+            if (++j >= 1000) {
+                j = 0;
+                t.next = keep.next;
+                keep.next = t;
+                k++;
+            }
+        }
+        int s = 0;
+        GcNode t = head;
+        for (int i = 0; i < 1000; i++) {
+            s = s + t.value;
+            t = t.next;
+        }
+        System.out.println(s);
+        System.out.println(junk);
+        s = 0;
+        t = keep.next;
+        for (int i = 0; i < k; i++) {
+            s = s + t.value;
+            t = t.next;
+        }
+        System.out.println(k);
+        System.out.println(s);
+    }
+}
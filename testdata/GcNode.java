@@ -0,0 +1,11 @@
+package testdata;
+
+public class GcNode {
+    int value;
+    GcNode next;
+
+    GcNode(int value)
+    {
+        this.value = value;
+    }
+}
@@ -0,0 +1,21 @@
+package testdata;
+import java.lang.System;
+
+// a loop around a small virtual call, taken from a single call of run()
+public class Loop {
+    static int run(Point p, int n)
+    {
+        int s = 0;
+        for (int i = 0; i < n; i++) {
+            s += p.call(i);
+            if (i % 3 == 0)
+                s -= i;
+        }
+        return s;
+    }
+
+    public static void main()
+    {
+        System.out.println(run(new Point(1, 2), 3000000));
+    }
+}
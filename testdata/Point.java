@@ -0,0 +1,19 @@
+package testdata;
+
+public class Point {
+
+    int x, y;
+    Point(int xv, int yv)
+    {
+        x = xv;
+        y = yv;
+    }
+    public int call(int z)
+    {
+        return x + y + z;
+    }
+    public int getX()
+    {
+        return x;
+    }
+}
@@ -0,0 +1,15 @@
+package testdata;
+
+public class Point3 extends Point {
+
+    int z;
+    Point3(int xv, int yv, int zv)
+    {
+        super(xv, yv);
+        z = zv;
+    }
+    public int call(int w)
+    {
+        return z + w + super.call(w);
+    }
+}
@@ -0,0 +1,17 @@
+package testdata;
+import java.lang.System;
+
+// deep recursion: 10000 frames of a static call
+public class Rec {
+    static int rec(int n)
+    {
+        if (n == 0)
+            return 0;
+        return 1 + rec(n - 1);
+    }
+
+    public static void main()
+    {
+        System.out.println(rec(10000));
+    }
+}
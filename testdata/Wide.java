@@ -0,0 +1,38 @@
+package testdata;
+import java.lang.System;
+
+public class Wide {
+    int base;
+    Wide(int b)
+    {
+        base = b;
+    }
+    // a wide argument followed by others, which take the locals after its two
+    public int offset(long x, int y)
+    {
+        return base + (int)x * y;
+    }
+
+    static long scale(long x, int k)
+    {
+        return x * k;
+    }
+    static double mix(double a, double b, int c)
+    {
+        return a - b * c;
+    }
+    static double sum(long a, int b, double c, int d)
+    {
+        return a + b + c + d;
+    }
+
+    public static void main()
+    {
+        System.out.println((int)scale(7L, 6));
+        System.out.println(mix(1.5, 0.25, 2));
+        System.out.println(sum(3L, 4, 5.0, 6));
+
+        Wide w = new Wide(100);
+        System.out.println(w.offset(5L, 3));
+    }
+}